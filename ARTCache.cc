@@ -0,0 +1,497 @@
+#include <cstring>
+#include "ARTCache.h"
+
+using namespace std;
+
+/*
+ * The nodes of the radix tree. An inner node has count children, one per
+ * distinct key byte at its depth, and skips the bytes in prefix before
+ * that byte. A leaf is a key of the cache; it holds the whole key (in its
+ * slot), so the bytes skipped on the way down are only checked there.
+ */
+struct ARTCache::Node {
+  enum { LEAF, NODE4, NODE16, NODE48, NODE256 };
+
+  unsigned char type;
+  int           count;   // # children
+  string        prefix;  // the key bytes skipped below the node
+
+  Node(unsigned char type) : type(type), count(0) {}
+
+  static Node** findChild(Node* node, unsigned char byte);
+  static void addChild(Node*& ref, unsigned char byte, Node* child);
+  static void removeChild(Node*& ref, unsigned char byte);
+  static void destroy(Node* node);
+
+  template<class T> static Node** findSorted(T* node, unsigned char byte);
+  template<class T> static void insertSorted(T* node, unsigned char byte, Node* child);
+  template<class T> static void removeSorted(T* node, unsigned char byte);
+  template<class From, class To> static To* copySorted(From* node);
+};
+
+struct ARTCache::Leaf : Node {
+  int slot;
+  Leaf(int slot) : Node(LEAF), slot(slot) {}
+};
+
+// Node4 and Node16 keep their key bytes sorted
+struct ARTCache::Node4 : Node {
+  unsigned char keys[4];
+  Node*         children[4];
+  Node4() : Node(NODE4) {}
+};
+
+struct ARTCache::Node16 : Node {
+  unsigned char keys[16];
+  Node*         children[16];
+  Node16() : Node(NODE16) {}
+};
+
+struct ARTCache::Node48 : Node {
+  unsigned char index[256];   // 1 + the position of the child of a byte, 0 if none
+  Node*         children[48]; // NULL where a child was removed
+  Node48() : Node(NODE48)
+  {
+    memset(index, 0, sizeof(index));
+    memset(children, 0, sizeof(children));
+  }
+};
+
+struct ARTCache::Node256 : Node {
+  Node* children[256];
+  Node256() : Node(NODE256) { memset(children, 0, sizeof(children)); }
+};
+
+template<class T>
+ARTCache::Node** ARTCache::Node::findSorted(T* node, unsigned char byte)
+{
+  for (int i = 0; i < node->count; i++) {
+    if (node->keys[i] == byte) return &node->children[i];
+  }
+  return NULL;
+}
+
+template<class T>
+void ARTCache::Node::insertSorted(T* node, unsigned char byte, Node* child)
+{
+  int i = node->count;
+  for (; i > 0 && node->keys[i - 1] > byte; i--) {
+    node->keys[i] = node->keys[i - 1];
+    node->children[i] = node->children[i - 1];
+  }
+  node->keys[i] = byte;
+  node->children[i] = child;
+  node->count++;
+}
+
+template<class T>
+void ARTCache::Node::removeSorted(T* node, unsigned char byte)
+{
+  int i = 0;
+  while (node->keys[i] != byte) i++;
+  for (node->count--; i < node->count; i++) {
+    node->keys[i] = node->keys[i + 1];
+    node->children[i] = node->children[i + 1];
+  }
+}
+
+template<class From, class To>
+To* ARTCache::Node::copySorted(From* node)
+{
+  To* copy = new To;
+  copy->prefix = node->prefix;
+  copy->count = node->count;
+  memcpy(copy->keys, node->keys, node->count);
+  memcpy(copy->children, node->children, node->count * sizeof(Node*));
+  return copy;
+}
+
+ARTCache::Node** ARTCache::Node::findChild(Node* node, unsigned char byte)
+{
+  switch (node->type) {
+  case NODE4:
+    return findSorted((Node4*)node, byte);
+  case NODE16:
+    return findSorted((Node16*)node, byte);
+  case NODE48: {
+    Node48* n = (Node48*)node;
+    return n->index[byte] ? &n->children[n->index[byte] - 1] : NULL;
+  }
+  case NODE256: {
+    Node256* n = (Node256*)node;
+    return n->children[byte] ? &n->children[byte] : NULL;
+  }
+  }
+  return NULL;
+}
+
+// Add the child of byte to the node at ref, which is replaced by a larger
+// node if it is full
+void ARTCache::Node::addChild(Node*& ref, unsigned char byte, Node* child)
+{
+  switch (ref->type) {
+  case NODE4: {
+    Node4* n = (Node4*)ref;
+    if (n->count < 4) {
+      insertSorted(n, byte, child);
+      return;
+    }
+    ref = copySorted<Node4, Node16>(n);
+    delete n;
+    insertSorted((Node16*)ref, byte, child);
+    return;
+  }
+  case NODE16: {
+    Node16* n = (Node16*)ref;
+    if (n->count < 16) {
+      insertSorted(n, byte, child);
+      return;
+    }
+    Node48* grown = new Node48;
+    grown->prefix = n->prefix;
+    for (int i = 0; i < n->count; i++) {
+      grown->index[n->keys[i]] = i + 1;
+      grown->children[i] = n->children[i];
+    }
+    grown->count = n->count;
+    delete n;
+    ref = grown;
+    // fall through to add the child to the Node48
+  }
+  case NODE48: {
+    Node48* n = (Node48*)ref;
+    if (n->count < 48) {
+      int i = 0;
+      while (n->children[i] != NULL) i++;
+      n->children[i] = child;
+      n->index[byte] = i + 1;
+      n->count++;
+      return;
+    }
+    Node256* grown = new Node256;
+    grown->prefix = n->prefix;
+    for (int b = 0; b < 256; b++) {
+      if (n->index[b]) grown->children[b] = n->children[n->index[b] - 1];
+    }
+    grown->count = n->count;
+    delete n;
+    ref = grown;
+    // fall through to add the child to the Node256
+  }
+  case NODE256: {
+    Node256* n = (Node256*)ref;
+    n->children[byte] = child;
+    n->count++;
+    return;
+  }
+  }
+}
+
+// Remove the child of byte from the node at ref, which is replaced by a
+// smaller node once it is sparse, or by its child once it has only one
+void ARTCache::Node::removeChild(Node*& ref, unsigned char byte)
+{
+  switch (ref->type) {
+  case NODE4: {
+    Node4* n = (Node4*)ref;
+    removeSorted(n, byte);
+    if (n->count == 1) {
+      Node* child = n->children[0];
+      if (child->type != LEAF) {
+        child->prefix = n->prefix + (char)n->keys[0] + child->prefix;
+      }
+      ref = child;
+      delete n;
+    }
+    return;
+  }
+  case NODE16: {
+    Node16* n = (Node16*)ref;
+    removeSorted(n, byte);
+    if (n->count <= 3) {
+      ref = copySorted<Node16, Node4>(n);
+      delete n;
+    }
+    return;
+  }
+  case NODE48: {
+    Node48* n = (Node48*)ref;
+    n->children[n->index[byte] - 1] = NULL;
+    n->index[byte] = 0;
+    if (--n->count <= 12) {
+      Node16* shrunk = new Node16;
+      shrunk->prefix = n->prefix;
+      for (int b = 0; b < 256; b++) {
+        if (n->index[b]) insertSorted(shrunk, b, n->children[n->index[b] - 1]);
+      }
+      delete n;
+      ref = shrunk;
+    }
+    return;
+  }
+  case NODE256: {
+    Node256* n = (Node256*)ref;
+    n->children[byte] = NULL;
+    if (--n->count <= 37) {
+      Node48* shrunk = new Node48;
+      shrunk->prefix = n->prefix;
+      for (int b = 0; b < 256; b++) {
+        if (n->children[b] == NULL) continue;
+        shrunk->children[shrunk->count] = n->children[b];
+        shrunk->index[b] = ++shrunk->count;
+      }
+      delete n;
+      ref = shrunk;
+    }
+    return;
+  }
+  }
+}
+
+void ARTCache::Node::destroy(Node* node)
+{
+  switch (node->type) {
+  case LEAF:
+    delete (Leaf*)node;
+    return;
+  case NODE4: {
+    Node4* n = (Node4*)node;
+    for (int i = 0; i < n->count; i++) destroy(n->children[i]);
+    delete n;
+    return;
+  }
+  case NODE16: {
+    Node16* n = (Node16*)node;
+    for (int i = 0; i < n->count; i++) destroy(n->children[i]);
+    delete n;
+    return;
+  }
+  case NODE48: {
+    Node48* n = (Node48*)node;
+    for (int i = 0; i < 48; i++) {
+      if (n->children[i] != NULL) destroy(n->children[i]);
+    }
+    delete n;
+    return;
+  }
+  case NODE256: {
+    Node256* n = (Node256*)node;
+    for (int b = 0; b < 256; b++) {
+      if (n->children[b] != NULL) destroy(n->children[b]);
+    }
+    delete n;
+    return;
+  }
+  }
+}
+
+ARTCache::ARTCache(int capacity)
+{
+  this->capacity = (capacity > 0) ? capacity : 1;
+  count = 0;
+  hand = 0;
+  root = NULL;
+}
+
+ARTCache::~ARTCache()
+{
+  if (root != NULL) Node::destroy(root);
+}
+
+void ARTCache::clear()
+{
+  if (root != NULL) Node::destroy(root);
+  root = NULL;
+  slots.clear();
+  leafHeads.clear();
+  count = 0;
+  hand = 0;
+}
+
+int ARTCache::findSlot(const string& key) const
+{
+  Node*    node = root;
+  unsigned depth = 0;
+  while (node != NULL) {
+    if (node->type == Node::LEAF) {
+      int slot = ((Leaf*)node)->slot;
+      return (slots[slot].key == key) ? slot : -1;
+    }
+    depth += node->prefix.size();
+    if (depth >= key.size()) return -1;
+    Node** child = Node::findChild(node, key[depth++]);
+    node = (child != NULL) ? *child : NULL;
+  }
+  return -1;
+}
+
+bool ARTCache::find(const string& key, Entry& entry)
+{
+  int slot = findSlot(key);
+  if (slot < 0) return false;
+  slots[slot].referenced = true;
+  entry = slots[slot].entry;
+  return true;
+}
+
+void ARTCache::insert(const string& key, const Entry& entry)
+{
+  int slot = findSlot(key);
+  if (slot >= 0) {
+    unlink(slot);
+    slots[slot].entry = entry;
+    slots[slot].referenced = true;
+    link(slot);
+    return;
+  }
+
+  slot = takeSlot();
+  Slot& s = slots[slot];
+  s.key = key;
+  s.entry = entry;
+  s.used = true;
+  s.referenced = false;
+  link(slot);
+  insertAt(root, key, 0, new Leaf(slot));
+  count++;
+}
+
+void ARTCache::remove(const string& key)
+{
+  int slot = findSlot(key);
+  if (slot >= 0) evict(slot);
+}
+
+void ARTCache::invalidateLeaf(PageId pid)
+{
+  map<PageId, int>::iterator it = leafHeads.find(pid);
+  if (it == leafHeads.end()) return;
+  for (int slot = it->second; slot >= 0; ) {
+    int next = slots[slot].nextInLeaf;
+    evict(slot);
+    slot = next;
+  }
+}
+
+// a free slot, evicting a key not looked up recently if the cache is full
+int ARTCache::takeSlot()
+{
+  if ((int)slots.size() < capacity) {
+    slots.push_back(Slot());
+    return slots.size() - 1;
+  }
+  // go around the clock; a key looked up since the last round is kept
+  while (true) {
+    int slot = hand;
+    hand = (hand + 1) % capacity;
+    if (!slots[slot].used) return slot;
+    if (slots[slot].referenced) {
+      slots[slot].referenced = false;
+    } else {
+      evict(slot);
+      return slot;
+    }
+  }
+}
+
+void ARTCache::evict(int slot)
+{
+  removeAt(root, slots[slot].key, 0);
+  unlink(slot);
+  slots[slot].used = false;
+  slots[slot].key.clear();
+  count--;
+}
+
+void ARTCache::link(int slot)
+{
+  Slot& s = slots[slot];
+  map<PageId, int>::iterator it = leafHeads.find(s.entry.pid);
+  s.prevInLeaf = -1;
+  s.nextInLeaf = (it != leafHeads.end()) ? it->second : -1;
+  if (s.nextInLeaf >= 0) slots[s.nextInLeaf].prevInLeaf = slot;
+  leafHeads[s.entry.pid] = slot;
+}
+
+void ARTCache::unlink(int slot)
+{
+  Slot& s = slots[slot];
+  if (s.nextInLeaf >= 0) slots[s.nextInLeaf].prevInLeaf = s.prevInLeaf;
+  if (s.prevInLeaf >= 0) {
+    slots[s.prevInLeaf].nextInLeaf = s.nextInLeaf;
+  } else if (s.nextInLeaf >= 0) {
+    leafHeads[s.entry.pid] = s.nextInLeaf;
+  } else {
+    leafHeads.erase(s.entry.pid);
+  }
+}
+
+// Add leaf, whose key is not in the tree yet, below the node at ref. The
+// keys are stored the way the index stores them (fixed-size, or led by
+// their length), so no key is a prefix of another and two keys always
+// differ at some byte of both.
+void ARTCache::insertAt(Node*& ref, const string& key, unsigned depth, Node* leaf)
+{
+  Node* node = ref;
+  if (node == NULL) {
+    ref = leaf;
+    return;
+  }
+
+  // lazy expansion: a leaf is split into a node for the bytes from depth
+  // on that both keys share
+  if (node->type == Node::LEAF) {
+    const string& other = slots[((Leaf*)node)->slot].key;
+    unsigned i = depth;
+    while (key[i] == other[i]) i++;
+    Node* split = new Node4;
+    split->prefix = key.substr(depth, i - depth);
+    Node::addChild(split, key[i], leaf);
+    Node::addChild(split, other[i], node);
+    ref = split;
+    return;
+  }
+
+  // the key leaves the compressed path: a new node takes the shared part
+  unsigned n = 0;
+  while (n < node->prefix.size() && node->prefix[n] == key[depth + n]) n++;
+  if (n < node->prefix.size()) {
+    Node* split = new Node4;
+    split->prefix = node->prefix.substr(0, n);
+    unsigned char byte = node->prefix[n];
+    node->prefix.erase(0, n + 1);
+    Node::addChild(split, byte, node);
+    Node::addChild(split, key[depth + n], leaf);
+    ref = split;
+    return;
+  }
+
+  depth += node->prefix.size();
+  Node** child = Node::findChild(node, key[depth]);
+  if (child != NULL) {
+    insertAt(*child, key, depth + 1, leaf);
+  } else {
+    Node::addChild(ref, key[depth], leaf);
+  }
+}
+
+// Remove the leaf of key from below the node at ref
+bool ARTCache::removeAt(Node*& ref, const string& key, unsigned depth)
+{
+  Node* node = ref;
+  if (node == NULL) return false;
+  if (node->type == Node::LEAF) {
+    if (slots[((Leaf*)node)->slot].key != key) return false;
+    delete (Leaf*)node;
+    ref = NULL;
+    return true;
+  }
+
+  depth += node->prefix.size();
+  if (depth >= key.size()) return false;
+  unsigned char byte = key[depth];
+  Node** child = Node::findChild(node, byte);
+  if (child == NULL || !removeAt(*child, key, depth + 1)) return false;
+  if (*child == NULL) Node::removeChild(ref, byte);
+  return true;
+}
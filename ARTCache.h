@@ -0,0 +1,122 @@
+#ifndef ARTCACHE_H
+#define ARTCACHE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+
+/**
+ * An in-memory cache in front of a B+tree index, which maps the keys
+ * recently found by a lookup to the leaf entry where they were found, so
+ * that the next lookup of a hot key reads no page at all.
+ * The keys are byte strings (keys stored the way the index stores them in
+ * its pages), kept in an adaptive radix tree: inner nodes grow from 4 to
+ * 16, 48 and 256 children as needed and skip the bytes shared by all of
+ * their keys (path compression).
+ * The cache holds at most a fixed number of keys and evicts the keys not
+ * looked up recently first (CLOCK). An index drops the keys of a leaf
+ * whenever it writes the leaf.
+ */
+class ARTCache {
+ public:
+
+  // the default max # keys in the cache
+  static const int DEFAULT_CAPACITY = 4096;
+
+  /**
+   * Where a key was found in the index.
+   */
+  struct Entry {
+    PageId   pid;     // the leaf holding the first entry with the key
+    int      eid;     // the first entry with the key in the leaf
+    RecordId rid;     // the RecordId of that entry
+    bool     single;  // whether it is the only entry with the key
+  };
+
+  /**
+   * @param capacity[IN] the max # keys in the cache
+   */
+  ARTCache(int capacity = DEFAULT_CAPACITY);
+  ~ARTCache();
+
+  /**
+   * look key up and mark it as recently used.
+   * @param key[IN] the key to look up
+   * @param entry[OUT] where the key was found
+   * @return true if the key is in the cache
+   */
+  bool find(const std::string& key, Entry& entry);
+
+  /**
+   * add key to the cache, or replace its entry. another key is evicted
+   * if the cache is full.
+   * @param key[IN] the key to add
+   * @param entry[IN] where the key was found
+   */
+  void insert(const std::string& key, const Entry& entry);
+
+  /**
+   * drop key from the cache, if it is there.
+   * @param key[IN] the key to drop
+   */
+  void remove(const std::string& key);
+
+  /**
+   * drop every key whose entry is in the leaf pid.
+   * @param pid[IN] the leaf that is written
+   */
+  void invalidateLeaf(PageId pid);
+
+  /**
+   * drop every key.
+   */
+  void clear();
+
+  /**
+   * @return # keys in the cache
+   */
+  int size() const { return count; }
+  bool empty() const { return count == 0; }
+
+ private:
+  struct Node;
+  struct Leaf;
+  struct Node4;
+  struct Node16;
+  struct Node48;
+  struct Node256;
+
+  // a key of the cache, and the list of the keys of the same leaf
+  struct Slot {
+    std::string key;
+    Entry       entry;
+    bool        used;
+    bool        referenced;  // looked up since the clock hand last passed
+    int         prevInLeaf;
+    int         nextInLeaf;
+  };
+
+  // no copies: the tree nodes are owned by the cache
+  ARTCache(const ARTCache&);
+  ARTCache& operator=(const ARTCache&);
+
+  int  findSlot(const std::string& key) const;
+  int  takeSlot();
+  void evict(int slot);
+  void link(int slot);
+  void unlink(int slot);
+  void insertAt(Node*& ref, const std::string& key, unsigned depth, Node* leaf);
+  bool removeAt(Node*& ref, const std::string& key, unsigned depth);
+
+  int capacity;
+  int count;
+  int hand;                          // the clock hand over slots
+  Node* root;
+  std::vector<Slot> slots;
+  std::map<PageId, int> leafHeads;   // the first slot of every leaf
+};
+
+#endif // ARTCACHE_H
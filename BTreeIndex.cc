@@ -8,55 +8,197 @@
  */
 
 #include <iostream>
+#include <map>
+#include <algorithm>
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
 
 using namespace std;
 
 #define ROOT_STORAGE_BLOCK 0
+
+// The format of the index file, stored in block 0. The leaves of fixed
+// (key, RecordId) entries of the first format became posting lists in 2.
+// readRoot() does not read an index file of another format
+#define INDEX_FORMAT_VERSION 2
 #define NO_NEXT_LEAF -1
+#define NO_OVERFLOW -1
+
+// locate() keeps the internal nodes of this many top levels in memory
+#define PINNED_LEVELS 2
+
+// The pinned index of a node that is not pinned yet, or of a leaf
+#define NOT_PINNED -1
+#define LEAF_NODE -2
+
+// Posting lists that grow beyond this many bytes are moved out of the
+// leaf to a chain of overflow pages
+#define POSTING_LIST_BYTES (PageFile::PAGE_SIZE / 4)
+
+// Header of an overflow page, followed by (rid, value) entries
+struct OverflowHeader {
+    PageId next;   // the next page of the posting list, NO_OVERFLOW at the end
+    int    count;  // # entries in this page
+    PageId tail;   // the last page of the posting list (kept in the first page)
+};
+
+// The learned model is rebuilt once the leaf splits and failed
+// predictions since it was built exceed 1/MODEL_DRIFT_DIVISOR of its leaves
+#define MODEL_DRIFT_DIVISOR 8
+
+// The write buffer is merged into the tree once it holds this many entries
+#define WRITE_BUFFER_ENTRIES 8192
+
+// # bytes of an internal node page kept for messages in a buffered tree
+#define NODE_BUFFER_BYTES (PageFile::PAGE_SIZE / 2)
+
+// Sidecar files (membership filters and learned models) are kept in
+// memory across opens of the same index, so that each is read from disk
+// only once
+static map<string, BloomFilter> filterCache;
+static map<string, LearnedModel> modelCache;
+
+// The front caches of the index files, which live as long as the process
+// so that hot keys stay cached across opens
+static map<string, ARTCache*> frontCaches;
+
+template<class T>
+static RC loadSidecar(map<string, T>& cache, const string& name, T& sidecar)
+{
+    typename map<string, T>::iterator it = cache.find(name);
+    if (it != cache.end()) {
+        sidecar = it->second;
+        return 0;
+    }
+    PageFile fpf;
+    RC errorCode = fpf.open(name, 'r');
+    if (errorCode < 0)
+        return errorCode;
+    errorCode = sidecar.read(fpf);
+    fpf.close();
+    if (errorCode < 0)
+        return errorCode;
+    cache[name] = sidecar;
+    return 0;
+}
+
+template<class T>
+static RC saveSidecar(map<string, T>& cache, const string& name, const T& sidecar)
+{
+    PageFile fpf;
+    RC errorCode = fpf.open(name, 'w');
+    if (errorCode < 0)
+        return errorCode;
+    errorCode = sidecar.write(fpf);
+    fpf.close();
+    if (errorCode < 0)
+        return errorCode;
+    cache[name] = sidecar;
+    return 0;
+}
 
 /*
  * BTreeIndex constructor
  */
-BTreeIndex::BTreeIndex()
+template<class K>
+BasicBTreeIndex<K>::BasicBTreeIndex() : cursorLeaf(-1)
 {
     rootPid = -1;
     PageFile newpf;
     pf = newpf;
+    mode = 0;
+    filterEnabled = false;
+    modelEnabled = false;
+    modelStale = false;
+    modelDrift = 0;
+    valueWidth = 0;
+    leafFormat = LeafNode::POSTING_LISTS;
+    pinnedRoot = NOT_PINNED;
+    frontCache = NULL;
+    bufferEnabled = false;
+    nodeBuffer = 0;
+    pendingBounded = false;
 }
 
-RC BTreeIndex::writeRoot()
+// Block 0 stores rootPid followed by valueWidth, leafFormat, nodeBuffer
+// and the format version
+template<class K>
+RC BasicBTreeIndex<K>::writeRoot()
 {
     char buffer[PageFile::PAGE_SIZE];
+    const int version = INDEX_FORMAT_VERSION;
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
     memcpy(buffer, &rootPid, sizeof(PageId));
+    memcpy(buffer + sizeof(PageId), &valueWidth, sizeof(int));
+    memcpy(buffer + sizeof(PageId) + sizeof(int), &leafFormat, sizeof(int));
+    memcpy(buffer + sizeof(PageId) + 2 * sizeof(int), &nodeBuffer, sizeof(int));
+    memcpy(buffer + sizeof(PageId) + 3 * sizeof(int), &version, sizeof(int));
     return pf.write(ROOT_STORAGE_BLOCK, buffer);
 }
 
-RC BTreeIndex::readRoot()
+template<class K>
+RC BasicBTreeIndex<K>::readRoot()
 {
     char buffer[PageFile::PAGE_SIZE];
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
     RC errorCode = pf.read(ROOT_STORAGE_BLOCK, buffer);
     if (errorCode < 0)
         return errorCode;
+    // The files written before the version was stored have 0 there
+    int version;
+    memcpy(&version, buffer + sizeof(PageId) + 3 * sizeof(int), sizeof(int));
+    if (version != INDEX_FORMAT_VERSION)
+        return RC_INVALID_FILE_FORMAT;
     memcpy(&rootPid, buffer, sizeof(PageId));
+    memcpy(&valueWidth, buffer + sizeof(PageId), sizeof(int));
+    memcpy(&leafFormat, buffer + sizeof(PageId) + sizeof(int), sizeof(int));
+    memcpy(&nodeBuffer, buffer + sizeof(PageId) + 2 * sizeof(int), sizeof(int));
+    pending.clear();
+    unpin();
     return 0;
 }
 
 // Used when first creating the index file after LOAD command
-RC BTreeIndex::initializeTree()
+template<class K>
+RC BasicBTreeIndex<K>::initializeTree()
 {
+    return initializeTree(0);
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::initializeTree(int valueWidth)
+{
+    return initializeTree(valueWidth, LeafNode::POSTING_LISTS);
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::initializeTree(int valueWidth, int leafFormat)
+{
+    return initializeTree(valueWidth, leafFormat, false);
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::initializeTree(int valueWidth, int leafFormat, bool buffered)
+{
+    this->valueWidth = valueWidth;
+    this->leafFormat = leafFormat;
+    nodeBuffer = buffered ? NODE_BUFFER_BYTES : 0;
+    pending.clear();
     writeRoot(); // Used to fill 0th block of index file
-    BTLeafNode rootLeaf(pf.endPid());
+    LeafNode rootLeaf(pf.endPid(), valueWidth, leafFormat);
     rootPid = rootLeaf.getPageId();
+    unpin();
+    if (frontCache != NULL)
+        frontCache->clear();
     writeRoot();
     return rootLeaf.write(rootLeaf.getPageId(), pf);
 }
 
-void BTreeIndex::printRec(PageId id, string offset)
+template<class K>
+void BasicBTreeIndex<K>::printRec(PageId id, string offset)
 {
     char buffer[PageFile::PAGE_SIZE];
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
@@ -64,12 +206,12 @@ void BTreeIndex::printRec(PageId id, string offset)
     int isLeaf;
     memcpy(&isLeaf, buffer, sizeof(int));
     if (isLeaf) {
-        BTLeafNode leaf(id);
+        LeafNode leaf(id, valueWidth, leafFormat);
         leaf.read(id, pf);
         leaf.print(offset);
     }
     else {
-        BTNonLeafNode nonl(id);
+        NonLeafNode nonl(id, nodeBuffer);
         nonl.read(id, pf);
         nonl.print(offset);
         for (int i = 0; i < nonl.getKeyCount(); i++) {
@@ -79,7 +221,8 @@ void BTreeIndex::printRec(PageId id, string offset)
     }
 }
 
-void BTreeIndex::print()
+template<class K>
+void BasicBTreeIndex<K>::print()
 {
     cout << "Root Pid: " << rootPid << std::endl;
     printRec(rootPid, "");
@@ -92,35 +235,435 @@ void BTreeIndex::print()
  * @param mode[IN] 'r' for read, 'w' for write
  * @return error code. 0 if no error
  */
-RC BTreeIndex::open(const string& indexname, char mode)
+template<class K>
+RC BasicBTreeIndex<K>::open(const string& indexname, char mode)
 {
-    return pf.open(indexname, mode);
+    RC errorCode = pf.open(indexname, mode);
+    if (errorCode < 0)
+        return errorCode;
+    this->mode = mode;
+    indexName = indexname;
+    cursorLeaf = LeafNode(-1);
+    unpin();
+    // The filter is optional; an index without a sidecar file has none
+    filterName = indexname + ".bf";
+    filterEnabled = (loadSidecar(filterCache, filterName, filter) == 0);
+    // So is the learned model. One saved with an index file of another
+    // size does not fit the tree any more
+    modelName = indexname + ".lm";
+    modelEnabled = K::INTEGRAL && loadSidecar(modelCache, modelName, model) == 0;
+    modelStale = modelEnabled && model.getEndPid() != pf.endPid();
+    modelDrift = 0;
+    ARTCache*& cache = frontCaches[indexname];
+    if (cache == NULL)
+        cache = new ARTCache();
+    frontCache = cache;
+    // The entries of an index with a write buffer log may not all be in
+    // the tree yet; the log gives them back
+    bufferName = indexname + ".wal";
+    bufferEnabled = (writeBuffer.open(bufferName, mode, false) == 0);
+    return 0;
 }
 
 /*
  * Close the index file.
  * @return error code. 0 if no error
  */
-RC BTreeIndex::close()
+template<class K>
+RC BasicBTreeIndex<K>::close()
 {
+    if (bufferEnabled) {
+        RC errorCode = (mode == 'w' || mode == 'W') ? mergeBuffer() : 0;
+        writeBuffer.close();
+        bufferEnabled = false;
+        if (errorCode < 0) {
+            pf.close();
+            return errorCode;
+        }
+    }
+    if (filterEnabled && (mode == 'w' || mode == 'W')) {
+        RC errorCode = saveSidecar(filterCache, filterName, filter);
+        if (errorCode < 0) {
+            pf.close();
+            return errorCode;
+        }
+    }
+    filterEnabled = false;
+    if (modelEnabled && (mode == 'w' || mode == 'W')) {
+        RC errorCode = (modelStale || modelDrift > 0) ? rebuildModel() : 0;
+        if (errorCode == 0) {
+            model.setEndPid(pf.endPid());
+            errorCode = saveSidecar(modelCache, modelName, model);
+        }
+        if (errorCode < 0) {
+            pf.close();
+            return errorCode;
+        }
+    }
+    modelEnabled = false;
     return pf.close();
 }
 
-RC BTreeIndex::insertSplitWrite(BTLeafNode& leaf, int key, const RecordId& rid, int& siblingKey, PageId& siblingPid)
+template<class K>
+void BasicBTreeIndex<K>::forget(const string& indexname)
+{
+    filterCache.erase(indexname + ".bf");
+    modelCache.erase(indexname + ".lm");
+    // An open index may still point to the front cache
+    map<string, ARTCache*>::iterator it = frontCaches.find(indexname);
+    if (it != frontCaches.end())
+        it->second->clear();
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::enableFilter()
+{
+    if (mode != 'w' && mode != 'W')
+        return RC_INVALID_FILE_MODE;
+    filterEnabled = true;
+    return rebuildFilter(filter.getCapacity());
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::enableModel()
+{
+    // The leaves of a buffered tree do not hold every key
+    if (!K::INTEGRAL || nodeBuffer > 0)
+        return RC_INVALID_ATTRIBUTE;
+    modelEnabled = true;
+    modelStale = true;
+    return 0;
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::enableWriteBuffer()
+{
+    if (mode != 'w' && mode != 'W')
+        return RC_INVALID_FILE_MODE;
+    if (bufferEnabled)
+        return 0;
+    RC errorCode = writeBuffer.open(bufferName, mode, true);
+    if (errorCode < 0)
+        return errorCode;
+    bufferEnabled = true;
+    return 0;
+}
+
+template<class K>
+bool BasicBTreeIndex<K>::mayContain(const KeyType& searchKey) const
+{
+    return !filterEnabled || filter.mayContain(K::hash(searchKey));
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::lookupCached(const KeyType& searchKey, RecordId& rid)
+{
+    ARTCache::Entry entry;
+    if (frontCache == NULL || !frontCache->find(cacheKey(searchKey), entry) || !entry.single)
+        return RC_NO_SUCH_RECORD;
+    // The cache only knows the entries in the tree
+    if (bufferEnabled && writeBuffer.contains(searchKey))
+        return RC_NO_SUCH_RECORD;
+    rid = entry.rid;
+    return 0;
+}
+
+// The key as the front cache stores it: the bytes of the key in a page
+template<class K>
+string BasicBTreeIndex<K>::cacheKey(const KeyType& key)
+{
+    string bytes(K::size(key), '\0');
+    K::write(&bytes[0], key);
+    return bytes;
+}
+
+// Cache the location of the key of entry eid, the first entry with its key
+template<class K>
+void BasicBTreeIndex<K>::cacheEntry(LeafNode& leaf, int eid)
+{
+    KeyType key, nextKey;
+    RecordId nextRid;
+    ARTCache::Entry entry;
+    // A key of a buffered tree may have entries pending above the leaf
+    if (frontCache == NULL || nodeBuffer > 0 || leaf.readEntry(eid, key, entry.rid) < 0)
+        return;
+    entry.pid = leaf.getPageId();
+    entry.eid = eid;
+    // Whether the next entry of the key, if any, is in the next leaf is
+    // not known, so the key is taken as single only if the leaf tells so
+    entry.single = entry.rid.sid != LeafNode::OVERFLOW_SID
+        && leaf.readEntry(eid + 1, nextKey, nextRid) == 0 && !(nextKey == key);
+    frontCache->insert(cacheKey(key), entry);
+}
+
+// The leaf pid is about to be written; its cached entries move
+template<class K>
+void BasicBTreeIndex<K>::invalidateLeaf(PageId pid)
+{
+    if (frontCache != NULL && !frontCache->empty())
+        frontCache->invalidateLeaf(pid);
+}
+
+// key is about to be inserted; its first entry may move to another leaf
+template<class K>
+void BasicBTreeIndex<K>::uncacheKey(const KeyType& key)
+{
+    if (frontCache != NULL && !frontCache->empty())
+        frontCache->remove(cacheKey(key));
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::leftmostLeaf(PageId& pid)
+{
+    char buffer[PageFile::PAGE_SIZE];
+    pid = rootPid;
+    while (true) {
+        RC errorCode = pf.read(pid, buffer);
+        if (errorCode < 0)
+            return errorCode;
+        int isLeaf;
+        memcpy(&isLeaf, buffer, sizeof(int));
+        if (isLeaf)
+            return 0;
+        NonLeafNode nonl(pid, nodeBuffer);
+        nonl.read(pid, pf);
+        pid = nonl.readEntry(0);
+    }
+}
+
+// Set cursor to the first entry of the index
+template<class K>
+RC BasicBTreeIndex<K>::locateFirst(IndexCursor& cursor)
+{
+    cursor.eid = 0;
+    cursor.opid = NO_OVERFLOW;
+    cursor.oeid = 0;
+    cursor.bid = bufferEnabled ? writeBuffer.first() : writeBuffer.END;
+    cursor.mid = 0;
+    if (nodeBuffer > 0)
+        return collectMessages(NULL, false, cursor.mid, cursor.pid);
+    return leftmostLeaf(cursor.pid);
+}
+
+// Reset the filter to the given capacity and add every key in the tree
+template<class K>
+RC BasicBTreeIndex<K>::rebuildFilter(int capacity)
+{
+    filter.reset(capacity);
+    // An empty index file has no tree to scan yet
+    if (pf.endPid() == 0)
+        return 0;
+    if (rootPid < 0) {
+        RC errorCode = readRoot();
+        if (errorCode < 0)
+            return errorCode;
+    }
+    PageId pid;
+    RC errorCode = leftmostLeaf(pid);
+    if (errorCode < 0)
+        return errorCode;
+    while (pid != NO_NEXT_LEAF) {
+        LeafNode leaf(pid, valueWidth, leafFormat);
+        leaf.read(pid, pf);
+        for (int eid = 0; eid < leaf.getKeyCount(); eid++) {
+            KeyType key;
+            RecordId rid;
+            leaf.readEntry(eid, key, rid);
+            filter.add(K::hash(key));
+        }
+        pid = leaf.getNextLeaf();
+    }
+    if (bufferEnabled) {
+        for (int position = writeBuffer.first(); position != writeBuffer.END; position = writeBuffer.next(position))
+            filter.add(K::hash(writeBuffer.getKey(position)));
+    }
+    return (nodeBuffer > 0) ? addMessagesToFilter(rootPid) : 0;
+}
+
+// Add the keys of the messages in the subtree of pid to the filter
+template<class K>
+RC BasicBTreeIndex<K>::addMessagesToFilter(PageId pid)
 {
-    BTLeafNode sibling(pf.endPid());
-    RC errorCode = leaf.insertAndSplit(key, rid, sibling, siblingKey);
+    char buffer[PageFile::PAGE_SIZE];
+    RC errorCode = pf.read(pid, buffer);
     if (errorCode < 0)
         return errorCode;
+    int isLeaf;
+    memcpy(&isLeaf, buffer, sizeof(int));
+    if (isLeaf)
+        return 0;
+    NonLeafNode nonl(pid, nodeBuffer);
+    nonl.read(pid, pf);
+    for (int i = 0; i < nonl.getMessageCount(); i++)
+        filter.add(K::hash(nonl.readMessage(i).key));
+    for (int i = 0; i < nonl.getKeyCount(); i++) {
+        if ((errorCode = addMessagesToFilter(nonl.readEntry(i))) < 0)
+            return errorCode;
+    }
+    return addMessagesToFilter(nonl.getLastId());
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::addToFilter(const KeyType& key)
+{
+    // Grow the filter once it holds as many keys as it was sized for,
+    // since its false positive rate climbs quickly beyond that point.
+    // The rebuild rescans the keys already in the tree.
+    if (filter.isFull()) {
+        RC errorCode = rebuildFilter(2 * filter.getCapacity());
+        if (errorCode < 0)
+            return errorCode;
+    }
+    filter.add(K::hash(key));
+    return 0;
+}
+
+// Add the entry to the leaf and write the leaf, unless writeLeaf is false
+// and the caller writes it later. A posting list that grows too long is
+// moved to overflow pages first.
+// Returns RC_NODE_FULL, leaving the leaf unchanged, if the leaf must be split.
+template<class K>
+RC BasicBTreeIndex<K>::insertIntoLeaf(LeafNode& leaf, const KeyType& key, const RecordId& rid, const string& value, bool writeLeaf)
+{
+    int eid;
+    if (leaf.locate(key, eid) == 0) {
+        KeyType entryKey;
+        RecordId entryRid;
+        leaf.readEntry(eid, entryKey, entryRid);
+        // The leaf only holds the first overflow page of the list
+        if (entryRid.sid == LeafNode::OVERFLOW_SID)
+            return appendOverflow(entryRid.pid, rid, value);
+        int count = 1;
+        while (leaf.readEntry(eid + count, entryKey, entryRid) == 0 && entryKey == key)
+            count++;
+        // Each entry of a posting list takes at least 2 bytes
+        if (count * (2 + valueWidth) >= POSTING_LIST_BYTES) {
+            RC errorCode = moveToOverflow(leaf, eid, count);
+            if (errorCode < 0)
+                return errorCode;
+            leaf.readEntry(eid, entryKey, entryRid);
+            return appendOverflow(entryRid.pid, rid, value);
+        }
+    }
+    RC errorCode = leaf.insert(key, rid, value);
+    if (errorCode == 0 && writeLeaf) {
+        invalidateLeaf(leaf.getPageId());
+        leaf.write(leaf.getPageId(), pf);
+    }
+    return errorCode;
+}
+
+// Move count entries of a posting list starting from eid to new overflow
+// pages, leaving a single entry pointing to them in the leaf
+template<class K>
+RC BasicBTreeIndex<K>::moveToOverflow(LeafNode& leaf, int eid, int count)
+{
+    char page[PageFile::PAGE_SIZE];
+    memset(page, 0, sizeof(char) * PageFile::PAGE_SIZE);
+    OverflowHeader header;
+    header.next = NO_OVERFLOW;
+    header.count = 0;
+    header.tail = pf.endPid();
+    memcpy(page, &header, sizeof(header));
+    PageId head = header.tail;
+    RC errorCode = pf.write(head, page);
+    if (errorCode < 0)
+        return errorCode;
+    KeyType key;
+    RecordId rid;
+    string value;
+    for (int i = 0; i < count; i++) {
+        leaf.readEntry(eid + i, key, rid, value);
+        errorCode = appendOverflow(head, rid, value);
+        if (errorCode < 0)
+            return errorCode;
+    }
+    leaf.removeEntries(eid, count);
+    rid.pid = head;
+    rid.sid = LeafNode::OVERFLOW_SID;
+    // The entry takes less room than the posting list it replaces
+    errorCode = leaf.insert(key, rid, string());
+    if (errorCode < 0)
+        return errorCode;
+    invalidateLeaf(leaf.getPageId());
+    return leaf.write(leaf.getPageId(), pf);
+}
+
+// Append the entry to the posting list starting at the overflow page head
+template<class K>
+RC BasicBTreeIndex<K>::appendOverflow(PageId head, const RecordId& rid, const string& value)
+{
+    const int entrySize = sizeof(RecordId) + valueWidth;
+    const int capacity = (PageFile::PAGE_SIZE - sizeof(OverflowHeader)) / entrySize;
+    char headPage[PageFile::PAGE_SIZE];
+    char tailPage[PageFile::PAGE_SIZE];
+    OverflowHeader headHeader, tailHeader;
+
+    RC errorCode = pf.read(head, headPage);
+    if (errorCode < 0)
+        return errorCode;
+    memcpy(&headHeader, headPage, sizeof(headHeader));
+    PageId tail = headHeader.tail;
+    char* page = headPage;
+    if (tail != head) {
+        if ((errorCode = pf.read(tail, tailPage)) < 0)
+            return errorCode;
+        page = tailPage;
+    }
+    memcpy(&tailHeader, page, sizeof(tailHeader));
+
+    // The last page is full; start a new one
+    if (tailHeader.count == capacity) {
+        PageId newTail = pf.endPid();
+        tailHeader.next = newTail;
+        memcpy(page, &tailHeader, sizeof(tailHeader));
+        if ((errorCode = pf.write(tail, page)) < 0)
+            return errorCode;
+        if (tail == head)
+            headHeader = tailHeader;
+        headHeader.tail = newTail;
+        memcpy(headPage, &headHeader, sizeof(headHeader));
+        if ((errorCode = pf.write(head, headPage)) < 0)
+            return errorCode;
+        tail = newTail;
+        page = tailPage;
+        memset(page, 0, sizeof(char) * PageFile::PAGE_SIZE);
+        tailHeader.next = NO_OVERFLOW;
+        tailHeader.count = 0;
+        tailHeader.tail = newTail;
+    }
+
+    char* entry = page + sizeof(OverflowHeader) + tailHeader.count * entrySize;
+    memcpy(entry, &rid, sizeof(RecordId));
+    memset(entry + sizeof(RecordId), 0, valueWidth);
+    memcpy(entry + sizeof(RecordId), value.data(), min((int)value.size(), valueWidth));
+    tailHeader.count++;
+    memcpy(page, &tailHeader, sizeof(tailHeader));
+    return pf.write(tail, page);
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::insertSplitWrite(LeafNode& leaf, const KeyType& key, const RecordId& rid, const string& value, KeyType& siblingKey, PageId& siblingPid)
+{
+    LeafNode sibling(pf.endPid(), valueWidth, leafFormat);
+    RC errorCode = leaf.insertAndSplit(key, rid, value, sibling, siblingKey);
+    if (errorCode < 0)
+        return errorCode;
+    // The parent gets a new entry
+    unpin();
+    if (modelEnabled)
+        addModelDrift();
+    invalidateLeaf(leaf.getPageId());
     leaf.write(leaf.getPageId(), pf);
     siblingPid = sibling.getPageId();
     sibling.write(siblingPid, pf);
     return 0;
 }
 
-RC BTreeIndex::insertSplitWrite(BTNonLeafNode& nonl, int key, PageId pid, int& midKey, PageId& siblingPid)
+template<class K>
+RC BasicBTreeIndex<K>::insertSplitWrite(NonLeafNode& nonl, const KeyType& key, PageId pid, KeyType& midKey, PageId& siblingPid)
 {
-    BTNonLeafNode sibling(pf.endPid());
+    NonLeafNode sibling(pf.endPid(), nodeBuffer);
     RC errorCode = nonl.insertAndSplit(key, pid, sibling, midKey);
     if (errorCode < 0)
         return errorCode;
@@ -130,7 +673,8 @@ RC BTreeIndex::insertSplitWrite(BTNonLeafNode& nonl, int key, PageId pid, int& m
     return 0;
 }
 
-RC BTreeIndex::insertRecursive(BTNonLeafNode& node, int key, const RecordId& rid, bool& overflow, int& overflowKey, PageId& overflowPid)
+template<class K>
+RC BasicBTreeIndex<K>::insertRecursive(NonLeafNode& node, const KeyType& key, const RecordId& rid, const string& value, bool& overflow, KeyType& overflowKey, PageId& overflowPid)
 {
     PageId childPid;
     node.locateChildPtr(key, childPid);
@@ -143,14 +687,15 @@ RC BTreeIndex::insertRecursive(BTNonLeafNode& node, int key, const RecordId& rid
     memcpy(&isLeaf, buffer, sizeof(int));
     // Leaf node case
     if (isLeaf) {
-        BTLeafNode leaf(childPid);
+        LeafNode leaf(childPid, valueWidth, leafFormat);
         leaf.read(childPid, pf);
         // Attempt direct insertion into leaf
-        errorCode = leaf.insert(key, rid);
+        errorCode = insertIntoLeaf(leaf, key, rid, value);
         // If insertion fails, do insertAndSplit on leaf
         if (errorCode == RC_NODE_FULL) {
-            int siblingKey, siblingPid;
-            errorCode = insertSplitWrite(leaf, key, rid, siblingKey, siblingPid);
+            KeyType siblingKey;
+            PageId siblingPid;
+            errorCode = insertSplitWrite(leaf, key, rid, value, siblingKey, siblingPid);
             if (errorCode < 0)
                 return errorCode;
             // Attempt direct insertion of siblingKey into node
@@ -166,22 +711,18 @@ RC BTreeIndex::insertRecursive(BTNonLeafNode& node, int key, const RecordId& rid
             }
             return errorCode;
         }
-        else if (errorCode == 0) {
-            leaf.write(leaf.getPageId(), pf);
-            return errorCode;
-        }
         else
-            return 0;
+            return errorCode;
     }
     // Non-leaf node case
     else {
-        BTNonLeafNode nonl(childPid);
+        NonLeafNode nonl(childPid, nodeBuffer);
         nonl.read(childPid, pf);
         bool ovrfl = false;
-        int oKey;
+        KeyType oKey;
         PageId oPid;
         // Insert recursively into subtree
-        errorCode = insertRecursive(nonl, key, rid, ovrfl, oKey, oPid);
+        errorCode = insertRecursive(nonl, key, rid, value, ovrfl, oKey, oPid);
         if (errorCode < 0)
             return errorCode;
         // If insertion returned with overflow of subtree, insert into non-leaf
@@ -207,53 +748,92 @@ RC BTreeIndex::insertRecursive(BTNonLeafNode& node, int key, const RecordId& rid
  * @param rid[IN] the RecordId for the record being inserted into the index
  * @return error code. 0 if no error
  */
-RC BTreeIndex::insert(int key, const RecordId& rid)
+template<class K>
+RC BasicBTreeIndex<K>::insert(const KeyType& key, const RecordId& rid)
+{
+    // A covering index cannot store an entry without its value
+    if (valueWidth > 0)
+        return RC_INVALID_ATTRIBUTE;
+    return insert(key, rid, string());
+}
+
+/*
+ * Insert (key, RecordId, value) entry to the index.
+ * @param key[IN] the key for the value inserted into the index
+ * @param rid[IN] the RecordId for the record being inserted into the index
+ * @param value[IN] the value of the record, stored inline by a covering index
+ * @return error code. 0 if no error
+ */
+template<class K>
+RC BasicBTreeIndex<K>::insert(const KeyType& key, const RecordId& rid, const string& value)
+{
+    RC errorCode;
+    if (filterEnabled && (errorCode = addToFilter(key)) < 0)
+        return errorCode;
+    if (bufferEnabled) {
+        // The leaf stores the first valueWidth bytes of the value
+        errorCode = writeBuffer.insert(key, rid, value.substr(0, valueWidth));
+        if (errorCode < 0)
+            return errorCode;
+        return (writeBuffer.size() >= WRITE_BUFFER_ENTRIES) ? mergeBuffer() : 0;
+    }
+    return insertTree(key, rid, value);
+}
+
+// Insert the entry into the tree itself
+template<class K>
+RC BasicBTreeIndex<K>::insertTree(const KeyType& key, const RecordId& rid, const string& value)
 {
     char buffer[PageFile::PAGE_SIZE];
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
-    RC errorCode = pf.read(rootPid, buffer);
+    RC errorCode;
+    // The leaf kept by readForward() may change, and so may the first
+    // entry of key, which can go to the leaf left of the cached one
+    cursorLeaf = LeafNode(-1);
+    uncacheKey(key);
+    errorCode = pf.read(rootPid, buffer);
     if (errorCode < 0)
         return errorCode;
     int isLeaf;
     memcpy(&isLeaf, buffer, sizeof(int));
     if (isLeaf) {
-        BTLeafNode leaf(rootPid);
+        LeafNode leaf(rootPid, valueWidth, leafFormat);
         leaf.read(rootPid, pf);
         // Attempt direct insertion
-        errorCode = leaf.insert(key, rid);
+        errorCode = insertIntoLeaf(leaf, key, rid, value);
         // If insertion fails, do insertAndSplit, then create a new root
         if (errorCode == RC_NODE_FULL) {
-            int siblingKey, siblingPid;
-            errorCode = insertSplitWrite(leaf, key, rid, siblingKey, siblingPid);
+            KeyType siblingKey;
+            PageId siblingPid;
+            errorCode = insertSplitWrite(leaf, key, rid, value, siblingKey, siblingPid);
             if (errorCode < 0)
                 return errorCode;
-            BTNonLeafNode newRoot(pf.endPid());
+            NonLeafNode newRoot(pf.endPid(), nodeBuffer);
             newRoot.initializeRoot(leaf.getPageId(), siblingKey, siblingPid);
             rootPid = newRoot.getPageId();
             newRoot.write(rootPid, pf);
             writeRoot();
             return 0;
         }
-        else if (errorCode == 0) {
-            leaf.write(leaf.getPageId(), pf);
-            return 0;
-        }
         else
             return errorCode;
     }
+    else if (nodeBuffer > 0) {
+        return insertMessage(key, rid, value);
+    }
     else {
-        BTNonLeafNode nonLeaf(rootPid);
+        NonLeafNode nonLeaf(rootPid, nodeBuffer);
         nonLeaf.read(rootPid, pf);
         bool overflow = false;
-        int oKey;
+        KeyType oKey;
         PageId oPid;
         // Insert recursively into subtree
-        errorCode = insertRecursive(nonLeaf, key, rid, overflow, oKey, oPid);
+        errorCode = insertRecursive(nonLeaf, key, rid, value, overflow, oKey, oPid);
         if (errorCode < 0)
             return errorCode;
         // If overflow occured, create new root
         else if (overflow) {
-            BTNonLeafNode newRoot(pf.endPid());
+            NonLeafNode newRoot(pf.endPid(), nodeBuffer);
             newRoot.initializeRoot(nonLeaf.getPageId(), oKey, oPid);
             rootPid = newRoot.getPageId();
             newRoot.write(rootPid, pf);
@@ -265,7 +845,359 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
     }
 }
 
-RC BTreeIndex::locateRec(PageId id, int searchKey, IndexCursor& cursor)
+// Insert the buffered entries into the tree in key order and empty the
+// buffer. The entries that go to the same leaf are added to it together,
+// so that the leaf is read and written once for all of them
+template<class K>
+RC BasicBTreeIndex<K>::mergeBuffer()
+{
+    cursorLeaf = LeafNode(-1);
+    int position = writeBuffer.first();
+    // A buffered tree batches the entries by itself
+    if (nodeBuffer > 0) {
+        for (; position != writeBuffer.END; position = writeBuffer.next(position)) {
+            RC errorCode = insertTree(writeBuffer.getKey(position), writeBuffer.getRid(position),
+                                      writeBuffer.getValue(position));
+            if (errorCode < 0)
+                return errorCode;
+        }
+        return writeBuffer.clear();
+    }
+    while (position != writeBuffer.END) {
+        IndexCursor cursor;
+        RC errorCode = locateTree(writeBuffer.getKey(position), cursor);
+        if (errorCode < 0 && errorCode != RC_NO_SUCH_RECORD)
+            return errorCode;
+        LeafNode leaf(cursor.pid, valueWidth, leafFormat);
+        if ((errorCode = leaf.read(cursor.pid, pf)) < 0)
+            return errorCode;
+        // The keys from the first one up to the last key of the leaf go to
+        // the leaf; the following ones may go to the next leaf
+        KeyType lastKey;
+        RecordId lastRid;
+        bool bounded = (leaf.readEntry(leaf.getKeyCount() - 1, lastKey, lastRid) == 0);
+        bool dirty = false;
+        do {
+            uncacheKey(writeBuffer.getKey(position));
+            errorCode = insertIntoLeaf(leaf, writeBuffer.getKey(position), writeBuffer.getRid(position),
+                                       writeBuffer.getValue(position), false);
+            if (errorCode < 0)
+                break;
+            dirty = true;
+            position = writeBuffer.next(position);
+        } while (position != writeBuffer.END && bounded && !(lastKey < writeBuffer.getKey(position)));
+        if (dirty) {
+            invalidateLeaf(leaf.getPageId());
+            leaf.write(leaf.getPageId(), pf);
+        }
+        if (errorCode == RC_NODE_FULL) {
+            // The leaf is split by a regular insert
+            errorCode = insertTree(writeBuffer.getKey(position), writeBuffer.getRid(position),
+                                   writeBuffer.getValue(position));
+            position = writeBuffer.next(position);
+        }
+        if (errorCode < 0)
+            return errorCode;
+    }
+    return writeBuffer.clear();
+}
+
+// Messages of a buffered tree are ordered by key, and the messages with
+// the same key by arrival
+template<class M>
+static bool messageLess(const M& a, const M& b)
+{
+    return a.key < b.key;
+}
+
+// Insert the entry into a buffered tree whose root is an internal node:
+// the entry becomes a message of the root
+template<class K>
+RC BasicBTreeIndex<K>::insertMessage(const KeyType& key, const RecordId& rid, const string& value)
+{
+    NonLeafNode root(rootPid, nodeBuffer);
+    RC errorCode = root.read(rootPid, pf);
+    if (errorCode < 0)
+        return errorCode;
+    Message message;
+    message.key = key;
+    message.rid = rid;
+    // The leaf stores the first valueWidth bytes of the value
+    message.value = value.substr(0, valueWidth);
+    SplitList splits;
+    if ((errorCode = pushMessages(root, vector<Message>(1, message), splits)) < 0)
+        return errorCode;
+    if (splits.empty())
+        return 0;
+    // The root split; the new root may split as well
+    while (!splits.empty()) {
+        NonLeafNode newRoot(pf.endPid(), nodeBuffer);
+        newRoot.initializeRoot(rootPid, splits[0].first, splits[0].second);
+        if ((errorCode = newRoot.write(newRoot.getPageId(), pf)) < 0)
+            return errorCode;
+        for (unsigned i = 1; i < splits.size(); i++)
+            newRoot.insertWithoutCheck(splits[i].first, splits[i].second);
+        rootPid = newRoot.getPageId();
+        splits.clear();
+        if ((errorCode = writeAndSplit(newRoot, splits)) < 0)
+            return errorCode;
+    }
+    unpin();
+    return writeRoot();
+}
+
+/*
+ * Add a batch of messages to the buffer of node. While the buffer is
+ * full, the messages for the child with the most of them move down to
+ * the child. The node is then written.
+ * @param node[IN/OUT] the internal node
+ * @param batch[IN] the messages to add, in arrival order
+ * @param splits[OUT] the (key, pid) of the nodes split off node, which
+ *                    the parent must insert
+ * @return error code. 0 if no error
+ */
+template<class K>
+RC BasicBTreeIndex<K>::pushMessages(NonLeafNode& node, const vector<Message>& batch, SplitList& splits)
+{
+    for (unsigned i = 0; i < batch.size(); i++)
+        node.addMessage(batch[i]);
+    while (!node.messagesFit()) {
+        vector<Message> flushed;
+        PageId childPid;
+        node.takeMessages(node.fullestChild(), flushed);
+        node.locateChildPtr(flushed[0].key, childPid);
+        char buffer[PageFile::PAGE_SIZE];
+        RC errorCode = pf.read(childPid, buffer);
+        if (errorCode < 0)
+            return errorCode;
+        int isLeaf;
+        memcpy(&isLeaf, buffer, sizeof(int));
+        SplitList childSplits;
+        if (isLeaf) {
+            errorCode = applyMessages(childPid, flushed, childSplits);
+        }
+        else {
+            NonLeafNode child(childPid, nodeBuffer);
+            child.read(childPid, pf);
+            errorCode = pushMessages(child, flushed, childSplits);
+        }
+        if (errorCode < 0)
+            return errorCode;
+        // The node may grow past its page; writeAndSplit() splits it
+        for (unsigned i = 0; i < childSplits.size(); i++)
+            node.insertWithoutCheck(childSplits[i].first, childSplits[i].second);
+    }
+    return writeAndSplit(node, splits);
+}
+
+// Insert the messages into the leaf pid, splitting it as needed. Every
+// leaf is written once, unless it splits
+template<class K>
+RC BasicBTreeIndex<K>::applyMessages(PageId pid, vector<Message>& batch, SplitList& splits)
+{
+    // In key order, the leaves split off are visited from left to right
+    stable_sort(batch.begin(), batch.end(), messageLess<Message>);
+    LeafNode leaf(pid, valueWidth, leafFormat);
+    RC errorCode = leaf.read(pid, pf);
+    if (errorCode < 0)
+        return errorCode;
+    bool dirty = false;
+    for (unsigned i = 0; i < batch.size(); i++) {
+        // The message goes to the leaf right of the last split key smaller
+        // than its key
+        PageId target = pid;
+        for (unsigned j = 0; j < splits.size() && splits[j].first < batch[i].key; j++)
+            target = splits[j].second;
+        if (target != leaf.getPageId()) {
+            if (dirty && (errorCode = leaf.write(leaf.getPageId(), pf)) < 0)
+                return errorCode;
+            leaf = LeafNode(target, valueWidth, leafFormat);
+            if ((errorCode = leaf.read(target, pf)) < 0)
+                return errorCode;
+            dirty = false;
+        }
+        errorCode = insertIntoLeaf(leaf, batch[i].key, batch[i].rid, batch[i].value, false);
+        if (errorCode == 0) {
+            dirty = true;
+            continue;
+        }
+        if (errorCode != RC_NODE_FULL)
+            return errorCode;
+        KeyType siblingKey;
+        PageId siblingPid;
+        errorCode = insertSplitWrite(leaf, batch[i].key, batch[i].rid, batch[i].value, siblingKey, siblingPid);
+        if (errorCode < 0)
+            return errorCode;
+        typename SplitList::iterator it = splits.begin();
+        while (it != splits.end() && it->first < siblingKey)
+            ++it;
+        splits.insert(it, make_pair(siblingKey, siblingPid));
+        dirty = false;
+    }
+    return dirty ? leaf.write(leaf.getPageId(), pf) : 0;
+}
+
+// Write node, after splitting off as many siblings as it needs to fit in
+// its page. The siblings are added to splits in key order
+template<class K>
+RC BasicBTreeIndex<K>::writeAndSplit(NonLeafNode& node, SplitList& splits)
+{
+    // Every split takes the upper entries of the node
+    int first = splits.size();
+    while (node.isOverfull()) {
+        NonLeafNode sibling(pf.endPid(), nodeBuffer);
+        KeyType midKey;
+        RC errorCode = node.split(sibling, midKey);
+        if (errorCode < 0)
+            return errorCode;
+        if ((errorCode = sibling.write(sibling.getPageId(), pf)) < 0)
+            return errorCode;
+        splits.push_back(make_pair(midKey, sibling.getPageId()));
+    }
+    reverse(splits.begin() + first, splits.end());
+    return node.write(node.getPageId(), pf);
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::reorganize()
+{
+    if (mode != 'w' && mode != 'W')
+        return RC_INVALID_FILE_MODE;
+    RC errorCode;
+    if (bufferEnabled && (errorCode = mergeBuffer()) < 0)
+        return errorCode;
+
+    // The new tree is built in a file of its own, which then replaces the
+    // index file. Nothing is written to the index file before
+    const string newName = indexName + ".reorg";
+    unlink(newName.c_str());
+    forget(newName);
+    BasicBTreeIndex<K> tree;
+    if ((errorCode = tree.open(newName, 'w')) < 0)
+        return errorCode;
+    errorCode = tree.copyTree(*this);
+    RC closed = tree.close();
+    if (errorCode == 0)
+        errorCode = closed;
+    if (errorCode == 0 && rename(newName.c_str(), indexName.c_str()) < 0)
+        errorCode = RC_FILE_WRITE_FAILED;
+    if (errorCode < 0) {
+        unlink(newName.c_str());
+        return errorCode;
+    }
+
+    // Read the new file from now on. Everything kept about the old tree
+    // is dropped
+    pf.close();
+    if ((errorCode = pf.open(indexName, mode)) < 0)
+        return errorCode;
+    if ((errorCode = readRoot()) < 0)
+        return errorCode;
+    cursorLeaf = LeafNode(-1);
+    if (frontCache != NULL)
+        frontCache->clear();
+    if (modelEnabled)
+        modelStale = true;
+    return 0;
+}
+
+// Fill the empty index file with the entries of source in key order. The
+// leaves follow each other, each written as soon as it is started so that
+// the overflow pages of its posting lists come right after it, and the
+// internal nodes are built over them
+template<class K>
+RC BasicBTreeIndex<K>::copyTree(BasicBTreeIndex<K>& source)
+{
+    valueWidth = source.valueWidth;
+    leafFormat = source.leafFormat;
+    nodeBuffer = source.nodeBuffer;
+    RC errorCode = writeRoot(); // Keep block 0 for the root
+    if (errorCode < 0)
+        return errorCode;
+
+    vector<PageId> children;
+    vector<KeyType> separators;  // the key between children i and i + 1
+    IndexCursor cursor;
+    if ((errorCode = source.locateFirst(cursor)) < 0)
+        return errorCode;
+    LeafNode leaf(pf.endPid(), valueWidth, leafFormat);
+    if ((errorCode = leaf.write(leaf.getPageId(), pf)) < 0)
+        return errorCode;
+    children.push_back(leaf.getPageId());
+    KeyType key, lastKey;
+    RecordId rid;
+    string value;
+    while ((errorCode = source.readForward(cursor, key, rid, value)) == 0) {
+        errorCode = insertIntoLeaf(leaf, key, rid, value, false);
+        if (errorCode == RC_NODE_FULL) {
+            LeafNode next(pf.endPid(), valueWidth, leafFormat);
+            if ((errorCode = next.write(next.getPageId(), pf)) < 0)
+                return errorCode;
+            leaf.setNextNodePtr(next.getPageId());
+            if ((errorCode = leaf.write(leaf.getPageId(), pf)) < 0)
+                return errorCode;
+            separators.push_back(K::separator(lastKey, key));
+            children.push_back(next.getPageId());
+            leaf = next;
+            errorCode = insertIntoLeaf(leaf, key, rid, value, false);
+        }
+        if (errorCode < 0)
+            return errorCode;
+        lastKey = key;
+    }
+    if (errorCode != RC_END_OF_TREE)
+        return errorCode;
+    if ((errorCode = leaf.write(leaf.getPageId(), pf)) < 0)
+        return errorCode;
+    if ((errorCode = buildInternalLevels(children, separators)) < 0)
+        return errorCode;
+    rootPid = children[0];
+    return writeRoot();
+}
+
+// Build the internal nodes over the nodes of a level, one level after the
+// other, and leave the root alone in children. The nodes are filled up,
+// but the last one of a level gets at least two children
+template<class K>
+RC BasicBTreeIndex<K>::buildInternalLevels(vector<PageId>& children, vector<KeyType>& separators)
+{
+    while (children.size() > 1) {
+        vector<PageId> parents;
+        vector<KeyType> parentSeparators;
+        const unsigned count = children.size();
+        unsigned first = 0;
+        while (first < count) {
+            // The node gets the children from first to last. Entries are
+            // appended, since a separator may repeat a key
+            NonLeafNode node(pf.endPid(), nodeBuffer);
+            node.insert_end(separators[first], children[first]);
+            unsigned last = first + 1;
+            while (last + 1 < count && count - last - 1 != 2 && node.hasRoom(separators[last])) {
+                node.insert_end(separators[last], children[last]);
+                last++;
+            }
+            // Three children always fit
+            if (count - last - 1 == 1) {
+                node.insert_end(separators[last], children[last]);
+                last++;
+            }
+            node.setLastId(children[last]);
+            RC errorCode = node.write(node.getPageId(), pf);
+            if (errorCode < 0)
+                return errorCode;
+            parents.push_back(node.getPageId());
+            if (last + 1 < count)
+                parentSeparators.push_back(separators[last]);
+            first = last + 1;
+        }
+        children.swap(parents);
+        separators.swap(parentSeparators);
+    }
+    return 0;
+}
+
+template<class K>
+RC BasicBTreeIndex<K>::locateRec(PageId id, const KeyType& searchKey, IndexCursor& cursor)
 {
     char buffer[PageFile::PAGE_SIZE];
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
@@ -275,13 +1207,33 @@ RC BTreeIndex::locateRec(PageId id, int searchKey, IndexCursor& cursor)
     int isLeaf;
     memcpy(&isLeaf, buffer, sizeof(int));
     if (isLeaf) {
-        BTLeafNode leaf(id);
+        LeafNode leaf(id, valueWidth, leafFormat);
         leaf.read(id, pf);
         cursor.pid = id;
-        return leaf.locate(searchKey, cursor.eid); 
+        cursor.opid = NO_OVERFLOW;
+        cursor.oeid = 0;
+        errorCode = leaf.locate(searchKey, cursor.eid);
+        // A parent key equal to searchKey sends the search to the leaf on
+        // its left, so the entries with searchKey may start the next leaf
+        if (errorCode == RC_NO_SUCH_RECORD && cursor.eid == leaf.getKeyCount()
+            && leaf.getNextNodePtr() != NO_NEXT_LEAF) {
+            LeafNode next(leaf.getNextNodePtr(), valueWidth, leafFormat);
+            next.read(leaf.getNextNodePtr(), pf);
+            KeyType key;
+            RecordId rid;
+            if (next.readEntry(0, key, rid) == 0 && key == searchKey) {
+                cursor.pid = next.getPageId();
+                cursor.eid = 0;
+                cacheEntry(next, 0);
+                return 0;
+            }
+        }
+        if (errorCode == 0)
+            cacheEntry(leaf, cursor.eid);
+        return errorCode;
     }
     else {
-        BTNonLeafNode nonl(id);
+        NonLeafNode nonl(id, nodeBuffer);
         nonl.read(id, pf);
         int nextPid;
         nonl.locateChildPtr(searchKey, nextPid);
@@ -307,9 +1259,312 @@ RC BTreeIndex::locateRec(PageId id, int searchKey, IndexCursor& cursor)
  *                    smaller than searchKey.
  * @return 0 if searchKey is found. Othewise an error code
  */
-RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
+template<class K>
+RC BasicBTreeIndex<K>::locate(const KeyType& searchKey, IndexCursor& cursor)
 {
-    return locateRec(rootPid, searchKey, cursor);
+    cursor.mid = 0;
+    RC errorCode = locateTree(searchKey, cursor);
+    cursor.bid = BasicWriteBuffer<K>::END;
+    if (!bufferEnabled || writeBuffer.empty() || (errorCode < 0 && errorCode != RC_NO_SUCH_RECORD))
+        return errorCode;
+    // The entries with searchKey may all be in the write buffer
+    cursor.bid = writeBuffer.lowerBound(searchKey);
+    if (cursor.bid != writeBuffer.END && writeBuffer.getKey(cursor.bid) == searchKey)
+        return 0;
+    return errorCode;
+}
+
+// locate() in the tree only
+template<class K>
+RC BasicBTreeIndex<K>::locateTree(const KeyType& searchKey, IndexCursor& cursor)
+{
+    if (nodeBuffer > 0)
+        return locateWithMessages(searchKey, cursor);
+
+    // A hot key is found in the front cache without reading any page
+    ARTCache::Entry entry;
+    if (frontCache != NULL && !frontCache->empty()
+        && frontCache->find(cacheKey(searchKey), entry)) {
+        cursor.pid = entry.pid;
+        cursor.eid = entry.eid;
+        cursor.opid = NO_OVERFLOW;
+        cursor.oeid = 0;
+        return 0;
+    }
+
+    if (modelEnabled) {
+        bool located;
+        RC errorCode = locateWithModel(searchKey, cursor, located);
+        if (located)
+            return errorCode;
+    }
+
+    // Go down the top levels through their pinned copies, pinning the
+    // nodes not pinned yet on the way; only the levels below are read
+    // from the PageFile
+    PageId pid = rootPid;
+    int parent = NOT_PINNED;
+    int slot = 0;
+    for (int level = 0; level < PINNED_LEVELS; level++) {
+        int index = (parent == NOT_PINNED) ? pinnedRoot : pinned[parent].getPinnedChild(slot);
+        if (index == NOT_PINNED) {
+            RC errorCode = pinNode(pid, index);
+            if (errorCode < 0)
+                return errorCode;
+            if (parent == NOT_PINNED)
+                pinnedRoot = index;
+            else
+                pinned[parent].setPinnedChild(slot, index);
+        }
+        if (index == LEAF_NODE)
+            break;
+        slot = pinned[index].locateChildSlot(searchKey);
+        pid = pinned[index].getChild(slot);
+        parent = index;
+    }
+    return locateRec(pid, searchKey, cursor);
+}
+
+/*
+ * Go down a buffered tree towards searchKey, and keep the messages pending
+ * on the way for the keys of the leaf reached.
+ * @param searchKey[IN] the key to go to, NULL for the first leaf
+ * @param after[IN] whether to go to the leaf after the one of searchKey
+ * @param mid[OUT] the first message with a key not smaller than (greater
+ *                 than, if after) searchKey
+ * @param leafPid[OUT] the leaf reached
+ * @return error code. 0 if no error
+ */
+template<class K>
+RC BasicBTreeIndex<K>::collectMessages(const KeyType* searchKey, bool after, int& mid, PageId& leafPid)
+{
+    char buffer[PageFile::PAGE_SIZE];
+    pending.clear();
+    pendingBounded = false;
+    leafPid = rootPid;
+    while (true) {
+        RC errorCode = pf.read(leafPid, buffer);
+        if (errorCode < 0)
+            return errorCode;
+        int isLeaf;
+        memcpy(&isLeaf, buffer, sizeof(int));
+        if (isLeaf)
+            break;
+        NonLeafNode nonl(leafPid, nodeBuffer);
+        nonl.read(leafPid, pf);
+        int slot = (searchKey == NULL) ? 0 : nonl.locateChildSlot(*searchKey);
+        if (after) {
+            while (slot < nonl.getKeyCount() && !(*searchKey < nonl.readKey(slot)))
+                slot++;
+        }
+        for (int i = 0; i < nonl.getMessageCount(); i++) {
+            if (nonl.locateChildSlot(nonl.readMessage(i).key) == slot)
+                pending.push_back(nonl.readMessage(i));
+        }
+        if (slot < nonl.getKeyCount()) {
+            pendingHi = nonl.readKey(slot);
+            pendingBounded = true;
+            leafPid = nonl.readEntry(slot);
+        }
+        else {
+            leafPid = nonl.getLastId();
+        }
+    }
+    // The messages of the nodes above go to the following leaves as well
+    if (pendingBounded) {
+        unsigned kept = 0;
+        for (unsigned i = 0; i < pending.size(); i++) {
+            if (!(pendingHi < pending[i].key))
+                pending[kept++] = pending[i];
+        }
+        pending.resize(kept);
+    }
+    stable_sort(pending.begin(), pending.end(), messageLess<Message>);
+    mid = 0;
+    if (searchKey == NULL)
+        return 0;
+    Message bound;
+    bound.key = *searchKey;
+    mid = (after ? upper_bound(pending.begin(), pending.end(), bound, messageLess<Message>)
+                 : lower_bound(pending.begin(), pending.end(), bound, messageLess<Message>)) - pending.begin();
+    return 0;
+}
+
+// locateTree() in a buffered tree: searchKey may only be in a message
+template<class K>
+RC BasicBTreeIndex<K>::locateWithMessages(const KeyType& searchKey, IndexCursor& cursor)
+{
+    PageId leafPid;
+    RC errorCode = collectMessages(&searchKey, false, cursor.mid, leafPid);
+    if (errorCode < 0)
+        return errorCode;
+    errorCode = locateRec(leafPid, searchKey, cursor);
+    if (errorCode == RC_NO_SUCH_RECORD && cursor.mid < (int)pending.size()
+        && pending[cursor.mid].key == searchKey)
+        return 0;
+    return errorCode;
+}
+
+// Make sure that the pending messages at the cursor cover the next entry
+// in the tree: once they run out, the messages for the following leaves
+// are collected, up to the leaf holding the next entry
+template<class K>
+RC BasicBTreeIndex<K>::prepareMessages(IndexCursor& cursor)
+{
+    while (cursor.mid == (int)pending.size() && pendingBounded) {
+        IndexCursor next = cursor;
+        KeyType key;
+        RecordId rid;
+        string value;
+        RC errorCode = readTree(next, key, rid, value);
+        if (errorCode < 0 && errorCode != RC_END_OF_TREE)
+            return errorCode;
+        if (errorCode == 0 && !(pendingHi < key))
+            return 0;
+        KeyType hi = pendingHi;
+        PageId leafPid;
+        if ((errorCode = collectMessages(&hi, true, cursor.mid, leafPid)) < 0)
+            return errorCode;
+    }
+    return 0;
+}
+
+// readForward() over the tree with the messages pending in it, without
+// the write buffer. The entries of a leaf come before the messages with
+// the same key
+template<class K>
+RC BasicBTreeIndex<K>::readLevel(IndexCursor& cursor, KeyType& key, RecordId& rid, string& value)
+{
+    if (nodeBuffer == 0)
+        return readTree(cursor, key, rid, value);
+    IndexCursor next = cursor;
+    RC errorCode = readTree(next, key, rid, value);
+    if (errorCode < 0 && errorCode != RC_END_OF_TREE)
+        return errorCode;
+    if (cursor.mid < (int)pending.size() && (errorCode == RC_END_OF_TREE || pending[cursor.mid].key < key)) {
+        const Message& message = pending[cursor.mid++];
+        key = message.key;
+        rid = message.rid;
+        value = message.value;
+        return 0;
+    }
+    if (errorCode == 0)
+        cursor = next;
+    return errorCode;
+}
+
+/*
+ * Pin the node pid: add its in-memory copy to pinned.
+ * @param pid[IN] the node to pin
+ * @param index[OUT] the index of the copy in pinned, LEAF_NODE if pid is a
+ *                   leaf (leaves are not pinned)
+ * @return error code. 0 if no error
+ */
+template<class K>
+RC BasicBTreeIndex<K>::pinNode(PageId pid, int& index)
+{
+    char buffer[PageFile::PAGE_SIZE];
+    RC errorCode = pf.read(pid, buffer);
+    if (errorCode < 0)
+        return errorCode;
+    int isLeaf;
+    memcpy(&isLeaf, buffer, sizeof(int));
+    if (isLeaf) {
+        index = LEAF_NODE;
+        return 0;
+    }
+    NonLeafNode nonl(pid, nodeBuffer);
+    nonl.read(pid, pf);
+    pinned.push_back(PinnedNode(nonl));
+    index = pinned.size() - 1;
+    return 0;
+}
+
+/*
+ * Locate searchKey in the leaf predicted by the learned model.
+ * @param searchKey[IN] the key to find
+ * @param cursor[OUT] the cursor, as set by locate()
+ * @param located[OUT] false if the model cannot tell the leaf, and the
+ *                     tree must be searched instead
+ * @return the result of locate() if located
+ */
+template<class K>
+RC BasicBTreeIndex<K>::locateWithModel(const KeyType& searchKey, IndexCursor& cursor, bool& located)
+{
+    located = false;
+    if (modelStale) {
+        RC errorCode = rebuildModel();
+        if (errorCode < 0)
+            return errorCode;
+    }
+    int position = model.findLeaf(K::toInt(searchKey));
+    if (position < 0) {
+        addModelDrift();
+        return 0;
+    }
+    PageId pid = model.getLeaf(position);
+    LeafNode leaf(pid, valueWidth, leafFormat);
+    leaf.read(pid, pf);
+    int eid;
+    RC errorCode = leaf.locate(searchKey, eid);
+    if (eid < leaf.getKeyCount()) {
+        cursor.pid = pid;
+        cursor.eid = eid;
+        cursor.opid = NO_OVERFLOW;
+        cursor.oeid = 0;
+        located = true;
+        if (errorCode == 0)
+            cacheEntry(leaf, eid);
+        return errorCode;
+    }
+    // Past the last entry, searchKey may start the next leaf, or be in a
+    // leaf split off after the model was built
+    if (leaf.getNextNodePtr() != model.getLeaf(position + 1))
+        addModelDrift();
+    return 0;
+}
+
+// Rebuild the learned model over the current leaves
+template<class K>
+RC BasicBTreeIndex<K>::rebuildModel()
+{
+    vector<int64_t> firstKeys;
+    vector<PageId> pids;
+    PageId pid;
+    RC errorCode = leftmostLeaf(pid);
+    if (errorCode < 0)
+        return errorCode;
+    while (pid != NO_NEXT_LEAF) {
+        LeafNode leaf(pid, valueWidth, leafFormat);
+        leaf.read(pid, pf);
+        KeyType key;
+        RecordId rid;
+        if (leaf.readEntry(0, key, rid) == 0) {
+            firstKeys.push_back(K::toInt(key));
+            pids.push_back(pid);
+        }
+        pid = leaf.getNextLeaf();
+    }
+    model.build(firstKeys, pids);
+    modelStale = false;
+    modelDrift = 0;
+    return 0;
+}
+
+// Count a leaf split or a failed prediction against the learned model
+template<class K>
+void BasicBTreeIndex<K>::addModelDrift()
+{
+    if (++modelDrift * MODEL_DRIFT_DIVISOR > model.getLeafCount())
+        modelStale = true;
+}
+
+// Drop the pinned nodes; they are pinned again by the next locate()
+template<class K>
+void BasicBTreeIndex<K>::unpin()
+{
+    pinned.clear();
+    pinnedRoot = NOT_PINNED;
 }
 
 /*
@@ -320,33 +1575,141 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
  * @param rid[OUT] the RecordId stored at the index cursor location.
  * @return error code. 0 if no error
  */
-RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
+template<class K>
+RC BasicBTreeIndex<K>::readForward(IndexCursor& cursor, KeyType& key, RecordId& rid)
 {
-    char buffer[PageFile::PAGE_SIZE];
-    memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
-    RC errorCode = pf.read(cursor.pid, buffer);
-    if (errorCode < 0)
+    string value;
+    return readForward(cursor, key, rid, value);
+}
+
+/*
+ * Read the (key, rid, value) entry at the location specified by the index
+ * cursor, and move foward the cursor to the next entry.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location.
+ * @param rid[OUT] the RecordId stored at the index cursor location.
+ * @param value[OUT] the value stored at the index cursor location.
+ * @return error code. 0 if no error
+ */
+template<class K>
+RC BasicBTreeIndex<K>::readForward(IndexCursor& cursor, KeyType& key, RecordId& rid, string& value)
+{
+    if (nodeBuffer > 0) {
+        RC errorCode = prepareMessages(cursor);
+        if (errorCode < 0)
+            return errorCode;
+    }
+    if (cursor.bid == writeBuffer.END)
+        return readLevel(cursor, key, rid, value);
+    // Merge the write buffer into the entries of the tree: the buffered
+    // entry comes first if its key is smaller than the next one in the tree
+    IndexCursor next = cursor;
+    RC errorCode = readLevel(next, key, rid, value);
+    if (errorCode < 0 && errorCode != RC_END_OF_TREE)
         return errorCode;
-    BTLeafNode leaf(cursor.pid);
-    leaf.read(cursor.pid, pf);
-    errorCode = leaf.readEntry(cursor.eid, key, rid);
+    if (errorCode == RC_END_OF_TREE || writeBuffer.getKey(cursor.bid) < key) {
+        key = writeBuffer.getKey(cursor.bid);
+        rid = writeBuffer.getRid(cursor.bid);
+        value = writeBuffer.getValue(cursor.bid);
+        cursor.bid = writeBuffer.next(cursor.bid);
+        return 0;
+    }
+    cursor = next;
+    return 0;
+}
+
+// readForward() over the entries in the tree only
+template<class K>
+RC BasicBTreeIndex<K>::readTree(IndexCursor& cursor, KeyType& key, RecordId& rid, string& value)
+{
+    // Cursors mostly move within a leaf, so the decoded leaf is kept
+    // for the next call
+    if (cursorLeaf.getPageId() != cursor.pid) {
+        cursorLeaf = LeafNode(cursor.pid, valueWidth, leafFormat);
+        RC errorCode = cursorLeaf.read(cursor.pid, pf);
+        if (errorCode < 0) {
+            cursorLeaf = LeafNode(-1);
+            return errorCode;
+        }
+    }
+    RC errorCode = cursorLeaf.readEntry(cursor.eid, key, rid, value);
+    // Past the last entry of this leaf, continue from the first entry
+    // of the next one
     if (errorCode == RC_NO_SUCH_RECORD) {
-        int nextLeafVal = leaf.getNextLeaf();
-        if (nextLeafVal == -1)
+        int nextLeafVal = cursorLeaf.getNextLeaf();
+        if (nextLeafVal == NO_NEXT_LEAF)
             return RC_END_OF_TREE;
         cursor.pid = nextLeafVal;
         cursor.eid = 0;
-        memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
-        errorCode = pf.read(cursor.pid, buffer);
-        if (errorCode < 0)
-            return errorCode;
-        BTLeafNode leafNext(cursor.pid);
-        leafNext.read(cursor.pid, pf);
-        cursor.eid++;
-        return leafNext.readEntry(cursor.eid, key, rid);
+        return readTree(cursor, key, rid, value);
     }
-    else {
+    else if (errorCode == 0) {
+        // The entries of the key are on overflow pages
+        if (rid.sid == LeafNode::OVERFLOW_SID)
+            return readOverflow(cursor, rid, value);
         cursor.eid++;
+    }
+    return errorCode;
+}
+
+// Read the entry of the overflow page list at the cursor, whose leaf entry
+// (pointing to the first overflow page) was read into rid
+template<class K>
+RC BasicBTreeIndex<K>::readOverflow(IndexCursor& cursor, RecordId& rid, string& value)
+{
+    const int entrySize = sizeof(RecordId) + valueWidth;
+    char page[PageFile::PAGE_SIZE];
+    OverflowHeader header;
+    if (cursor.opid == NO_OVERFLOW) {
+        cursor.opid = rid.pid;
+        cursor.oeid = 0;
+    }
+    RC errorCode = pf.read(cursor.opid, page);
+    if (errorCode < 0)
         return errorCode;
+    memcpy(&header, page, sizeof(header));
+    const char* entry = page + sizeof(OverflowHeader) + cursor.oeid * entrySize;
+    memcpy(&rid, entry, sizeof(RecordId));
+    value.erase();
+    if (valueWidth > 0)
+        value.assign(entry + sizeof(RecordId), strnlen(entry + sizeof(RecordId), valueWidth));
+    // Move to the next entry, or past the leaf entry at the end of the list
+    if (++cursor.oeid == header.count) {
+        cursor.opid = header.next;
+        cursor.oeid = 0;
+        if (cursor.opid == NO_OVERFLOW)
+            cursor.eid++;
     }
+    return 0;
 }
+
+template<class K>
+int BasicBTreeIndex<K>::getValueWidth() const
+{
+    return valueWidth;
+}
+
+template<class K>
+int BasicBTreeIndex<K>::getLeafFormat() const
+{
+    return leafFormat;
+}
+
+template<class K>
+bool BasicBTreeIndex<K>::isBuffered() const
+{
+    return nodeBuffer > 0;
+}
+
+template<class K>
+bool BasicBTreeIndex<K>::coversValue(const string& value) const
+{
+    // A stored value that fills its whole width may have been cut
+    return valueWidth > 0 && (int)value.size() < valueWidth;
+}
+
+template class BasicBTreeIndex<IntKey>;
+template class BasicBTreeIndex<StringKey>;
+template class BasicBTreeIndex<Int64Key>;
+template class BasicBTreeIndex<DoubleKey>;
+template class BasicBTreeIndex<CompositeKey>;
@@ -14,11 +14,20 @@
 #include "PageFile.h"
 #include "RecordFile.h"
 #include "BTreeNode.h"
+#include "BloomFilter.h"
+#include "LearnedModel.h"
+#include "ARTCache.h"
+#include "WriteBuffer.h"
 
 /**
  * The data structure to point to a particular entry at a b+tree leaf node.
  * An IndexCursor consists of pid (PageId of the leaf node) and 
  * eid (the location of the index entry inside the node).
+ * Inside a posting list moved to overflow pages, opid and oeid point to
+ * the entry in the overflow page.
+ * If the index has a write buffer, bid points to the next buffered entry.
+ * In a buffered (B-epsilon) tree, mid points to the next message pending
+ * above the leaves (see BasicBTreeIndex::initializeTree()).
  * IndexCursor is used for index lookup and traversal.
  */
 typedef struct {
@@ -26,19 +35,73 @@ typedef struct {
   PageId  pid;  
   // The entry number inside the node
   int     eid;  
+  // PageId of the overflow page, -1 outside of overflow pages
+  PageId  opid;
+  // The entry number inside the overflow page
+  int     oeid;
+  // The position of the next entry in the write buffer, -1 if none
+  int     bid;
+  // The position of the next pending message
+  int     mid;
 } IndexCursor;
 
 /**
  * Implements a B-Tree index for bruinbase.
- * 
+ * K is the key traits class (see BTreeKey.h).
  */
-class BTreeIndex {
+template<class K>
+class BasicBTreeIndex {
  public:
-  BTreeIndex();
+  typedef typename K::Type KeyType;
+
+  BasicBTreeIndex();
 
   RC writeRoot();
+
+  /**
+   * Read the root and the settings of the tree from block 0 of the file.
+   * @return error code. 0 if no error. RC_INVALID_FILE_FORMAT if the file
+   *         was written in another format of the index, and has to be
+   *         built again
+   */
   RC readRoot();
   RC initializeTree();
+
+  /**
+   * Create an empty tree whose leaf entries store the first valueWidth
+   * bytes of the record value next to the key and RecordId, so that
+   * queries can be answered from the index without reading the table.
+   * @param valueWidth[IN] # value bytes stored per entry, 0 for none
+   * @return error code. 0 if no error
+   */
+  RC initializeTree(int valueWidth);
+
+  /**
+   * Create an empty tree like initializeTree(valueWidth), whose leaves are
+   * stored in the given page format. The format is kept in the index file.
+   * @param valueWidth[IN] # value bytes stored per entry, 0 for none
+   * @param leafFormat[IN] LeafNode::POSTING_LISTS or LeafNode::PACKED
+   * @return error code. 0 if no error
+   */
+  RC initializeTree(int valueWidth, int leafFormat);
+
+  /**
+   * Create an empty tree like initializeTree(valueWidth, leafFormat),
+   * which may be buffered (a B-epsilon tree): its internal nodes keep half
+   * of their page for the messages of the inserts not applied to the
+   * leaves yet. An insert only adds a message to the root, and the
+   * messages move down in batches, to the child with the most of them,
+   * once a buffer is full, so that a leaf is read and written once for
+   * many entries. locate() and readForward() apply the messages pending on
+   * the way to the leaf. Whether the tree is buffered is kept in the index
+   * file. A buffered tree has no learned model and no front cache, and
+   * only the last cursor located can be read forward.
+   * @param valueWidth[IN] # value bytes stored per entry, 0 for none
+   * @param leafFormat[IN] LeafNode::POSTING_LISTS or LeafNode::PACKED
+   * @param buffered[IN] whether the internal nodes have message buffers
+   * @return error code. 0 if no error
+   */
+  RC initializeTree(int valueWidth, int leafFormat, bool buffered);
   void print();
   
   /**
@@ -55,6 +118,13 @@ class BTreeIndex {
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * Drop what the process keeps in memory about an index file across
+   * opens (its sidecars and its front cache), once the file is replaced.
+   * @param indexname[IN] the name of the index file
+   */
+  static void forget(const std::string& indexname);
     
   /**
    * Insert (key, RecordId) pair to the index.
@@ -62,7 +132,18 @@ class BTreeIndex {
    * @param rid[IN] the RecordId for the record being inserted into the index
    * @return error code. 0 if no error
    */
-  RC insert(int key, const RecordId& rid);
+  RC insert(const KeyType& key, const RecordId& rid);
+
+  /**
+   * Insert (key, RecordId, value) entry to the index.
+   * The value is only stored by a covering index (see initializeTree()),
+   * which must be populated with this function.
+   * @param key[IN] the key for the value inserted into the index
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @param value[IN] the value of the record
+   * @return error code. 0 if no error
+   */
+  RC insert(const KeyType& key, const RecordId& rid, const std::string& value);
 
   /**
    * Run the standard B+Tree key search algorithm and identify the
@@ -82,7 +163,7 @@ class BTreeIndex {
    *                    smaller than searchKey.
    * @return 0 if searchKey is found. Othewise, an error code
    */
-  RC locate(int searchKey, IndexCursor& cursor);
+  RC locate(const KeyType& searchKey, IndexCursor& cursor);
 
   /**
    * Read the (key, rid) pair at the location specified by the index cursor,
@@ -92,14 +173,163 @@ class BTreeIndex {
    * @param rid[OUT] the RecordId stored at the index cursor location
    * @return error code. 0 if no error
    */
-  RC readForward(IndexCursor& cursor, int& key, RecordId& rid);
+  RC readForward(IndexCursor& cursor, KeyType& key, RecordId& rid);
+
+  /**
+   * Read the (key, rid, value) entry at the location specified by the
+   * index cursor, and move foward the cursor to the next entry.
+   * value is the (prefix of the) record value stored in the leaf, or
+   * empty if the index is not covering. Use coversValue() to check
+   * whether it is the complete value.
+   * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+   * @param key[OUT] the key stored at the index cursor location
+   * @param rid[OUT] the RecordId stored at the index cursor location
+   * @param value[OUT] the value stored at the index cursor location
+   * @return error code. 0 if no error
+   */
+  RC readForward(IndexCursor& cursor, KeyType& key, RecordId& rid, std::string& value);
+
+  /**
+   * @return # bytes of the record value stored in every leaf entry
+   *         (0 if the index is not covering)
+   */
+  int getValueWidth() const;
+
+  /**
+   * @return the page format of the leaves, LeafNode::POSTING_LISTS or
+   *         LeafNode::PACKED
+   */
+  int getLeafFormat() const;
+
+  /**
+   * @return true if the internal nodes have message buffers
+   */
+  bool isBuffered() const;
+
+  /**
+   * @param value[IN] a value returned by readForward()
+   * @return true if value is the complete record value, so that the
+   *         record does not have to be read from the table
+   */
+  bool coversValue(const std::string& value) const;
+
+  /**
+   * Attach a membership filter to the index. The filter is kept in a
+   * sidecar file next to the index file (indexname + ".bf"), is updated
+   * on every insert and is loaded into memory whenever the index is
+   * opened, so that searches for keys that are not in the index can be
+   * answered without reading the tree.
+   * The index must be opened in 'w' mode. Keys already in the tree are
+   * added to the filter.
+   * @return error code. 0 if no error
+   */
+  RC enableFilter();
+
+  /**
+   * Attach a learned model over the leaf level to the index (see
+   * LearnedModel.h). locate() then goes straight to the leaf predicted by
+   * the model and only walks the tree when the prediction cannot be
+   * trusted. The model is built over the leaves at the next locate(),
+   * and rebuilt when leaf splits and failed predictions show that it no
+   * longer fits the tree. In 'w' mode the model is saved to a sidecar file
+   * (indexname + ".lm") by close() and loaded whenever the index is
+   * opened. Only indexes with integral keys and without message buffers
+   * can have a model.
+   * @return error code. 0 if no error
+   */
+  RC enableModel();
+
+  /**
+   * Put a write buffer in front of the index (see WriteBuffer.h). insert()
+   * then only appends the entry to a log and adds it to the buffer, and
+   * the buffer is merged into the tree in key order once it is full and
+   * when the index is closed. locate() and readForward() read the
+   * buffered entries together with the entries in the tree. The log is a
+   * sidecar file (indexname + ".wal"); an index opened with a log gets
+   * its buffer back.
+   * The index must be opened in 'w' mode. Inserting an entry, which may
+   * merge the buffer, invalidates the cursors.
+   * @return error code. 0 if no error
+   */
+  RC enableWriteBuffer();
+
+  /**
+   * Rewrite the tree so that its leaves follow each other in key order in
+   * the index file, and range scans read consecutive pages. The entries
+   * (with those of the write buffer and the pending messages) are copied
+   * into full leaves of a new file (the index file name + ".reorg"),
+   * followed by the internal nodes built over them, and the new file is
+   * renamed over the index file. The index file is never written, so that
+   * a reader which has it open keeps reading the old tree, and the pages
+   * of the old tree are freed with it.
+   * The index must be opened in 'w' mode. The cursors are invalidated.
+   * @return error code. 0 if no error
+   */
+  RC reorganize();
+
+  /**
+   * Check the membership filter for searchKey without reading any page.
+   * @param searchKey[IN] the key to check
+   * @return false if searchKey is certainly not in the index.
+   *         true if it may be, or if the index has no filter.
+   */
+  bool mayContain(const KeyType& searchKey) const;
+
+  /**
+   * Look searchKey up in the front cache of the index (see ARTCache.h)
+   * without reading any page. The cache holds the keys recently found by
+   * locate(), and is shared by every open of the same index file.
+   * @param searchKey[IN] the key to find
+   * @param rid[OUT] the RecordId of the only entry with searchKey
+   * @return 0 if searchKey is cached and has a single entry.
+   *         RC_NO_SUCH_RECORD otherwise
+   */
+  RC lookupCached(const KeyType& searchKey, RecordId& rid);
   
  private:
   void printRec(PageId id, std::string offset);
-  RC insertSplitWrite(BTLeafNode& leaf, int key, const RecordId& rid, int& siblingKey, PageId& siblingPid);
-  RC insertSplitWrite(BTNonLeafNode& nonl, int key, PageId pid, int& midKey, PageId& siblingPid);
-  RC insertRecursive(BTNonLeafNode& node, int key, const RecordId& rid, bool& overflow, int& overflowKey, PageId& overflowPid); 
-  RC locateRec(PageId id, int searchKey, IndexCursor& cursor);
+  typedef BasicBTLeafNode<K>    LeafNode;
+  typedef BasicBTNonLeafNode<K> NonLeafNode;
+  typedef BasicBTPinnedNode<K>  PinnedNode;
+  typedef typename NonLeafNode::Message Message;
+  typedef std::vector<std::pair<KeyType, PageId> > SplitList;
+
+  RC insertSplitWrite(LeafNode& leaf, const KeyType& key, const RecordId& rid, const std::string& value, KeyType& siblingKey, PageId& siblingPid);
+  RC insertSplitWrite(NonLeafNode& nonl, const KeyType& key, PageId pid, KeyType& midKey, PageId& siblingPid);
+  RC insertRecursive(NonLeafNode& node, const KeyType& key, const RecordId& rid, const std::string& value, bool& overflow, KeyType& overflowKey, PageId& overflowPid); 
+  RC locateRec(PageId id, const KeyType& searchKey, IndexCursor& cursor);
+  RC locateTree(const KeyType& searchKey, IndexCursor& cursor);
+  RC readTree(IndexCursor& cursor, KeyType& key, RecordId& rid, std::string& value);
+  RC insertTree(const KeyType& key, const RecordId& rid, const std::string& value);
+  RC mergeBuffer();
+  RC insertMessage(const KeyType& key, const RecordId& rid, const std::string& value);
+  RC pushMessages(NonLeafNode& node, const std::vector<Message>& batch, SplitList& splits);
+  RC applyMessages(PageId pid, std::vector<Message>& batch, SplitList& splits);
+  RC writeAndSplit(NonLeafNode& node, SplitList& splits);
+  RC collectMessages(const KeyType* searchKey, bool after, int& mid, PageId& leafPid);
+  RC locateWithMessages(const KeyType& searchKey, IndexCursor& cursor);
+  RC prepareMessages(IndexCursor& cursor);
+  RC readLevel(IndexCursor& cursor, KeyType& key, RecordId& rid, std::string& value);
+  RC addMessagesToFilter(PageId pid);
+  RC leftmostLeaf(PageId& pid);
+  RC locateFirst(IndexCursor& cursor);
+  RC copyTree(BasicBTreeIndex<K>& source);
+  RC buildInternalLevels(std::vector<PageId>& children, std::vector<KeyType>& separators);
+  RC insertIntoLeaf(LeafNode& leaf, const KeyType& key, const RecordId& rid, const std::string& value, bool writeLeaf = true);
+  RC moveToOverflow(LeafNode& leaf, int eid, int count);
+  RC appendOverflow(PageId head, const RecordId& rid, const std::string& value);
+  RC readOverflow(IndexCursor& cursor, RecordId& rid, std::string& value);
+  RC addToFilter(const KeyType& key);
+  RC rebuildFilter(int capacity);
+  RC pinNode(PageId pid, int& index);
+  RC locateWithModel(const KeyType& searchKey, IndexCursor& cursor, bool& located);
+  RC rebuildModel();
+  void addModelDrift();
+  void unpin();
+  void cacheEntry(LeafNode& leaf, int eid);
+  void invalidateLeaf(PageId pid);
+  void uncacheKey(const KeyType& key);
+  static std::string cacheKey(const KeyType& key);
 
   PageFile pf;         /// the PageFile used to store the actual b+tree in disk
 
@@ -109,6 +339,43 @@ class BTreeIndex {
   /// this class is destructed. Make sure to store the values of the two 
   /// variables in disk, so that they can be reconstructed when the index
   /// is opened again later.
+
+  char        mode;           /// the mode the index file was opened with
+  std::string indexName;      /// the name of the index file
+  bool        filterEnabled;  /// whether the index has a membership filter
+  std::string filterName;     /// the name of the filter sidecar file
+  BloomFilter filter;         /// the membership filter of the index
+  int         valueWidth;     /// # value bytes stored per leaf entry (0 if none)
+  int         leafFormat;     /// the page format of the leaves
+  bool        modelEnabled;   /// whether locate() uses the learned model
+  bool        modelStale;     /// whether the model must be rebuilt before use
+  int         modelDrift;     /// # leaf splits and failed predictions since
+                              /// the model was built
+  std::string modelName;      /// the name of the model sidecar file
+  LearnedModel model;         /// the learned model over the leaf level
+  LeafNode    cursorLeaf;     /// the leaf last read by readForward()
+  ARTCache*   frontCache;     /// the hot keys of the index file
+  bool        bufferEnabled;  /// whether inserts go to the write buffer
+  std::string bufferName;     /// the name of the write buffer log
+  BasicWriteBuffer<K> writeBuffer; /// the entries not in the tree yet
+  int         nodeBuffer;     /// # message bytes per internal node page
+                              /// (0 if the tree is not buffered)
+  std::vector<Message> pending; /// the messages above the leaf of the last
+                                /// cursor located, sorted by key
+  bool        pendingBounded; /// whether the keys of that leaf are bounded
+  KeyType     pendingHi;      /// by pendingHi (the messages with greater keys
+                              /// are pending above the following leaves)
+
+  /// In-memory copies of the internal nodes of the top levels, pinned by
+  /// locate() as it first goes through them and dropped after a split
+  std::vector<PinnedNode> pinned;
+  int         pinnedRoot;     /// index of the root in pinned (see pinNode())
 };
 
+typedef BasicBTreeIndex<IntKey>       BTreeIndex;
+typedef BasicBTreeIndex<StringKey>    BTreeStringIndex;
+typedef BasicBTreeIndex<Int64Key>     BTreeInt64Index;
+typedef BasicBTreeIndex<DoubleKey>    BTreeDoubleIndex;
+typedef BasicBTreeIndex<CompositeKey> BTreeCompositeIndex;
+
 #endif /* BTREEINDEX_H */
@@ -0,0 +1,263 @@
+#ifndef BTREEKEY_H
+#define BTREEKEY_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include "RecordFile.h"
+
+/**
+ * Key traits for the B+tree classes. A traits class defines the key type
+ * (which must support operator< and operator==) and how a key is stored
+ * in a node page:
+ *   size(key, n)       # bytes the key takes in the page without its
+ *                      first n bytes
+ *   write(buf, key, n) store the key at buf without its first n bytes
+ *   read(buf, key, n)  load the key stored at buf; the first n bytes are
+ *                      taken from key. returns # bytes read
+ *   hash(key)          64-bit hash of the key for the membership filter
+ *   separator(a, b)    the shortest key s with a < s <= b (for a < b)
+ *   lowerBound(keys, key)  index of the first of the sorted keys that is
+ *                      not smaller than key (keys.size() if none)
+ *
+ * FIXED_SIZE is the # bytes of every key, or 0 if keys differ in size.
+ * Nodes with fixed-size keys know their capacity at compile time.
+ *
+ * If PREFIXED is true, a leaf node stores the prefix shared by all of its
+ * keys once and only the rest of every key (prefix compression):
+ *   commonPrefix(a, b) # leading bytes shared by a and b
+ *   prefix(key, n)     the key made of the first n bytes of key
+ * Otherwise n is always 0.
+ *
+ * If INTEGRAL is true, keys map to int64_t in order (toInt, fromInt), and
+ * a packed leaf stores the keys as bit-packed differences.
+ */
+
+/**
+ * Binary search without branches on the comparison, for keys that are
+ * compared with a few machine instructions: the loop runs log2(n) times
+ * whatever the keys, so there are no mispredicted branches to pay for.
+ */
+template<class T>
+inline int branchlessLowerBound(const std::vector<T>& keys, const T& key)
+{
+  int n = keys.size();
+  if (n == 0) return 0;
+  const T* first = &keys[0];
+  const T* base = first;
+  while (n > 1) {
+    int half = n / 2;
+    base = (base[half] < key) ? base + half : base;
+    n -= half;
+  }
+  return (base - first) + (*base < key);
+}
+
+// 64-bit finalizer of MurmurHash3
+inline uint64_t mixHash(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * Fixed-size key traits: the key is stored as its sizeof(T) bytes.
+ */
+template<class T>
+struct FixedKey {
+  typedef T Type;
+
+  static const bool PREFIXED = false;
+  static const bool INTEGRAL = false;
+  static const int FIXED_SIZE = sizeof(T);
+
+  static int size(const T& key, int n = 0) { return sizeof(T); }
+
+  static void write(char* buf, const T& key, int n = 0)
+  {
+    memcpy(buf, &key, sizeof(T));
+  }
+
+  static int read(const char* buf, T& key, int n = 0)
+  {
+    memcpy(&key, buf, sizeof(T));
+    return sizeof(T);
+  }
+
+  static int commonPrefix(const T& a, const T& b) { return 0; }
+  static T prefix(const T& key, int n) { return key; }
+  static T separator(const T& a, const T& b) { return b; }
+
+  // only used if INTEGRAL
+  static int64_t toInt(const T& key) { return 0; }
+  static T fromInt(int64_t v) { return T(); }
+
+  static int lowerBound(const std::vector<T>& keys, const T& key)
+  {
+    return branchlessLowerBound(keys, key);
+  }
+};
+
+/**
+ * IntKey: the int record key.
+ */
+struct IntKey : FixedKey<int> {
+  static const bool INTEGRAL = true;
+  static int64_t toInt(const int& key) { return key; }
+  static int fromInt(int64_t v) { return (int)v; }
+
+  static uint64_t hash(const int& key)
+  {
+    return mixHash((uint32_t)key);
+  }
+};
+
+/**
+ * Int64Key: 64-bit surrogate keys.
+ */
+struct Int64Key : FixedKey<int64_t> {
+  static const bool INTEGRAL = true;
+  static int64_t toInt(const int64_t& key) { return key; }
+  static int64_t fromInt(int64_t v) { return v; }
+
+  static uint64_t hash(const int64_t& key)
+  {
+    return mixHash((uint64_t)key);
+  }
+};
+
+/**
+ * DoubleKey: floating point keys. NaN is not a valid key.
+ */
+struct DoubleKey : FixedKey<double> {
+  static uint64_t hash(const double& key)
+  {
+    // -0.0 == 0.0, so both must hash the same
+    double d = (key == 0) ? 0 : key;
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return mixHash(bits);
+  }
+};
+
+/**
+ * TenantKey: a key scoped by a tenant id, ordered by tenant first.
+ */
+#pragma pack(push, 4)
+struct TenantKey {
+  int     tenantId;
+  int64_t key;
+
+  bool operator<(const TenantKey& k) const
+  {
+    return tenantId < k.tenantId || (tenantId == k.tenantId && key < k.key);
+  }
+  bool operator==(const TenantKey& k) const
+  {
+    return tenantId == k.tenantId && key == k.key;
+  }
+};
+#pragma pack(pop)
+
+inline std::ostream& operator<<(std::ostream& os, const TenantKey& k)
+{
+  return os << "(" << k.tenantId << "," << k.key << ")";
+}
+
+/**
+ * CompositeKey: (tenant id, key) pairs, stored in 12 bytes.
+ */
+struct CompositeKey : FixedKey<TenantKey> {
+  static uint64_t hash(const TenantKey& k)
+  {
+    return mixHash((uint64_t)k.key ^ mixHash((uint32_t)k.tenantId));
+  }
+};
+
+/**
+ * StringKey: a record value, stored as a one-byte length and the bytes.
+ * Keys are at most MAX_LENGTH bytes long. Longer strings must be cut to
+ * their prefix with truncate() before they are used as a key, so a key of
+ * MAX_LENGTH bytes may stand for a longer value.
+ */
+struct StringKey {
+  typedef std::string Type;
+
+  static const int MAX_LENGTH = 100;
+
+  static std::string truncate(const std::string& s)
+  {
+    return ((int)s.size() > MAX_LENGTH) ? s.substr(0, MAX_LENGTH) : s;
+  }
+
+  static const bool PREFIXED = true;
+  static const bool INTEGRAL = false;
+  static const int FIXED_SIZE = 0;
+
+  static int size(const std::string& key, int n = 0)
+  {
+    return 1 + key.size() - n;
+  }
+
+  static void write(char* buf, const std::string& key, int n = 0)
+  {
+    *buf = (unsigned char)(key.size() - n);
+    memcpy(buf + 1, key.data() + n, key.size() - n);
+  }
+
+  static int read(const char* buf, std::string& key, int n = 0)
+  {
+    int length = (unsigned char)*buf;
+    key.resize(n);
+    key.append(buf + 1, length);
+    return 1 + length;
+  }
+
+  static int commonPrefix(const std::string& a, const std::string& b)
+  {
+    unsigned n = 0;
+    while (n < a.size() && n < b.size() && a[n] == b[n]) n++;
+    return n;
+  }
+
+  static std::string prefix(const std::string& key, int n)
+  {
+    return key.substr(0, n);
+  }
+
+  static std::string separator(const std::string& a, const std::string& b)
+  {
+    // b cut right after the first byte where it differs from a
+    if (!(a < b)) return b;
+    return b.substr(0, commonPrefix(a, b) + 1);
+  }
+
+  // only used if INTEGRAL
+  static int64_t toInt(const std::string& key) { return 0; }
+  static std::string fromInt(int64_t v) { return std::string(); }
+
+  static int lowerBound(const std::vector<std::string>& keys, const std::string& key)
+  {
+    return std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+  }
+
+  static uint64_t hash(const std::string& key)
+  {
+    // 64-bit FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned i = 0; i < key.size(); i++) {
+      h ^= (unsigned char)key[i];
+      h *= 0x100000001b3ULL;
+    }
+    return h;
+  }
+};
+
+#endif // BTREEKEY_H
@@ -1,4 +1,5 @@
-#include <list>
+#include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <string.h>
@@ -13,40 +14,345 @@ using namespace std;
 // Nodes may have [38, 75] keys
 // ceil(N/2) = 38
 // Non-leaf nodes may have [38, 75] keys
+// Nodes with larger keys hold as many entries as fit in the page, and
+// leaves as many as their posting lists fit in the page
 #define MAX_KEYS 75
 
+// Nodes are split within this many bytes from the middle of the page
+#define SPLIT_SLACK (PageFile::PAGE_SIZE / 16)
+
+// # bytes of a page taken by isLeaf, length and the trailing PageId
+#define NODE_OVERHEAD (2 * sizeof(int) + sizeof(PageId))
+
 void reportErrorExit(RC error) {
     printf("Error! Received RC code%d\n", error);
     exit(error);
 }
 
-BTLeafNode::BTLeafNode(PageId id) {
+template<class K>
+BasicBTLeafNode<K>::BasicBTLeafNode(PageId id, int valueWidth, int format) {
     isLeaf = 1;
     length = 0;
     this->id = id;
     nextLeaf = -1;
+    this->valueWidth = valueWidth;
+    this->format = format;
+}
+
+// Page layout: isLeaf, length, [prefix], entries, nextLeaf
+// The entries are stored as posting lists or packed (see encodePacked())
+// With prefix compression (K::PREFIXED) the prefix shared by all keys in
+// the node is stored once, and the entries hold the keys without it.
+template<class K>
+int BasicBTLeafNode<K>::prefixLength() {
+    if (!K::PREFIXED || length == 0)
+        return 0;
+    // Keys are sorted, so the first and the last key share the least
+    return K::commonPrefix(keys.front(), keys.back());
+}
+
+// Store v in 7-bit groups, low group first, at page + pos (if page is not
+// NULL). Return the # bytes taken.
+static int putVarint(char* page, int pos, unsigned v)
+{
+    int n = 0;
+    do {
+        unsigned char byte = v & 0x7f;
+        v >>= 7;
+        if (v)
+            byte |= 0x80;
+        if (page)
+            page[pos + n] = byte;
+        n++;
+    } while (v);
+    return n;
+}
+
+static int getVarint(const char* page, int pos, unsigned& v)
+{
+    int n = 0;
+    int shift = 0;
+    unsigned char byte;
+    v = 0;
+    do {
+        byte = page[pos + n++];
+        v |= (unsigned)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return n;
+}
+
+// Bit-packed arrays hold values of at most this many bits, so that every
+// value can be read with a single 8-byte load
+#define MAX_PACKED_BITS 57
+
+// The key width byte of a packed leaf whose keys are not bit-packed
+#define RAW_KEYS 0xff
+
+// # bits needed to store v
+static int bitWidth(uint64_t v)
+{
+    int width = 0;
+    while (v) {
+        width++;
+        v >>= 1;
+    }
+    return width;
+}
+
+// Store the n values with width bits each at out (if out is not NULL).
+// Return the # bytes taken.
+static int packBits(char* out, const uint64_t* values, int n, int width)
+{
+    int bytes = (int)(((int64_t)n * width + 7) / 8);
+    if (!out)
+        return bytes;
+    memset(out, 0, bytes);
+    for (int i = 0; i < n; i++) {
+        uint64_t bit = (uint64_t)i * width;
+        int shift = bit % 8;
+        uint64_t v = values[i] << shift;
+        for (int b = 0; b < width + shift; b += 8)
+            out[bit / 8 + b / 8] |= (unsigned char)(v >> b);
+    }
+    return bytes;
+}
+
+// Load the n values with width bits each stored at in. Every value is
+// extracted with its own 8-byte load, shift and mask, independent of the
+// others, so the loop has no carried dependency and the compiler can
+// unroll and vectorize it. in must be readable for 8 bytes past the end
+// of the packed values. Return the # bytes read.
+static int unpackBits(const char* in, uint64_t* values, int n, int width)
+{
+    uint64_t mask = (1ULL << width) - 1;
+    for (int i = 0; i < n; i++) {
+        uint64_t bit = (uint64_t)i * width;
+        uint64_t word;
+        memcpy(&word, in + bit / 8, sizeof(word));
+        values[i] = (word >> (bit % 8)) & mask;
+    }
+    return (int)(((int64_t)n * width + 7) / 8);
+}
+
+/*
+ * Encode the node into page, or only compute its size if page is NULL.
+ * The entries of a key are stored as a posting list: the key once, the
+ * # entries, and for every entry its RecordId as the difference from the
+ * previous one (see below) followed by its value. A posting list moved to
+ * overflow pages is stored as the key, 0 and the first overflow page.
+ * @param page[OUT] the page to write to, or NULL
+ * @param prefix[IN] the # leading key bytes shared by all keys
+ * @param costs[OUT] if not NULL, the # bytes taken by every entry
+ * @return the # bytes of the encoded page
+ */
+template<class K>
+int BasicBTLeafNode<K>::encode(char* page, int prefix, std::vector<int>* costs) {
+    int pos = 0;
+    if (page) {
+        memcpy(page + pos, &isLeaf, sizeof(int));
+        memcpy(page + pos + sizeof(int), &length, sizeof(int));
+    }
+    pos += 2 * sizeof(int);
+    if (K::PREFIXED && length > 0) {
+        KeyType shared = K::prefix(keys.front(), prefix);
+        if (page)
+            K::write(page + pos, shared);
+        pos += K::size(shared);
+    }
+    if (format == PACKED)
+        return encodePacked(page, pos, prefix, costs);
+    if (costs)
+        costs->assign(length, 0);
+    for (int i = 0; i < length; ) {
+        int start = pos;
+        if (page)
+            K::write(page + pos, keys[i], prefix);
+        pos += K::size(keys[i], prefix);
+        if (records[i].sid == OVERFLOW_SID) {
+            pos += putVarint(page, pos, 0);
+            if (page)
+                memcpy(page + pos, &records[i].pid, sizeof(PageId));
+            pos += sizeof(PageId);
+            if (costs)
+                (*costs)[i] = pos - start;
+            i++;
+            continue;
+        }
+        int end = i + 1;
+        while (end < length && keys[end] == keys[i] && records[end].sid != OVERFLOW_SID)
+            end++;
+        pos += putVarint(page, pos, end - i);
+        // RecordIds are increasing within a posting list. The pid is
+        // stored as the difference from the previous pid, and so is the
+        // sid when both are on the same page.
+        RecordId prev;
+        prev.pid = prev.sid = 0;
+        for (; i < end; i++) {
+            unsigned pidDelta = records[i].pid - prev.pid;
+            pos += putVarint(page, pos, pidDelta);
+            pos += putVarint(page, pos, pidDelta ? records[i].sid : records[i].sid - prev.sid);
+            prev = records[i];
+            if (valueWidth > 0) {
+                // Values are NUL padded to valueWidth bytes
+                if (page)
+                    memcpy(page + pos, values[i].data(), std::min((int)values[i].size(), valueWidth));
+                pos += valueWidth;
+            }
+            if (costs)
+                (*costs)[i] = pos - start;
+            start = pos;
+        }
+    }
+    if (page)
+        memcpy(page + pos, &nextLeaf, sizeof(PageId));
+    pos += sizeof(PageId);
+    return pos;
+}
+
+/*
+ * Encode the entries of the node in the packed format at page + pos, or
+ * only compute their size if page is NULL. The keys, pids and sids of
+ * the entries are stored as three arrays:
+ *   keys: the width byte, then for integral keys the first key (8 bytes)
+ *         and the differences from the previous key, bit-packed; other
+ *         keys (or differences too wide to pack) as runs of equal keys,
+ *         each stored as the key and the # entries with it
+ *   pids: the smallest pid (frame of reference), the width byte and the
+ *         bit-packed differences from it
+ *   sids: the width byte and the bit-packed sids plus one (so that
+ *         OVERFLOW_SID is 0)
+ * followed by the values and nextLeaf.
+ * @param page[OUT] the page to write to, or NULL
+ * @param pos[IN] the page offset of the entries
+ * @param prefix[IN] the # leading key bytes shared by all keys
+ * @param costs[OUT] if not NULL, the # bytes taken by every entry
+ * @return the # bytes of the encoded page
+ */
+template<class K>
+int BasicBTLeafNode<K>::encodePacked(char* page, int pos, int prefix, std::vector<int>* costs) {
+    std::vector<uint64_t> packed(length + 1);
+
+    int keyWidth = RAW_KEYS;
+    if (K::INTEGRAL && length > 0) {
+        // Keys are sorted, so the differences are not negative
+        uint64_t bits = 0;
+        for (int i = 1; i < length; i++) {
+            packed[i - 1] = (uint64_t)K::toInt(keys[i]) - (uint64_t)K::toInt(keys[i - 1]);
+            bits |= packed[i - 1];
+        }
+        if (bitWidth(bits) <= MAX_PACKED_BITS)
+            keyWidth = bitWidth(bits);
+    }
+    if (page)
+        page[pos] = (char)keyWidth;
+    pos++;
+    if (keyWidth != RAW_KEYS) {
+        int64_t first = K::toInt(keys[0]);
+        if (page)
+            memcpy(page + pos, &first, sizeof(int64_t));
+        pos += sizeof(int64_t);
+        pos += packBits(page ? page + pos : NULL, &packed[0], length - 1, keyWidth);
+    } else {
+        // Every run of equal keys is stored as the key and the run length
+        for (int i = 0, end; i < length; i = end) {
+            for (end = i + 1; end < length && keys[end] == keys[i]; end++)
+                ;
+            if (page)
+                K::write(page + pos, keys[i], prefix);
+            pos += K::size(keys[i], prefix);
+            pos += putVarint(page, pos, end - i);
+        }
+    }
+
+    PageId minPid = 0;
+    for (int i = 0; i < length; i++)
+        if (i == 0 || records[i].pid < minPid)
+            minPid = records[i].pid;
+    uint64_t bits = 0;
+    for (int i = 0; i < length; i++) {
+        packed[i] = (uint32_t)(records[i].pid - minPid);
+        bits |= packed[i];
+    }
+    int pidWidth = bitWidth(bits);
+    if (page) {
+        memcpy(page + pos, &minPid, sizeof(PageId));
+        page[pos + sizeof(PageId)] = (char)pidWidth;
+    }
+    pos += sizeof(PageId) + 1;
+    pos += packBits(page ? page + pos : NULL, &packed[0], length, pidWidth);
+
+    bits = 0;
+    for (int i = 0; i < length; i++) {
+        packed[i] = (uint32_t)(records[i].sid + 1);
+        bits |= packed[i];
+    }
+    int sidWidth = bitWidth(bits);
+    if (page)
+        page[pos] = (char)sidWidth;
+    pos++;
+    pos += packBits(page ? page + pos : NULL, &packed[0], length, sidWidth);
+
+    if (valueWidth > 0) {
+        for (int i = 0; i < length; i++) {
+            if (page)
+                memcpy(page + pos, values[i].data(), std::min((int)values[i].size(), valueWidth));
+            pos += valueWidth;
+        }
+    }
+    if (page)
+        memcpy(page + pos, &nextLeaf, sizeof(PageId));
+    pos += sizeof(PageId);
+
+    if (costs) {
+        int bitsPerEntry = pidWidth + sidWidth + (keyWidth != RAW_KEYS ? keyWidth : 0);
+        costs->assign(length, (bitsPerEntry + 7) / 8 + valueWidth);
+        if (keyWidth == RAW_KEYS)
+            for (int i = 0; i < length; i++)
+                if (i == 0 || !(keys[i - 1] == keys[i]))
+                    (*costs)[i] += K::size(keys[i], prefix) + 1;
+    }
+    return pos;
+}
+
+// Rank of a split before the eid entry with the given separator; lower is better
+template<class K>
+int BasicBTLeafNode<K>::splitRank(int eid, const KeyType& separator) {
+    return 2 * K::size(separator) + (keys[eid - 1] == keys[eid] ? 1 : 0);
+}
+
+template<class K>
+bool BasicBTLeafNode<K>::hasRoom(const KeyType& key, const RecordId& rid) {
+    // Try the insert; the encoded size depends on the neighbours
+    int index;
+    insertWithoutCheck(key, rid, std::string(), index);
+    bool fits = encode(NULL, prefixLength(), NULL) <= PageFile::PAGE_SIZE;
+    removeEntries(index, 1);
+    return fits;
 }
 
-PageId BTLeafNode::getPageId() {
+template<class K>
+PageId BasicBTLeafNode<K>::getPageId() {
     return id;
 }
 
-PageId BTLeafNode::getNextLeaf() {
+template<class K>
+PageId BasicBTLeafNode<K>::getNextLeaf() {
     return nextLeaf;
 }
 
-void BTLeafNode::print(std::string offset) {
+template<class K>
+void BasicBTLeafNode<K>::print(std::string offset) {
     std::cout << offset << "Id: " << id;
     std::cout << "\tisLeaf: " << isLeaf;
     std::cout << "\tlength: " << length << std::endl;
     std::cout << offset << "Records/keys: " << std::endl;
-    std::list<RecordId>::iterator recIt = records.begin();
-    std::list<int>::iterator keyIt = keys.begin();
     for (int i = 0; i < length; i++) {
-        std::cout << offset << "(" << recIt->pid << "," << recIt->sid << ") ";
-        std::cout << *keyIt << std::endl;
-        recIt++;
-        keyIt++;
+        std::cout << offset << "(" << records[i].pid << "," << records[i].sid << ") ";
+        std::cout << keys[i];
+        if (valueWidth > 0)
+            std::cout << " '" << values[i] << "'";
+        std::cout << std::endl;
     }
     std::cout << offset << "nextLeaf: " << nextLeaf << std::endl;
 }
@@ -57,7 +363,8 @@ void BTLeafNode::print(std::string offset) {
  * @param pf[IN] PageFile to read from
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::read(PageId pid, const PageFile& pf)
+template<class K>
+RC BasicBTLeafNode<K>::read(PageId pid, const PageFile& pf)
 {
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
     RC errorCode = pf.read(pid, buffer);
@@ -69,19 +376,119 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
     bufferIndex += sizeof(int);
     memcpy(&length, buffer + bufferIndex, sizeof(int));
     bufferIndex += sizeof(int);
-    for (int i = 0; i < length; i++) {
-        RecordId nextRecord;
-        memcpy(&nextRecord, buffer + bufferIndex, sizeof(RecordId));
-        bufferIndex += sizeof(RecordId);
-        records.push_back(nextRecord);
-        int nextKey;
-        memcpy(&nextKey, buffer + bufferIndex, sizeof(int));
-        bufferIndex += sizeof(int);
-        keys.push_back(nextKey);
+    records.clear();
+    keys.clear();
+    values.clear();
+    KeyType shared = KeyType();
+    int prefix = 0;
+    if (K::PREFIXED && length > 0) {
+        bufferIndex += K::read(buffer + bufferIndex, shared);
+        prefix = K::commonPrefix(shared, shared);
     }
+    if (format == PACKED)
+        bufferIndex = decodePacked(bufferIndex, shared, prefix);
+    else
+        bufferIndex = decodePostingLists(bufferIndex, shared, prefix);
     memcpy(&nextLeaf, buffer + bufferIndex, sizeof(PageId));
     return 0;
 }
+
+// Decode the posting lists stored at buffer + pos (see encode()).
+// Return the offset of the trailing PageId
+template<class K>
+int BasicBTLeafNode<K>::decodePostingLists(int pos, const KeyType& shared, int prefix)
+{
+    while ((int)keys.size() < length) {
+        KeyType nextKey = shared;
+        pos += K::read(buffer + pos, nextKey, prefix);
+        unsigned count;
+        pos += getVarint(buffer, pos, count);
+        if (count == 0) {
+            RecordId overflow;
+            memcpy(&overflow.pid, buffer + pos, sizeof(PageId));
+            pos += sizeof(PageId);
+            overflow.sid = OVERFLOW_SID;
+            keys.push_back(nextKey);
+            records.push_back(overflow);
+            if (valueWidth > 0)
+                values.push_back(std::string());
+            continue;
+        }
+        RecordId prev;
+        prev.pid = prev.sid = 0;
+        for (unsigned i = 0; i < count; i++) {
+            unsigned pidDelta, sid;
+            pos += getVarint(buffer, pos, pidDelta);
+            pos += getVarint(buffer, pos, sid);
+            RecordId nextRecord;
+            nextRecord.pid = prev.pid + pidDelta;
+            nextRecord.sid = pidDelta ? sid : prev.sid + sid;
+            prev = nextRecord;
+            keys.push_back(nextKey);
+            records.push_back(nextRecord);
+            if (valueWidth > 0) {
+                const char* value = buffer + pos;
+                values.push_back(std::string(value, strnlen(value, valueWidth)));
+                pos += valueWidth;
+            }
+        }
+    }
+    return pos;
+}
+
+// Decode the packed entries stored at buffer + pos (see encodePacked()).
+// Every array is unpacked in one pass over the whole page, so that
+// readEntry() stays an array access.
+// Return the offset of the trailing PageId
+template<class K>
+int BasicBTLeafNode<K>::decodePacked(int pos, const KeyType& shared, int prefix)
+{
+    std::vector<uint64_t> unpacked(length + 1);
+
+    int keyWidth = (unsigned char)buffer[pos++];
+    if (keyWidth != RAW_KEYS) {
+        int64_t key;
+        memcpy(&key, buffer + pos, sizeof(int64_t));
+        pos += sizeof(int64_t);
+        pos += unpackBits(buffer + pos, &unpacked[0], length - 1, keyWidth);
+        keys.resize(length);
+        keys[0] = K::fromInt(key);
+        for (int i = 1; i < length; i++) {
+            key = (int64_t)((uint64_t)key + unpacked[i - 1]);
+            keys[i] = K::fromInt(key);
+        }
+    } else {
+        while ((int)keys.size() < length) {
+            KeyType nextKey = shared;
+            pos += K::read(buffer + pos, nextKey, prefix);
+            unsigned count;
+            pos += getVarint(buffer, pos, count);
+            keys.insert(keys.end(), count, nextKey);
+        }
+    }
+
+    records.resize(length);
+    PageId minPid;
+    memcpy(&minPid, buffer + pos, sizeof(PageId));
+    pos += sizeof(PageId);
+    int pidWidth = (unsigned char)buffer[pos++];
+    pos += unpackBits(buffer + pos, &unpacked[0], length, pidWidth);
+    for (int i = 0; i < length; i++)
+        records[i].pid = minPid + (PageId)unpacked[i];
+    int sidWidth = (unsigned char)buffer[pos++];
+    pos += unpackBits(buffer + pos, &unpacked[0], length, sidWidth);
+    for (int i = 0; i < length; i++)
+        records[i].sid = (int)unpacked[i] - 1;
+
+    if (valueWidth > 0) {
+        for (int i = 0; i < length; i++) {
+            const char* value = buffer + pos;
+            values.push_back(std::string(value, strnlen(value, valueWidth)));
+            pos += valueWidth;
+        }
+    }
+    return pos;
+}
     
 /*
  * Write the content of the node to the page pid in the PageFile pf.
@@ -89,26 +496,11 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
  * @param pf[IN] PageFile to write to
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::write(PageId pid, PageFile& pf)
+template<class K>
+RC BasicBTLeafNode<K>::write(PageId pid, PageFile& pf)
 {
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
-    int bufferIndex = 0;
-    memcpy(buffer + bufferIndex, &isLeaf, sizeof(int));
-    bufferIndex += sizeof(int);
-    memcpy(buffer + bufferIndex, &length, sizeof(int));
-    bufferIndex += sizeof(int);
-    std::list<RecordId>::iterator recIt = records.begin();
-    std::list<int>::iterator keyIt = keys.begin();
-    for (int i = 0; i < length; i++) {
-        memcpy(buffer + bufferIndex, &*recIt, sizeof(RecordId));
-        bufferIndex += sizeof(RecordId);
-        memcpy(buffer + bufferIndex, &*keyIt, sizeof(int));
-        bufferIndex += sizeof(int);
-        recIt++;
-        keyIt++;
-    }
-    memcpy(buffer + bufferIndex, &nextLeaf, sizeof(PageId));
-    bufferIndex += sizeof(PageId);
+    encode(buffer, prefixLength(), NULL);
     RC errorCode = pf.write(pid, buffer);
     if (errorCode < 0)
         reportErrorExit(errorCode);
@@ -119,57 +511,85 @@ RC BTLeafNode::write(PageId pid, PageFile& pf)
  * Return the number of keys stored in the node.
  * @return the number of keys in the node
  */
-int BTLeafNode::getKeyCount()
+template<class K>
+int BasicBTLeafNode<K>::getKeyCount()
 {
     return length;
 }
 
-RC BTLeafNode::insertWithoutCheck(int key, const RecordId& rid)
+template<class K>
+RC BasicBTLeafNode<K>::insertWithoutCheck(const KeyType& key, const RecordId& rid, const std::string& value, int& index)
 {
-    int index = 0;
-    std::list<int>::iterator it;
-    for(it = keys.begin(); it != keys.end(); it++) {
-        if (*it < key) {
-            index++;
-        }
-        else
-            break;
-    }
-    keys.insert(it, key);
-    std::list<RecordId>::iterator recIt = records.begin();
-    for (int i = 0; i < index; i++) {
-        recIt++;
-    }
-    RecordId newRec;
-    newRec.pid = rid.pid;
-    newRec.sid = rid.sid;
-    records.insert(recIt, newRec);
+    // The new entry goes after the smaller keys, and in RecordId order
+    // among the entries with the same key
+    index = K::lowerBound(keys, key);
+    while (index < length && keys[index] == key && records[index] < rid)
+        index++;
+    keys.insert(keys.begin() + index, key);
+    records.insert(records.begin() + index, rid);
+    if (valueWidth > 0)
+        values.insert(values.begin() + index, value.substr(0, valueWidth));
     length++;
     return 0;
 }
 
+/*
+ * Remove count entries starting from the eid entry.
+ * @param eid[IN] the first entry to remove
+ * @param count[IN] the # entries to remove
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template<class K>
+RC BasicBTLeafNode<K>::removeEntries(int eid, int count)
+{
+    if (eid < 0 || count < 0 || eid + count > length)
+        return RC_NO_SUCH_RECORD;
+    keys.erase(keys.begin() + eid, keys.begin() + eid + count);
+    records.erase(records.begin() + eid, records.begin() + eid + count);
+    if (valueWidth > 0)
+        values.erase(values.begin() + eid, values.begin() + eid + count);
+    length -= count;
+    return 0;
+}
+
 /*
  * Insert a (key, rid) pair to the node.
  * @param key[IN] the key to insert
  * @param rid[IN] the RecordId to insert
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTLeafNode::insert(int key, const RecordId& rid)
+template<class K>
+RC BasicBTLeafNode<K>::insert(const KeyType& key, const RecordId& rid)
 {
-    if (length >= MAX_KEYS)
+    return insert(key, rid, std::string());
+}
+
+/*
+ * Insert the (key, rid, value) entry to the node.
+ * @param key[IN] the key to insert
+ * @param rid[IN] the RecordId to insert
+ * @param value[IN] the record value to store with the entry
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+template<class K>
+RC BasicBTLeafNode<K>::insert(const KeyType& key, const RecordId& rid, const std::string& value)
+{
+    int index;
+    insertWithoutCheck(key, rid, value, index);
+    if (encode(NULL, prefixLength(), NULL) > PageFile::PAGE_SIZE) {
+        removeEntries(index, 1);
         return RC_NODE_FULL;
-    else {
-        return insertWithoutCheck(key, rid);
     }
+    return 0;
 }
 
-RC BTLeafNode::insert_end(int key, const RecordId& rid)
+template<class K>
+RC BasicBTLeafNode<K>::insert_end(const KeyType& key, const RecordId& rid, const std::string& value)
 {
-    RecordId newRec;
-    newRec.pid = rid.pid;
-    newRec.sid = rid.sid;
-    records.push_back(newRec);
+    records.push_back(rid);
     keys.push_back(key);
+    if (valueWidth > 0)
+        values.push_back(value.substr(0, valueWidth));
     length++;
     return 0;
 }
@@ -177,42 +597,74 @@ RC BTLeafNode::insert_end(int key, const RecordId& rid)
 /*
  * Insert the (key, rid) pair to the node
  * and split the node half and half with sibling.
- * The first key of the sibling node is returned in siblingKey.
+ * The key to insert in the parent node is returned in siblingKey.
  * @param key[IN] the key to insert.
  * @param rid[IN] the RecordId to insert.
  * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
- * @param siblingKey[OUT] the first key in the sibling node after split.
+ * @param siblingKey[OUT] the shortest key that is larger than the last key
+ *                        in this node and not larger than the first key in
+ *                        the sibling node after split.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::insertAndSplit(int key, const RecordId& rid, 
-                              BTLeafNode& sibling, int& siblingKey)
+template<class K>
+RC BasicBTLeafNode<K>::insertAndSplit(const KeyType& key, const RecordId& rid, 
+                                      BasicBTLeafNode& sibling, KeyType& siblingKey)
+{
+    return insertAndSplit(key, rid, std::string(), sibling, siblingKey);
+}
+
+template<class K>
+RC BasicBTLeafNode<K>::insertAndSplit(const KeyType& key, const RecordId& rid, const std::string& value,
+                                      BasicBTLeafNode& sibling, KeyType& siblingKey)
 {
     // Note: sibling must have been properly initialized by the caller, with only its lists missing
-    if (length < MAX_KEYS)
+    if (hasRoom(key, rid))
         return RC_INVALID_RID;
     // The key and rid are first properly inserted into the lists to preserve ordering, before splitting between this node and sibling
-    insertWithoutCheck(key, rid);
-    int half = ceil(MAX_KEYS/2.0);
-    std::list<int>::iterator keyIt = keys.begin();
-    std::list<RecordId>::iterator recIt = records.begin();
-    for (int i = 0; i < half; i++) {
-        keyIt++;
-        recIt++;
-    }
-    while (keyIt != keys.end()) {
-        RC errorCode = sibling.insert_end(*keyIt, *recIt);
+    int index;
+    insertWithoutCheck(key, rid, value, index);
+    // Entries differ in size, so they are split by bytes rather than by
+    // count. Each node keeps at least one entry.
+    std::vector<int> costs;
+    std::vector<int> kept(length, 0);  // # bytes of the entries before i
+    encode(NULL, prefixLength(), &costs);
+    for (int i = 1; i < length; i++)
+        kept[i] = kept[i - 1] + costs[i - 1];
+    int half = (kept[length - 1] + costs[length - 1]) / 2;
+    int mid = 1;
+    while (mid < length - 1 && kept[mid] + costs[mid] <= half)
+        mid++;
+    // Suffix truncation: among the split points near the middle, take the
+    // one with the shortest separator, to keep the parent's fanout high.
+    // Splits between two distinct keys are preferred, as they do not cut
+    // a posting list in two
+    int split = mid;
+    siblingKey = K::separator(keys[mid - 1], keys[mid]);
+    int bestRank = splitRank(mid, siblingKey);
+    for (int i = 1; i < length; i++) {
+        if (abs(kept[i] - kept[mid]) > SPLIT_SLACK)
+            continue;
+        KeyType separator = K::separator(keys[i - 1], keys[i]);
+        int rank = splitRank(i, separator);
+        if (rank < bestRank || (rank == bestRank && abs(i - mid) < abs(split - mid))) {
+            split = i;
+            siblingKey = separator;
+            bestRank = rank;
+        }
+    }
+    for (int i = split; i < length; i++) {
+        RC errorCode = sibling.insert_end(keys[i], records[i],
+                                          valueWidth > 0 ? values[i] : std::string());
         if (errorCode < 0)
             return errorCode;
-        keyIt = keys.erase(keyIt);
-        recIt = records.erase(recIt);
-        length--;
     }
-    RecordId sibRec;
+    keys.resize(split);
+    records.resize(split);
+    if (valueWidth > 0)
+        values.resize(split);
+    length = split;
     sibling.setNextNodePtr(nextLeaf);
     nextLeaf = sibling.getPageId();
-    RC errorCode = sibling.readEntry(0, siblingKey, sibRec);
-    if (errorCode < 0)
-        return errorCode;
     return 0;
 }
 
@@ -227,27 +679,14 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
                    behind the largest key smaller than searchKey.
  * @return 0 if searchKey is found. Otherwise return an error code.
  */
-RC BTLeafNode::locate(int searchKey, int& eid)
+template<class K>
+RC BasicBTLeafNode<K>::locate(const KeyType& searchKey, int& eid)
 {
-    std::list<int>::iterator it = keys.begin();
-    eid = 0;
-    // If first entry is smaller search key cannot be found as key is increasing
-    if (searchKey < *it) {
-        return RC_NO_SUCH_RECORD;
-    }
-    // Loop continues while search key > last key checked
-    for (; it != keys.end(); it++) {
-        if (searchKey == *it)
-            return 0;
-        // If search key is less than current entry, cannot be found
-        // eid has not been incremented and holds index of largest key smaller
-        else if (searchKey < *it) {
-            return RC_NO_SUCH_RECORD;
-        }
-        eid++;
-    }
-    eid--; // Undo last eid increment to meet eid value requirements
-    return RC_NO_SUCH_RECORD;
+    // Find the first key that is not smaller than search key; as keys are
+    // increasing, search key is either there or not in the node.
+    // If every key is smaller, eid is one past the last entry
+    eid = K::lowerBound(keys, searchKey);
+    return (eid < length && keys[eid] == searchKey) ? 0 : RC_NO_SUCH_RECORD;
 }
 
 /*
@@ -257,20 +696,35 @@ RC BTLeafNode::locate(int searchKey, int& eid)
  * @param rid[OUT] the RecordId from the entry
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
+template<class K>
+RC BasicBTLeafNode<K>::readEntry(int eid, KeyType& key, RecordId& rid)
 {
     // Note: node entries are indexed starting from zero, length starts from 1
     if (eid >= length || eid < 0)
         return RC_NO_SUCH_RECORD;
     
-    std::list<int>::iterator keyIt = keys.begin();
-    std::list<RecordId>::iterator recIt = records.begin();
-    for (int i = 0; i < eid; i++) {
-        keyIt++;
-        recIt++;
-    }
-    key = *keyIt;
-    rid = *recIt;
+    key = keys[eid];
+    rid = records[eid];
+    return 0;
+}
+
+/*
+ * Read the (key, rid, value) entry from the eid entry.
+ * @param eid[IN] the entry number to read the entry from
+ * @param key[OUT] the key from the entry
+ * @param rid[OUT] the RecordId from the entry
+ * @param value[OUT] the stored (prefix of the) record value
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+template<class K>
+RC BasicBTLeafNode<K>::readEntry(int eid, KeyType& key, RecordId& rid, std::string& value)
+{
+    RC errorCode = readEntry(eid, key, rid);
+    if (errorCode < 0)
+        return errorCode;
+    value.erase();
+    if (valueWidth > 0)
+        value = values[eid];
     return 0;
 }
 
@@ -278,7 +732,8 @@ RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
  * Return the pid of the next slibling node.
  * @return the PageId of the next sibling node 
  */
-PageId BTLeafNode::getNextNodePtr()
+template<class K>
+PageId BasicBTLeafNode<K>::getNextNodePtr()
 {
     return nextLeaf;
 }
@@ -288,50 +743,88 @@ PageId BTLeafNode::getNextNodePtr()
  * @param pid[IN] the PageId of the next sibling node 
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTLeafNode::setNextNodePtr(PageId pid)
+template<class K>
+RC BasicBTLeafNode<K>::setNextNodePtr(PageId pid)
 {
     nextLeaf = pid;
     return 0;
 }
 
-BTNonLeafNode::BTNonLeafNode(PageId id) {
+template<class K>
+BasicBTNonLeafNode<K>::BasicBTNonLeafNode(PageId id, int bufferBytes) {
     isLeaf = 0;
     length = 0;
     this->id = id;
+    this->bufferBytes = bufferBytes;
+    messageBytes = 0;
+}
+
+// Page layout: isLeaf, length, (pid, key) entries, lastId. The last
+// bufferBytes bytes of the page hold the message count and the messages,
+// each stored as the key, the RecordId, a one-byte length and the value
+template<class K>
+int BasicBTNonLeafNode<K>::entrySize(const KeyType& key) {
+    return sizeof(PageId) + K::size(key);
 }
 
-PageId BTNonLeafNode::getPageId() {
+template<class K>
+int BasicBTNonLeafNode<K>::pageBytes() {
+    int bytes = NODE_OVERHEAD;
+    for (int i = 0; i < length; i++)
+        bytes += entrySize(keys[i]);
+    return bytes;
+}
+
+template<class K>
+bool BasicBTNonLeafNode<K>::hasRoom(const KeyType& key) {
+    const int capacity = PageFile::PAGE_SIZE - bufferBytes;
+    if (K::FIXED_SIZE > 0) {
+        // # entries that fit in the page, without a sum over the keys
+        const int fit = (capacity - NODE_OVERHEAD) / (sizeof(PageId) + K::FIXED_SIZE);
+        return length < (fit < MAX_KEYS ? fit : MAX_KEYS);
+    }
+    return length < MAX_KEYS && pageBytes() + entrySize(key) <= capacity;
+}
+
+template<class K>
+bool BasicBTNonLeafNode<K>::isOverfull() {
+    return length > MAX_KEYS || pageBytes() > PageFile::PAGE_SIZE - bufferBytes;
+}
+
+template<class K>
+int BasicBTNonLeafNode<K>::messageSize(const Message& message) {
+    return K::size(message.key) + sizeof(RecordId) + 1 + message.value.size();
+}
+
+template<class K>
+PageId BasicBTNonLeafNode<K>::getPageId() {
     return id;
 }
 
-void BTNonLeafNode::setLastId(PageId last) {
+template<class K>
+void BasicBTNonLeafNode<K>::setLastId(PageId last) {
     lastId = last;
 }
 
-PageId BTNonLeafNode::getLastId() {
+template<class K>
+PageId BasicBTNonLeafNode<K>::getLastId() {
     return lastId;
 }
 
-PageId BTNonLeafNode::readEntry(int eid) {
-    int i = 0;
-    for (std::list<PageId>::iterator it = pages.begin(); it != pages.end(); it++) {
-        if (i == eid)
-            return *it;
-        i++;
-	}
+template<class K>
+PageId BasicBTNonLeafNode<K>::readEntry(int eid) {
+    // eid == length is the last child
+    return (eid < length) ? pages[eid] : lastId;
 }
 
-void BTNonLeafNode::print(std::string offset) {
+template<class K>
+void BasicBTNonLeafNode<K>::print(std::string offset) {
     std::cout << offset << "Id: " << id;
     std::cout << "\tisLeaf: " << isLeaf;
     std::cout << "\tlength: "<< length << std::endl;
     std::cout << offset << "Pages/keys: " << std::endl;
-    std::list<PageId>::iterator pageIt = pages.begin();
-    std::list<int>::iterator keyIt = keys.begin();
     for (int i = 0; i < length; i++) {
-        std::cout << offset << *pageIt << " " << *keyIt << std::endl;
-        pageIt++;
-        keyIt++;
+        std::cout << offset << pages[i] << " " << keys[i] << std::endl;
     }
     std::cout << offset << "lastId: " << lastId << std::endl;
 }
@@ -342,7 +835,8 @@ void BTNonLeafNode::print(std::string offset) {
  * @param pf[IN] PageFile to read from
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
+template<class K>
+RC BasicBTNonLeafNode<K>::read(PageId pid, const PageFile& pf)
 {
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
     RC errorCode = pf.read(pid, buffer);
@@ -354,18 +848,38 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
     bufferIndex += sizeof(int);
     memcpy(&length, buffer + bufferIndex, sizeof(int));
     bufferIndex += sizeof(int);
+    pages.clear();
+    keys.clear();
     for (int i = 0; i < length; i++) {
         PageId nextPage;
         memcpy(&nextPage, buffer + bufferIndex, sizeof(PageId));
         bufferIndex += sizeof(PageId);
         pages.push_back(nextPage);
-        int nextKey;
-        memcpy(&nextKey, buffer + bufferIndex, sizeof(int));
-        bufferIndex += sizeof(int);
+        KeyType nextKey;
+        bufferIndex += K::read(buffer + bufferIndex, nextKey);
         keys.push_back(nextKey);
     }
     memcpy(&lastId, buffer + bufferIndex, sizeof(PageId));
     bufferIndex += sizeof(PageId);
+
+    messages.clear();
+    messageBytes = 0;
+    if (bufferBytes > 0) {
+        int count;
+        bufferIndex = PageFile::PAGE_SIZE - bufferBytes;
+        memcpy(&count, buffer + bufferIndex, sizeof(int));
+        bufferIndex += sizeof(int);
+        for (int i = 0; i < count; i++) {
+            Message message;
+            bufferIndex += K::read(buffer + bufferIndex, message.key);
+            memcpy(&message.rid, buffer + bufferIndex, sizeof(RecordId));
+            bufferIndex += sizeof(RecordId);
+            int valueLength = (unsigned char)buffer[bufferIndex++];
+            message.value.assign(buffer + bufferIndex, valueLength);
+            bufferIndex += valueLength;
+            addMessage(message);
+        }
+    }
     return 0;
 }
     
@@ -375,7 +889,8 @@ RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
  * @param pf[IN] PageFile to write to
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::write(PageId pid, PageFile& pf)
+template<class K>
+RC BasicBTNonLeafNode<K>::write(PageId pid, PageFile& pf)
 {
     memset(buffer, 0, sizeof(char) * PageFile::PAGE_SIZE);
     int bufferIndex = 0;
@@ -383,18 +898,30 @@ RC BTNonLeafNode::write(PageId pid, PageFile& pf)
     bufferIndex += sizeof(int);
     memcpy(buffer + bufferIndex, &length, sizeof(int));
     bufferIndex += sizeof(int);
-    std::list<PageId>::iterator pageIt = pages.begin();
-    std::list<int>::iterator keyIt = keys.begin();
     for (int i = 0; i < length; i++) {
-        memcpy(buffer + bufferIndex, &*pageIt, sizeof(PageId));
+        memcpy(buffer + bufferIndex, &pages[i], sizeof(PageId));
         bufferIndex += sizeof(PageId);
-        memcpy(buffer + bufferIndex, &*keyIt, sizeof(int));
-        bufferIndex += sizeof(int);
-        pageIt++;
-        keyIt++;
+        K::write(buffer + bufferIndex, keys[i]);
+        bufferIndex += K::size(keys[i]);
     }
     memcpy(buffer + bufferIndex, &lastId, sizeof(PageId));
     bufferIndex += sizeof(PageId);
+    if (bufferBytes > 0) {
+        int count = messages.size();
+        bufferIndex = PageFile::PAGE_SIZE - bufferBytes;
+        memcpy(buffer + bufferIndex, &count, sizeof(int));
+        bufferIndex += sizeof(int);
+        for (int i = 0; i < count; i++) {
+            const Message& message = messages[i];
+            K::write(buffer + bufferIndex, message.key);
+            bufferIndex += K::size(message.key);
+            memcpy(buffer + bufferIndex, &message.rid, sizeof(RecordId));
+            bufferIndex += sizeof(RecordId);
+            buffer[bufferIndex++] = (unsigned char)message.value.size();
+            memcpy(buffer + bufferIndex, message.value.data(), message.value.size());
+            bufferIndex += message.value.size();
+        }
+    }
     RC errorCode = pf.write(pid, buffer);
     if (errorCode < 0)
         reportErrorExit(errorCode);
@@ -405,37 +932,27 @@ RC BTNonLeafNode::write(PageId pid, PageFile& pf)
  * Return the number of keys stored in the node.
  * @return the number of keys in the node
  */
-int BTNonLeafNode::getKeyCount()
+template<class K>
+int BasicBTNonLeafNode<K>::getKeyCount()
 { 
     return length;
 }
 
-RC BTNonLeafNode::insertWithoutCheck(int key, PageId pid)
+template<class K>
+RC BasicBTNonLeafNode<K>::insertWithoutCheck(const KeyType& key, PageId pid)
 {
-    int index = 0;
-    std::list<int>::iterator it;
-    for (it = keys.begin(); it != keys.end(); it++) {
-        if (*it < key) {
-        index++;
-        }
-        else
-            break;
-    }
+    int index = K::lowerBound(keys, key);
     // Special case; change lastId
-    if (it == keys.end()) {
+    if (index == length) {
         keys.push_back(key);
         pages.push_back(lastId);
         lastId = pid;
         length++;
 	    return 0;
     }
-    keys.insert(it, key);
-    std::list<PageId>::iterator pageIt = pages.begin();
-    for (int i = 0; i < index; i++) {
-        pageIt++;
-    }
-    pageIt++; // Page Ids inserted with key are inserted at index 1 higher
-    pages.insert(pageIt, pid);
+    keys.insert(keys.begin() + index, key);
+    // Page Ids inserted with key are inserted at index 1 higher
+    pages.insert(pages.begin() + index + 1, pid);
     length++;
     return 0;
 }
@@ -446,16 +963,18 @@ RC BTNonLeafNode::insertWithoutCheck(int key, PageId pid)
  * @param pid[IN] the PageId to insert
  * @return 0 if successful. Return an error code if the node is full.
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+template<class K>
+RC BasicBTNonLeafNode<K>::insert(const KeyType& key, PageId pid)
 {
-    if (length >= MAX_KEYS)
+    if (!hasRoom(key))
         return RC_NODE_FULL;
     else {
         return insertWithoutCheck(key, pid);
     }
 }
 
-RC BTNonLeafNode::insert_end(int key, PageId pid)
+template<class K>
+RC BasicBTNonLeafNode<K>::insert_end(const KeyType& key, PageId pid)
 {
     pages.push_back(pid);
     keys.push_back(key);
@@ -473,35 +992,78 @@ RC BTNonLeafNode::insert_end(int key, PageId pid)
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+template<class K>
+RC BasicBTNonLeafNode<K>::insertAndSplit(const KeyType& key, PageId pid, BasicBTNonLeafNode& sibling, KeyType& midKey)
 {
-    if (length < MAX_KEYS)
+    if (hasRoom(key))
         return RC_INVALID_PID;
     insertWithoutCheck(key, pid);
-    int half = ceil(MAX_KEYS/2.0);
-    std::list<PageId>::iterator pageIt = pages.begin();
-    std::list<int>::iterator keyIt = keys.begin();
-    for (int i = 0; i < half; i++) {
-        pageIt++;
-        keyIt++;
+    return split(sibling, midKey);
+}
+
+template<class K>
+RC BasicBTNonLeafNode<K>::split(BasicBTNonLeafNode& sibling, KeyType& midKey)
+{
+    if (length < 3)
+        return RC_INVALID_PID;
+    // Split by bytes, leaving at least one key on either side of midKey.
+    // The sibling gets half of the bytes, or all it can hold if less
+    const int capacity = PageFile::PAGE_SIZE - bufferBytes - NODE_OVERHEAD;
+    const int total = pageBytes() - NODE_OVERHEAD;
+    int half = max(total / 2, total - capacity);
+    int kept = 0;
+    int mid = 0;
+    for (; mid < length - 2; mid++) {
+        if (mid > 0 && kept + entrySize(keys[mid]) > half)
+            break;
+        kept += entrySize(keys[mid]);
     }
+    // Any key near the middle separates the two halves; move up the
+    // shortest one, to keep the parent's fanout high
+    int split = mid;
+    int offset = 0;  // # bytes between the entries i and mid
+    for (int i = mid - 1; i >= 1 && (offset += entrySize(keys[i])) <= SPLIT_SLACK; i--) {
+        if (K::size(keys[i]) < K::size(keys[split]))
+            split = i;
+    }
+    offset = 0;
+    for (int i = mid + 1; i <= length - 2 && (offset += entrySize(keys[i - 1])) <= SPLIT_SLACK; i++) {
+        if (K::size(keys[i]) < K::size(keys[split]) ||
+            (K::size(keys[i]) == K::size(keys[split]) && i - mid < abs(split - mid)))
+            split = i;
+    }
+    // A split left of mid must still leave a sibling that fits
+    int siblingBytes = 0;
+    for (int i = split + 1; i < length; i++)
+        siblingBytes += entrySize(keys[i]);
+    if (siblingBytes > capacity)
+        split = mid;
     // Save middle key to move up
-    midKey = *keyIt;
-    keyIt = keys.erase(keyIt);
+    midKey = keys[split];
     // Save corresponding PageId for new lastId
-    PageId midPid = *pageIt;
-    pageIt = pages.erase(pageIt);
-    length--;
-    while (keyIt != keys.end()) {
-        RC errorCode = sibling.insert_end(*keyIt, *pageIt);
+    PageId midPid = pages[split];
+    for (int i = split + 1; i < length; i++) {
+        RC errorCode = sibling.insert_end(keys[i], pages[i]);
         if (errorCode < 0)
             return errorCode;
-        keyIt = keys.erase(keyIt);
-        pageIt = pages.erase(pageIt);
-        length--;
     }
+    keys.resize(split);
+    pages.resize(split);
+    length = split;
     sibling.setLastId(lastId);
     lastId = midPid;
+    // The messages for the children moved go with them
+    std::vector<Message> staying;
+    messageBytes = 0;
+    for (unsigned i = 0; i < messages.size(); i++) {
+        if (midKey < messages[i].key) {
+            sibling.addMessage(messages[i]);
+        } else {
+            messageBytes += messageSize(messages[i]);
+            staying.push_back(messages[i]);
+        }
+    }
+    messages.swap(staying);
     return 0;
 }
 
@@ -512,20 +1074,77 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
  * @param pid[OUT] the pointer to the child node to follow.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
+template<class K>
+RC BasicBTNonLeafNode<K>::locateChildPtr(const KeyType& searchKey, PageId& pid)
 { 
-    int keyIndex = 0;
-    std::list<int>::iterator keyIt = keys.begin();
-    std::list<PageId>::iterator pageIt = pages.begin();
-    for (; keyIt != keys.end(); keyIt++) {
-        if (searchKey < *keyIt) {
-            pid = *pageIt;
-            return 0;
+    // Follow the child left of the first key that is not smaller than
+    // searchKey. A key equal to searchKey sends the search to its left
+    // child: with duplicate keys the first occurrence may be left of it
+    pid = readEntry(K::lowerBound(keys, searchKey));
+    return 0;
+}
+
+template<class K>
+int BasicBTNonLeafNode<K>::locateChildSlot(const KeyType& searchKey)
+{
+    return K::lowerBound(keys, searchKey);
+}
+
+template<class K>
+const typename K::Type& BasicBTNonLeafNode<K>::readKey(int eid)
+{
+    return keys[eid];
+}
+
+template<class K>
+void BasicBTNonLeafNode<K>::addMessage(const Message& message)
+{
+    messages.push_back(message);
+    messageBytes += messageSize(message);
+}
+
+template<class K>
+int BasicBTNonLeafNode<K>::getMessageCount()
+{
+    return messages.size();
+}
+
+template<class K>
+const typename BasicBTNonLeafNode<K>::Message& BasicBTNonLeafNode<K>::readMessage(int i)
+{
+    return messages[i];
+}
+
+template<class K>
+bool BasicBTNonLeafNode<K>::messagesFit()
+{
+    return (int)sizeof(int) + messageBytes <= bufferBytes;
+}
+
+template<class K>
+int BasicBTNonLeafNode<K>::fullestChild()
+{
+    std::vector<int> counts(length + 1, 0);
+    for (unsigned i = 0; i < messages.size(); i++)
+        counts[locateChildSlot(messages[i].key)]++;
+    return std::max_element(counts.begin(), counts.end()) - counts.begin();
+}
+
+template<class K>
+void BasicBTNonLeafNode<K>::takeMessages(int slot, std::vector<Message>& taken)
+{
+    std::vector<Message> kept;
+    taken.clear();
+    messageBytes = 0;
+    for (unsigned i = 0; i < messages.size(); i++) {
+        if (locateChildSlot(messages[i].key) == slot) {
+            taken.push_back(messages[i]);
+        } else {
+            messageBytes += messageSize(messages[i]);
+            kept.push_back(messages[i]);
         }
-        pageIt++;
     }
-    pid = lastId;
-    return 0;
+    messages.swap(kept);
 }
 
 /*
@@ -535,7 +1154,8 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
  * @param pid2[IN] the PageId to insert behind the key
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
+template<class K>
+RC BasicBTNonLeafNode<K>::initializeRoot(PageId pid1, const KeyType& key, PageId pid2)
 { 
     pages.clear();
     keys.clear();
@@ -546,3 +1166,85 @@ RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
     lastId = pid2;  
     return 0;
 }
+
+template<class K>
+BasicBTPinnedNode<K>::BasicBTPinnedNode(const BasicBTNonLeafNode<K>& node)
+{
+    int n = node.length;
+    keys.resize(n + 1);
+    children.resize(n + 1);
+    pinnedChildren.assign(n + 1, -1);
+    children[0] = node.lastId;
+    fill(node.keys, node.pages, 0, 1);
+}
+
+// Store the sorted keys from rank on in the subtree of slot, in order.
+// Return the rank of the next key to store
+template<class K>
+int BasicBTPinnedNode<K>::fill(const std::vector<KeyType>& sorted, const std::vector<PageId>& pages, int rank, int slot)
+{
+    if (slot < (int)keys.size()) {
+        rank = fill(sorted, pages, rank, 2 * slot);
+        keys[slot] = sorted[rank];
+        children[slot] = pages[rank];
+        rank = fill(sorted, pages, rank + 1, 2 * slot + 1);
+    }
+    return rank;
+}
+
+template<class K>
+int BasicBTPinnedNode<K>::locateChildSlot(const KeyType& searchKey) const
+{
+    int n = keys.size() - 1;
+    const KeyType* base = &keys[0];
+    int slot = 1;
+    while (slot <= n) {
+        // The slots two levels down are 4 * slot to 4 * slot + 3
+        __builtin_prefetch(base + std::min(4 * slot, n));
+        slot = 2 * slot + (base[slot] < searchKey);
+    }
+    // The search went left at the first key that is not smaller than
+    // searchKey, and right ever after: drop the trailing right turns and
+    // the last left turn. slot 0 means every key is smaller
+    return slot >> __builtin_ffs(~slot);
+}
+
+template<class K>
+PageId BasicBTPinnedNode<K>::getChild(int slot) const
+{
+    return children[slot];
+}
+
+template<class K>
+int BasicBTPinnedNode<K>::getPinnedChild(int slot) const
+{
+    return pinnedChildren[slot];
+}
+
+template<class K>
+void BasicBTPinnedNode<K>::setPinnedChild(int slot, int index)
+{
+    pinnedChildren[slot] = index;
+}
+
+template<class K>
+int BasicBTPinnedNode<K>::getSlotCount() const
+{
+    return keys.size();
+}
+
+template class BasicBTLeafNode<IntKey>;
+template class BasicBTNonLeafNode<IntKey>;
+template class BasicBTPinnedNode<IntKey>;
+template class BasicBTLeafNode<StringKey>;
+template class BasicBTNonLeafNode<StringKey>;
+template class BasicBTPinnedNode<StringKey>;
+template class BasicBTLeafNode<Int64Key>;
+template class BasicBTNonLeafNode<Int64Key>;
+template class BasicBTPinnedNode<Int64Key>;
+template class BasicBTLeafNode<DoubleKey>;
+template class BasicBTNonLeafNode<DoubleKey>;
+template class BasicBTPinnedNode<DoubleKey>;
+template class BasicBTLeafNode<CompositeKey>;
+template class BasicBTNonLeafNode<CompositeKey>;
+template class BasicBTPinnedNode<CompositeKey>;
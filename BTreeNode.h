@@ -10,17 +10,35 @@
 #ifndef BTREENODE_H
 #define BTREENODE_H
 
-#include <list>
+#include <vector>
 #include "RecordFile.h"
 #include "PageFile.h"
+#include "BTreeKey.h"
 
 /**
- * BTLeafNode: The class representing a B+tree leaf node.
+ * BasicBTLeafNode: The class representing a B+tree leaf node.
+ * K is the key traits class (see BTreeKey.h).
  */
-class BTLeafNode {
+template<class K>
+class BasicBTLeafNode {
   public:
+    typedef typename K::Type KeyType;
 
-    BTLeafNode(PageId id);
+   /**
+    * Leaf page formats. POSTING_LISTS stores the entries of every key as a
+    * list of varint-coded RecordIds. PACKED stores the keys, pids and sids
+    * of all entries as separate bit-packed arrays, which roughly doubles
+    * the fanout of leaves with mostly distinct integral keys.
+    */
+    enum { POSTING_LISTS = 0, PACKED = 1 };
+
+   /**
+    * @param id[IN] the PageId of the node
+    * @param valueWidth[IN] the # bytes of the record value stored inline
+    *                       with every entry (0 if the values are not stored)
+    * @param format[IN] the page format of the node (POSTING_LISTS or PACKED)
+    */
+    BasicBTLeafNode(PageId id, int valueWidth = 0, int format = POSTING_LISTS);
 
    /**
     * Insert the (key, rid) pair to the node.
@@ -29,20 +47,35 @@ class BTLeafNode {
     * @param rid[IN] the RecordId to insert
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, const RecordId& rid);
+    RC insert(const KeyType& key, const RecordId& rid);
+
+   /**
+    * Insert the (key, rid, value) entry to the node. Only the first
+    * valueWidth bytes of the value are stored.
+    * @param key[IN] the key to insert
+    * @param rid[IN] the RecordId to insert
+    * @param value[IN] the record value to store with the entry
+    * @return 0 if successful. Return an error code if the node is full.
+    */
+    RC insert(const KeyType& key, const RecordId& rid, const std::string& value);
 
    /**
     * Insert the (key, rid) pair to the node
     * and split the node half and half with sibling.
-    * The first key of the sibling node is returned in siblingKey.
+    * The key to insert in the parent node is returned in siblingKey.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert.
     * @param rid[IN] the RecordId to insert.
     * @param sibling[IN] the sibling node to split with. This node MUST be EMPTY when this function is called.
-    * @param siblingKey[OUT] the first key in the sibling node after split.
+    * @param siblingKey[OUT] the shortest key that is larger than the last key
+    *                        in this node and not larger than the first key in
+    *                        the sibling node after split.
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
+    RC insertAndSplit(const KeyType& key, const RecordId& rid,
+                      BasicBTLeafNode& sibling, KeyType& siblingKey);
+    RC insertAndSplit(const KeyType& key, const RecordId& rid, const std::string& value,
+                      BasicBTLeafNode& sibling, KeyType& siblingKey);
 
    /**
     * If searchKey exists in the node, set eid to the index entry
@@ -55,7 +88,7 @@ class BTLeafNode {
                       behind the largest key smaller than searchKey.
     * @return 0 if searchKey is found. If not, RC_NO_SEARCH_RECORD.
     */
-    RC locate(int searchKey, int& eid);
+    RC locate(const KeyType& searchKey, int& eid);
 
    /**
     * Read the (key, rid) pair from the eid entry.
@@ -64,7 +97,18 @@ class BTLeafNode {
     * @param rid[OUT] the RecordId from the slot
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC readEntry(int eid, int& key, RecordId& rid);
+    RC readEntry(int eid, KeyType& key, RecordId& rid);
+
+   /**
+    * Read the (key, rid, value) entry from the eid entry.
+    * The value is empty if the node does not store values.
+    * @param eid[IN] the entry number to read the entry from
+    * @param key[OUT] the key from the slot
+    * @param rid[OUT] the RecordId from the slot
+    * @param value[OUT] the stored (prefix of the) record value
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC readEntry(int eid, KeyType& key, RecordId& rid, std::string& value);
 
    /**
     * Return the pid of the next slibling node.
@@ -105,32 +149,83 @@ class BTLeafNode {
     PageId getPageId();
     PageId getNextLeaf();
     void print(std::string offset);
-    RC insert_end(int key, const RecordId& rid);
+    RC insert_end(const KeyType& key, const RecordId& rid, const std::string& value);
+
+   /**
+    * Check whether an entry with the given key and RecordId fits in the
+    * node's page.
+    * @param key[IN] the key of the entry
+    * @param rid[IN] the RecordId of the entry
+    * @return true if the entry can be inserted without a split
+    */
+    bool hasRoom(const KeyType& key, const RecordId& rid);
+
+   /**
+    * Remove count entries starting from the eid entry.
+    * @param eid[IN] the first entry to remove
+    * @param count[IN] the # entries to remove
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC removeEntries(int eid, int count);
+
+   /**
+    * The sid of the entry standing for a posting list moved to overflow
+    * pages. The pid of the entry is the first overflow page.
+    */
+    static const int OVERFLOW_SID = -1;
 
   private:
-    RC insertWithoutCheck(int key, const RecordId& rid);
+    RC insertWithoutCheck(const KeyType& key, const RecordId& rid, const std::string& value, int& index);
+    int prefixLength();
+    int encode(char* page, int prefix, std::vector<int>* costs);
+    int encodePacked(char* page, int pos, int prefix, std::vector<int>* costs);
+    int decodePostingLists(int pos, const KeyType& shared, int prefix);
+    int decodePacked(int pos, const KeyType& shared, int prefix);
+    int splitRank(int eid, const KeyType& separator);
 
     int isLeaf;
     int length;
-    std::list<RecordId> records;
-    std::list<int> keys;
+    std::vector<RecordId> records;
+    std::vector<KeyType> keys;
+    std::vector<std::string> values;
     PageId id;
     PageId nextLeaf;
+    int valueWidth;
+    int format;
    /**
     * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * that contains the node. The spare bytes at the end let the packed
+    * arrays be read with 8-byte loads up to the last page byte.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    char buffer[PageFile::PAGE_SIZE + sizeof(uint64_t)];
 }; 
 
 
 /**
- * BTNonLeafNode: The class representing a B+tree nonleaf node.
+ * BasicBTNonLeafNode: The class representing a B+tree nonleaf node.
+ * K is the key traits class (see BTreeKey.h).
+ * A node of a buffered (B-epsilon) tree reserves the last bufferBytes
+ * bytes of its page for messages: inserts on their way down to the leaves,
+ * which are pushed to the children in batches.
  */
-class BTNonLeafNode {
+template<class K>
+class BasicBTNonLeafNode {
   public:
+    typedef typename K::Type KeyType;
+
+    // A pending insert of (key, rid, value)
+    struct Message {
+        KeyType     key;
+        RecordId    rid;
+        std::string value;
+    };
 
-    BTNonLeafNode(PageId id);
+   /**
+    * @param id[IN] the PageId of the node
+    * @param bufferBytes[IN] # bytes of the page reserved for messages,
+    *                        0 for a node without a message buffer
+    */
+    BasicBTNonLeafNode(PageId id, int bufferBytes = 0);
   
    /**
     * Insert a (key, pid) pair to the node.
@@ -139,7 +234,7 @@ class BTNonLeafNode {
     * @param pid[IN] the PageId to insert
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, PageId pid);
+    RC insert(const KeyType& key, PageId pid);
 
    /**
     * Insert the (key, pid) pair to the node
@@ -153,7 +248,32 @@ class BTNonLeafNode {
     * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+    RC insertAndSplit(const KeyType& key, PageId pid, BasicBTNonLeafNode& sibling, KeyType& midKey);
+
+   /**
+    * Insert a (key, pid) pair to the node even if the node is full. A node
+    * with more entries than fit in its page must be split with split()
+    * before it is written.
+    * @param key[IN] the key to insert
+    * @param pid[IN] the PageId to insert
+    * @return 0 if successful
+    */
+    RC insertWithoutCheck(const KeyType& key, PageId pid);
+
+   /**
+    * Move the upper half of the entries to sibling, or as many of them as
+    * fit in a page if half of them do not. The messages for the children
+    * moved go with them.
+    * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
+    * @param midKey[OUT] the key between the two nodes, for the parent node.
+    * @return 0 if successful. Return an error code if the node has too few keys.
+    */
+    RC split(BasicBTNonLeafNode& sibling, KeyType& midKey);
+
+   /**
+    * @return whether the entries of the node do not fit in its page
+    */
+    bool isOverfull();
 
    /**
     * Given the searchKey, find the child-node pointer to follow and
@@ -163,7 +283,52 @@ class BTNonLeafNode {
     * @param pid[OUT] the pointer to the child node to follow.
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC locateChildPtr(int searchKey, PageId& pid);
+    RC locateChildPtr(const KeyType& searchKey, PageId& pid);
+
+   /**
+    * Like locateChildPtr(), but return the position of the child pointer:
+    * readEntry() of it is the child to follow.
+    * @param searchKey[IN] the searchKey that is being looked up.
+    * @return the position of the child, between 0 and getKeyCount()
+    */
+    int locateChildSlot(const KeyType& searchKey);
+
+   /**
+    * @param eid[IN] a key position, smaller than getKeyCount()
+    * @return the key right of the child at position eid
+    */
+    const KeyType& readKey(int eid);
+
+   /**
+    * Add a message to the buffer of the node. The buffer may overflow
+    * until it is flushed: see messagesFit().
+    * @param message[IN] the message to add
+    */
+    void addMessage(const Message& message);
+
+   /**
+    * @return # messages in the buffer, in the order they were added
+    */
+    int getMessageCount();
+    const Message& readMessage(int i);
+
+   /**
+    * @return whether the messages fit in the part of the page reserved
+    *         for them
+    */
+    bool messagesFit();
+
+   /**
+    * @return the position of the child with the most pending messages
+    */
+    int fullestChild();
+
+   /**
+    * Remove the messages for a child from the buffer.
+    * @param slot[IN] the position of the child
+    * @param messages[OUT] the messages removed, in the order they were added
+    */
+    void takeMessages(int slot, std::vector<Message>& messages);
 
    /**
     * Initialize the root node with (pid1, key, pid2).
@@ -172,7 +337,7 @@ class BTNonLeafNode {
     * @param pid2[IN] the PageId to insert behind the key
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC initializeRoot(PageId pid1, int key, PageId pid2);
+    RC initializeRoot(PageId pid1, const KeyType& key, PageId pid2);
 
    /**
     * Return the number of keys stored in the node.
@@ -201,17 +366,31 @@ class BTNonLeafNode {
 	PageId getLastId();
     PageId readEntry(int eid);
     void print(std::string offset);
-    RC insert_end(int key, PageId pid);
+    RC insert_end(const KeyType& key, PageId pid);
+
+   /**
+    * Check whether an entry with the given key fits in the node's page.
+    * @param key[IN] the key of the entry
+    * @return true if the entry can be inserted without a split
+    */
+    bool hasRoom(const KeyType& key);
 
   private:
-    RC insertWithoutCheck(int key, PageId pid);
+    template<class> friend class BasicBTPinnedNode;
+
+    int entrySize(const KeyType& key);
+    int pageBytes();
+    int messageSize(const Message& message);
   
     int isLeaf;
     int length;
-    std::list<PageId> pages;
-    std::list<int> keys;
+    std::vector<PageId> pages;
+    std::vector<KeyType> keys;
     PageId id;
     PageId lastId;
+    int bufferBytes;                 // # bytes of the page for messages
+    int messageBytes;                // # bytes taken by the messages
+    std::vector<Message> messages;
 
    /**
     * The main memory buffer for loading the content of the disk page 
@@ -220,4 +399,64 @@ class BTNonLeafNode {
     char buffer[PageFile::PAGE_SIZE];
 }; 
 
+/**
+ * BasicBTPinnedNode: a read-only copy of a nonleaf node kept in memory
+ * for the hot top levels of a tree. The keys are laid out in Eytzinger
+ * (breadth-first) order: the search visits slots 1, 2 or 3, 4 to 7, ...
+ * so the first levels of every search share a few cache lines, and the
+ * four possible slots two levels down are adjacent and prefetched while
+ * the current key is compared.
+ */
+template<class K>
+class BasicBTPinnedNode {
+  public:
+    typedef typename K::Type KeyType;
+
+   /**
+    * Copy the keys and child pointers of node.
+    * @param node[IN] the nonleaf node to copy
+    */
+    BasicBTPinnedNode(const BasicBTNonLeafNode<K>& node);
+
+   /**
+    * Find the child-node pointer to follow for searchKey, like
+    * BasicBTNonLeafNode::locateChildPtr().
+    * @param searchKey[IN] the searchKey that is being looked up
+    * @return the slot of the child pointer to follow
+    */
+    int locateChildSlot(const KeyType& searchKey) const;
+
+   /**
+    * @param slot[IN] a slot returned by locateChildSlot()
+    * @return the PageId of the child node in slot
+    */
+    PageId getChild(int slot) const;
+
+   /**
+    * The pinned copy of a child node, if any, is referred to by its index
+    * in the caller's array of pinned nodes.
+    * @param slot[IN] a slot returned by locateChildSlot()
+    * @return the index of the pinned copy of the child, -1 if none
+    */
+    int getPinnedChild(int slot) const;
+    void setPinnedChild(int slot, int index);
+
+   /**
+    * @return the # slots (# keys + 1) of the node
+    */
+    int getSlotCount() const;
+
+  private:
+    int fill(const std::vector<KeyType>& sorted, const std::vector<PageId>& pages, int rank, int slot);
+
+    std::vector<KeyType> keys;      // keys[1..n] in Eytzinger order
+    std::vector<PageId>  children;  // child left of keys[slot]; [0] is the last child
+    std::vector<int>     pinnedChildren;
+};
+
+typedef BasicBTLeafNode<IntKey>       BTLeafNode;
+typedef BasicBTNonLeafNode<IntKey>    BTNonLeafNode;
+typedef BasicBTLeafNode<StringKey>    BTStringLeafNode;
+typedef BasicBTNonLeafNode<StringKey> BTStringNonLeafNode;
+
 #endif /* BTREENODE_H */
@@ -0,0 +1,106 @@
+#include <cstring>
+#include "BloomFilter.h"
+
+// multipliers that pick one bit out of each word of a block
+static const uint32_t SALT[BloomFilter::WORDS_PER_BLOCK] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+// the header fields stored at the beginning of page 0
+static const int HEADER_FIELDS = 3;
+
+BloomFilter::BloomFilter()
+{
+  reset(KEYS_PER_BLOCK);
+}
+
+void BloomFilter::reset(int capacity)
+{
+  this->capacity = (capacity > 0) ? capacity : KEYS_PER_BLOCK;
+  keyCount = 0;
+  blockCount = (this->capacity + KEYS_PER_BLOCK - 1) / KEYS_PER_BLOCK;
+  words.assign(blockCount * WORDS_PER_BLOCK, 0);
+}
+
+int BloomFilter::blockOffset(uint64_t hash) const
+{
+  // the upper half of the hash picks the block, the lower half the bits
+  uint64_t block = ((hash >> 32) * (uint64_t)blockCount) >> 32;
+  return (int)block * WORDS_PER_BLOCK;
+}
+
+void BloomFilter::add(uint64_t h)
+{
+  uint32_t* block = &words[blockOffset(h)];
+  for (int i = 0; i < WORDS_PER_BLOCK; i++) {
+    block[i] |= 1U << (((uint32_t)h * SALT[i]) >> 27);
+  }
+  keyCount++;
+}
+
+bool BloomFilter::mayContain(uint64_t h) const
+{
+  const uint32_t* block = &words[blockOffset(h)];
+
+  // no early exit: all eight words are tested at once
+  uint32_t missing = 0;
+  for (int i = 0; i < WORDS_PER_BLOCK; i++) {
+    uint32_t mask = 1U << (((uint32_t)h * SALT[i]) >> 27);
+    missing |= ~block[i] & mask;
+  }
+  return missing == 0;
+}
+
+RC BloomFilter::read(const PageFile& pf)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  header[HEADER_FIELDS];
+
+  if ((rc = pf.read(0, page)) < 0) return rc;
+  memcpy(header, page, sizeof(header));
+  if (header[0] <= 0 || header[2] != (header[0] + KEYS_PER_BLOCK - 1) / KEYS_PER_BLOCK) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  reset(header[0]);
+  keyCount = header[1];
+
+  // copy the blocks page by page
+  char* dst = reinterpret_cast<char*>(&words[0]);
+  int   remaining = blockCount * BLOCK_SIZE;
+  for (PageId pid = 1; remaining > 0; pid++) {
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    int n = (remaining < PageFile::PAGE_SIZE) ? remaining : PageFile::PAGE_SIZE;
+    memcpy(dst, page, n);
+    dst += n;
+    remaining -= n;
+  }
+
+  return 0;
+}
+
+RC BloomFilter::write(PageFile& pf) const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  header[HEADER_FIELDS] = { capacity, keyCount, blockCount };
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, header, sizeof(header));
+  if ((rc = pf.write(0, page)) < 0) return rc;
+
+  const char* src = reinterpret_cast<const char*>(&words[0]);
+  int remaining = blockCount * BLOCK_SIZE;
+  for (PageId pid = 1; remaining > 0; pid++) {
+    int n = (remaining < PageFile::PAGE_SIZE) ? remaining : PageFile::PAGE_SIZE;
+    memset(page, 0, PageFile::PAGE_SIZE);
+    memcpy(page, src, n);
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+    src += n;
+    remaining -= n;
+  }
+
+  return 0;
+}
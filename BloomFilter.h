@@ -0,0 +1,85 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <vector>
+#include <stdint.h>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * A split-block Bloom filter over 64-bit key hashes.
+ * Every key hash selects exactly one 32-byte block and sets one bit in
+ * each of the eight 32-bit words of the block, so a probe touches a
+ * single cache line and the eight word tests are independent of each
+ * other (the probe loop is written so that the compiler can turn it into
+ * a single vector compare).
+ * The filter is stored in its own PageFile: page 0 holds the header and
+ * the blocks start from page 1.
+ */
+class BloomFilter {
+ public:
+
+  static const int WORDS_PER_BLOCK = 8;
+  static const int BLOCK_SIZE      = WORDS_PER_BLOCK * sizeof(uint32_t);
+  static const int BLOCKS_PER_PAGE = PageFile::PAGE_SIZE / BLOCK_SIZE;
+
+  // # keys per block at the nominal capacity (16 bits per key)
+  static const int KEYS_PER_BLOCK  = 16;
+
+  BloomFilter();
+
+  /**
+   * clear the filter and size it for the given number of keys.
+   * @param capacity[IN] the number of keys the filter is sized for
+   */
+  void reset(int capacity);
+
+  /**
+   * add a key to the filter.
+   * @param hash[IN] the 64-bit hash of the key to add
+   */
+  void add(uint64_t hash);
+
+  /**
+   * test whether the key may have been added to the filter.
+   * a false answer is always correct; a true answer may be a false positive.
+   * @param hash[IN] the 64-bit hash of the key to test
+   * @return false if the key was never added
+   */
+  bool mayContain(uint64_t hash) const;
+
+  /**
+   * @return true if as many keys were added as the filter was sized for.
+   *         adding more keys degrades its false positive rate.
+   */
+  bool isFull() const { return keyCount >= capacity; }
+
+  /**
+   * @return the number of keys the filter was sized for
+   */
+  int getCapacity() const { return capacity; }
+
+  /**
+   * read the filter from the PageFile.
+   * @param pf[IN] PageFile to read from
+   * @return error code. 0 if no error
+   */
+  RC read(const PageFile& pf);
+
+  /**
+   * write the filter to the PageFile.
+   * @param pf[IN] PageFile to write to
+   * @return error code. 0 if no error
+   */
+  RC write(PageFile& pf) const;
+
+ private:
+  int blockOffset(uint64_t hash) const;
+
+  int capacity;    // # keys the filter is sized for
+  int keyCount;    // # keys added since the last reset
+  int blockCount;  // # 32-byte blocks in the filter
+  std::vector<uint32_t> words;
+};
+
+#endif // BLOOMFILTER_H
@@ -0,0 +1,96 @@
+#include <cstring>
+#include "Dictionary.h"
+
+using namespace std;
+
+// the header fields stored at the beginning of page 0
+static const int HEADER_FIELDS = 2;
+
+Dictionary::Dictionary()
+{
+}
+
+void Dictionary::clear()
+{
+  values.clear();
+  codes.clear();
+}
+
+int Dictionary::encode(const string& value)
+{
+  map<string, int>::iterator it = codes.find(value);
+  if (it != codes.end()) return it->second;
+
+  int code = values.size();
+  values.push_back(value);
+  codes[value] = code;
+  return code;
+}
+
+int Dictionary::find(const string& value) const
+{
+  map<string, int>::const_iterator it = codes.find(value);
+  return (it != codes.end()) ? it->second : -1;
+}
+
+RC Dictionary::read(const PageFile& pf)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  header[HEADER_FIELDS];
+
+  if ((rc = pf.read(0, page)) < 0) return rc;
+  memcpy(header, page, sizeof(header));
+  if (header[0] < 0 || header[1] < 0 ||
+      (header[1] + PageFile::PAGE_SIZE - 1) / PageFile::PAGE_SIZE + 1 > pf.endPid()) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  // the values follow each other from page 1
+  string bytes(header[1], '\0');
+  for (int done = 0; done < header[1]; done += PageFile::PAGE_SIZE) {
+    if ((rc = pf.read(1 + done / PageFile::PAGE_SIZE, page)) < 0) return rc;
+    int n = (header[1] - done < PageFile::PAGE_SIZE) ? header[1] - done : PageFile::PAGE_SIZE;
+    bytes.replace(done, PageFile::PAGE_SIZE, page, n);
+  }
+
+  clear();
+  unsigned offset = 0;
+  for (int i = 0; i < header[0]; i++) {
+    int length;
+    if (offset + sizeof(int) > bytes.size()) return RC_INVALID_FILE_FORMAT;
+    memcpy(&length, bytes.data() + offset, sizeof(int));
+    offset += sizeof(int);
+    if (length < 0 || offset + length > bytes.size()) return RC_INVALID_FILE_FORMAT;
+    encode(bytes.substr(offset, length));
+    offset += length;
+  }
+
+  return 0;
+}
+
+RC Dictionary::write(PageFile& pf) const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  string bytes;
+  for (unsigned i = 0; i < values.size(); i++) {
+    int length = values[i].size();
+    bytes.append((const char*)&length, sizeof(int));
+    bytes.append(values[i]);
+  }
+
+  int header[HEADER_FIELDS] = { (int)values.size(), (int)bytes.size() };
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, header, sizeof(header));
+  if ((rc = pf.write(0, page)) < 0) return rc;
+
+  for (unsigned done = 0; done < bytes.size(); done += PageFile::PAGE_SIZE) {
+    memset(page, 0, PageFile::PAGE_SIZE);
+    bytes.copy(page, PageFile::PAGE_SIZE, done);
+    if ((rc = pf.write(1 + done / PageFile::PAGE_SIZE, page)) < 0) return rc;
+  }
+
+  return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * The dictionary of the values of a table: every distinct value gets an
+ * integer code, in the order the values are first added. A table with a
+ * dictionary stores the code of a value instead of the value, so that a
+ * repeated value takes four bytes, and an equality on value compares codes.
+ * The dictionary is stored in its own PageFile: page 0 holds the header
+ * and the values, each one as its length and its bytes, start from page 1.
+ */
+class Dictionary {
+ public:
+
+  Dictionary();
+
+  /**
+   * remove all the values.
+   */
+  void clear();
+
+  /**
+   * get the code of a value, and add the value if it is new.
+   * @param value[IN] the value to encode
+   * @return the code of the value
+   */
+  int encode(const std::string& value);
+
+  /**
+   * @param value[IN] the value to look for
+   * @return the code of the value. -1 if it is not in the dictionary
+   */
+  int find(const std::string& value) const;
+
+  /**
+   * @param code[IN] a code returned by encode()
+   * @return the value of the code
+   */
+  const std::string& decode(int code) const { return values[code]; }
+
+  /**
+   * @return # values in the dictionary
+   */
+  int getSize() const { return values.size(); }
+
+  /**
+   * read the dictionary from the PageFile.
+   * @param pf[IN] PageFile to read from
+   * @return error code. 0 if no error
+   */
+  RC read(const PageFile& pf);
+
+  /**
+   * write the dictionary to the PageFile.
+   * @param pf[IN] PageFile to write to
+   * @return error code. 0 if no error
+   */
+  RC write(PageFile& pf) const;
+
+ private:
+  std::vector<std::string>   values;  // the value of every code
+  std::map<std::string, int> codes;   // the code of every value
+};
+
+#endif // DICTIONARY_H
@@ -0,0 +1,438 @@
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include "ExtentFile.h"
+
+using std::string;
+
+// the header fields stored at the beginning of page 0 of the offset map
+static const int HEADER_FIELDS = 3;
+
+//
+// the block compression. a block is a list of sequences, and a sequence
+// is a token byte, literal bytes copied as they are, and a match: bytes
+// copied from the output already produced. the high 4 bits of the token
+// are # literals and the low 4 bits the match length - MIN_MATCH. a field
+// of 15 is followed by more bytes of the length, each one added to it,
+// until a byte below 255. the literals are followed by the 2-byte offset
+// of the match, back from the end of the output. the last sequence has
+// no match, and ends the block.
+//
+
+static const int MIN_MATCH  = 4;
+static const int MAX_OFFSET = 65535;
+static const int HASH_BITS  = 12;
+
+// compress n bytes of src into dst. return # bytes written to dst, or -1
+// if the block does not fit in capacity bytes
+static int compressBlock(const char* src, int n, char* dst, int capacity);
+
+// decompress the n bytes of a block in src into dst. return # bytes
+// written to dst, or -1 if the block is corrupt or does not fit in
+// capacity bytes
+static int decompressBlock(const char* src, int n, char* dst, int capacity);
+
+
+ExtentFile::ExtentFile()
+{
+  streamEnd = 0;
+  epid = 0;
+  mapDirty = false;
+  currentExtent = -1;
+  currentDirty = false;
+  cachedExtent = -1;
+}
+
+RC ExtentFile::open(const string& filename, char mode)
+{
+  RC rc;
+
+  if ((rc = pf.open(filename, mode)) < 0) return rc;
+
+  name = mapName(filename);
+  extents.clear();
+  streamEnd = 0;
+  epid = 0;
+  currentExtent = cachedExtent = -1;
+  currentDirty = false;
+
+  // a new file gets its offset map when it is closed, even if empty
+  mapDirty = false;
+  if (::access(name.c_str(), F_OK) == 0) {
+    rc = readMap();
+  } else if (pf.endPid() > 0) {
+    rc = RC_INVALID_FILE_FORMAT;
+  } else {
+    mapDirty = (mode == 'w' || mode == 'W');
+  }
+  if (rc < 0) {
+    pf.close();
+    return rc;
+  }
+  return 0;
+}
+
+RC ExtentFile::close()
+{
+  RC rc = 0;
+
+  // the extent in memory and the offset map are written only now
+  if (currentDirty) {
+    rc = storeExtent(currentExtent, current, extentPages(currentExtent));
+  }
+  if (rc == 0 && mapDirty) rc = writeMap();
+
+  extents.clear();
+  streamEnd = 0;
+  epid = 0;
+  mapDirty = false;
+  currentExtent = cachedExtent = -1;
+  currentDirty = false;
+
+  if (rc < 0) {
+    pf.close();
+    return rc;
+  }
+  return pf.close();
+}
+
+RC ExtentFile::read(PageId pid, void* buffer) const
+{
+  RC rc;
+
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID;
+
+  int n = pid / EXTENT_PAGES;
+  int offset = (pid % EXTENT_PAGES) * PageFile::PAGE_SIZE;
+  if (n == currentExtent) {
+    memcpy(buffer, current + offset, PageFile::PAGE_SIZE);
+    return 0;
+  }
+
+  // the extent is decompressed once for all its pages
+  if (n != cachedExtent) {
+    cachedExtent = -1;
+    if ((rc = loadExtent(n, cache)) < 0) return rc;
+    cachedExtent = n;
+  }
+  memcpy(buffer, cache + offset, PageFile::PAGE_SIZE);
+  return 0;
+}
+
+RC ExtentFile::write(PageId pid, const void* buffer)
+{
+  RC rc;
+
+  if (pid < 0 || pid > epid) return RC_INVALID_PID;
+
+  // moving on to another extent writes the one in memory
+  int n = pid / EXTENT_PAGES;
+  if (n != currentExtent) {
+    if (currentDirty) {
+      if ((rc = storeExtent(currentExtent, current, extentPages(currentExtent))) < 0) return rc;
+      currentDirty = false;
+    }
+    currentExtent = -1;
+    if (n < (int)extents.size()) {
+      if ((rc = loadExtent(n, current)) < 0) return rc;
+    } else {
+      memset(current, 0, sizeof(current));
+    }
+    currentExtent = n;
+  }
+
+  memcpy(current + (pid % EXTENT_PAGES) * PageFile::PAGE_SIZE, buffer, PageFile::PAGE_SIZE);
+  currentDirty = true;
+  if (pid == epid) epid++;
+  return 0;
+}
+
+int ExtentFile::extentPages(int n) const
+{
+  // every extent is full but the last one
+  int count = epid - n * EXTENT_PAGES;
+  return (count < EXTENT_PAGES) ? count : EXTENT_PAGES;
+}
+
+RC ExtentFile::loadExtent(int n, char* pages) const
+{
+  RC   rc;
+  char block[EXTENT_PAGES * PageFile::PAGE_SIZE];
+
+  if (n < 0 || n >= (int)extents.size()) return RC_INVALID_PID;
+  const Extent& extent = extents[n];
+  int length = extent.pages * PageFile::PAGE_SIZE;
+
+  if (extent.length == length) {
+    if ((rc = readBytes(extent.offset, pages, length)) < 0) return rc;
+  } else {
+    if ((rc = readBytes(extent.offset, block, extent.length)) < 0) return rc;
+    if (decompressBlock(block, extent.length, pages, length) != length) {
+      return RC_INVALID_FILE_FORMAT;
+    }
+  }
+
+  // the pages the extent does not have yet are empty
+  memset(pages + length, 0, (EXTENT_PAGES - extent.pages) * PageFile::PAGE_SIZE);
+  return 0;
+}
+
+RC ExtentFile::storeExtent(int n, const char* pages, int count)
+{
+  RC   rc;
+  char block[EXTENT_PAGES * PageFile::PAGE_SIZE];
+
+  // the pages are stored as they are if they do not compress
+  int         length = count * PageFile::PAGE_SIZE;
+  const char* bytes = pages;
+  int         compressed = compressBlock(pages, length, block, length - 1);
+  if (compressed >= 0) {
+    bytes = block;
+    length = compressed;
+  }
+
+  // the block is written over the old one of the extent if it fits, or
+  // if the old one ends the file. it goes to the end of the file otherwise
+  Extent extent = { streamEnd, length, count };
+  bool   atEnd = false;
+  if (n < (int)extents.size()) {
+    atEnd = (extents[n].offset + extents[n].length == streamEnd);
+    if (atEnd || length <= extents[n].length) extent.offset = extents[n].offset;
+  }
+  if ((rc = writeBytes(extent.offset, bytes, length)) < 0) return rc;
+
+  if (n < (int)extents.size()) {
+    extents[n] = extent;
+  } else {
+    extents.push_back(extent);
+  }
+  if (atEnd || extent.offset + length > streamEnd) streamEnd = extent.offset + length;
+  if (cachedExtent == n) cachedExtent = -1;
+  mapDirty = true;
+  return 0;
+}
+
+RC ExtentFile::readBytes(int offset, char* bytes, int length) const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  for (int done = 0; done < length; ) {
+    int at = (offset + done) % PageFile::PAGE_SIZE;
+    int n = std::min(PageFile::PAGE_SIZE - at, length - done);
+    if ((rc = pf.read((offset + done) / PageFile::PAGE_SIZE, page)) < 0) return rc;
+    memcpy(bytes + done, page + at, n);
+    done += n;
+  }
+  return 0;
+}
+
+RC ExtentFile::writeBytes(int offset, const char* bytes, int length)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  for (int done = 0; done < length; ) {
+    PageId pid = (offset + done) / PageFile::PAGE_SIZE;
+    int    at = (offset + done) % PageFile::PAGE_SIZE;
+    int    n = std::min(PageFile::PAGE_SIZE - at, length - done);
+
+    // a page shared with another block keeps its other bytes
+    if (n < PageFile::PAGE_SIZE && pid < pf.endPid()) {
+      if ((rc = pf.read(pid, page)) < 0) return rc;
+    } else {
+      memset(page, 0, PageFile::PAGE_SIZE);
+    }
+    memcpy(page + at, bytes + done, n);
+    if ((rc = pf.write(pid, page)) < 0) return rc;
+    done += n;
+  }
+  return 0;
+}
+
+RC ExtentFile::readMap()
+{
+  RC       rc;
+  PageFile mpf;
+  char     page[PageFile::PAGE_SIZE];
+  int      header[HEADER_FIELDS];
+  const int EXTENTS_PER_PAGE = PageFile::PAGE_SIZE / sizeof(Extent);
+
+  if ((rc = mpf.open(name, 'r')) < 0) return rc;
+  if ((rc = mpf.read(0, page)) < 0) {
+    mpf.close();
+    return rc;
+  }
+
+  // header: # extents, # pages and # bytes used by the blocks
+  memcpy(header, page, sizeof(header));
+  if (header[0] < 0 || header[1] < 0 || header[2] < 0 ||
+      header[0] != (header[1] + EXTENT_PAGES - 1) / EXTENT_PAGES ||
+      header[2] > pf.endPid() * PageFile::PAGE_SIZE ||
+      (header[0] + EXTENTS_PER_PAGE - 1) / EXTENTS_PER_PAGE + 1 > mpf.endPid()) {
+    mpf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  extents.resize(header[0]);
+  for (int i = 0; i < header[0]; i += EXTENTS_PER_PAGE) {
+    if ((rc = mpf.read(1 + i / EXTENTS_PER_PAGE, page)) < 0) {
+      mpf.close();
+      return rc;
+    }
+    int n = std::min(header[0] - i, EXTENTS_PER_PAGE);
+    memcpy(&extents[i], page, n * sizeof(Extent));
+  }
+  mpf.close();
+
+  for (unsigned i = 0; i < extents.size(); i++) {
+    const Extent& extent = extents[i];
+    if (extent.offset < 0 || extent.length < 0 || extent.offset + extent.length > header[2] ||
+        extent.pages < 1 || extent.pages > EXTENT_PAGES ||
+        extent.length > extent.pages * PageFile::PAGE_SIZE) {
+      return RC_INVALID_FILE_FORMAT;
+    }
+  }
+  epid = header[1];
+  streamEnd = header[2];
+  return 0;
+}
+
+RC ExtentFile::writeMap()
+{
+  RC       rc;
+  PageFile mpf;
+  char     page[PageFile::PAGE_SIZE];
+  int      header[HEADER_FIELDS] = { (int)extents.size(), epid, streamEnd };
+  const int EXTENTS_PER_PAGE = PageFile::PAGE_SIZE / sizeof(Extent);
+
+  if ((rc = mpf.open(name, 'w')) < 0) return rc;
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, header, sizeof(header));
+  rc = mpf.write(0, page);
+
+  for (int i = 0; rc == 0 && i < header[0]; i += EXTENTS_PER_PAGE) {
+    int n = std::min(header[0] - i, EXTENTS_PER_PAGE);
+    memset(page, 0, PageFile::PAGE_SIZE);
+    memcpy(page, &extents[i], n * sizeof(Extent));
+    rc = mpf.write(1 + i / EXTENTS_PER_PAGE, page);
+  }
+
+  mpf.close();
+  if (rc == 0) mapDirty = false;
+  return rc;
+}
+
+// write a length field of a sequence, past the 15 in the token
+static int writeLength(char* dst, int out, int length)
+{
+  for (; length >= 255; length -= 255) dst[out++] = (char)255;
+  dst[out++] = (char)length;
+  return out;
+}
+
+// write a sequence at dst + out and return the new end of the output,
+// or -1 if it does not fit in capacity bytes. a sequence without match
+// has matchLength 0
+static int writeSequence(char* dst, int out, int capacity, const char* literals,
+                         int literalLength, int offset, int matchLength)
+{
+  // the token, the literals with their length, and the match
+  int size = 1 + literalLength + (literalLength >= 15 ? literalLength / 255 + 1 : 0);
+  if (matchLength > 0) size += 2 + (matchLength - MIN_MATCH >= 15 ? matchLength / 255 + 1 : 0);
+  if (out + size > capacity) return -1;
+
+  int matchField = (matchLength > 0) ? matchLength - MIN_MATCH : 0;
+  dst[out++] = (char)((std::min(literalLength, 15) << 4) | std::min(matchField, 15));
+  if (literalLength >= 15) out = writeLength(dst, out, literalLength - 15);
+  memcpy(dst + out, literals, literalLength);
+  out += literalLength;
+
+  if (matchLength > 0) {
+    dst[out++] = (char)(offset & 0xff);
+    dst[out++] = (char)(offset >> 8);
+    if (matchField >= 15) out = writeLength(dst, out, matchField - 15);
+  }
+  return out;
+}
+
+static int compressBlock(const char* src, int n, char* dst, int capacity)
+{
+  int table[1 << HASH_BITS];  // the last position of every hashed 4 bytes
+  int anchor = 0;             // the first byte not written yet
+  int out = 0;
+
+  std::fill(table, table + (1 << HASH_BITS), -1);
+
+  for (int i = 0; i + MIN_MATCH <= n; ) {
+    unsigned int sequence;
+    memcpy(&sequence, src + i, sizeof(sequence));
+    int hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+    int candidate = table[hash];
+    table[hash] = i;
+
+    if (candidate < 0 || i - candidate > MAX_OFFSET ||
+        memcmp(src + candidate, src + i, MIN_MATCH) != 0) {
+      i++;
+      continue;
+    }
+
+    // extend the match as far as it goes
+    int length = MIN_MATCH;
+    while (i + length < n && src[candidate + length] == src[i + length]) length++;
+
+    out = writeSequence(dst, out, capacity, src + anchor, i - anchor, i - candidate, length);
+    if (out < 0) return -1;
+    i += length;
+    anchor = i;
+  }
+
+  // the bytes after the last match end the block
+  return writeSequence(dst, out, capacity, src + anchor, n - anchor, 0, 0);
+}
+
+// read a length field of a sequence, past the 15 in the token. return
+// false if the block ends in it
+static bool readLength(const char* src, int n, int& in, int& length)
+{
+  unsigned char byte;
+  do {
+    if (in >= n) return false;
+    byte = src[in++];
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+static int decompressBlock(const char* src, int n, char* dst, int capacity)
+{
+  int in = 0;
+  int out = 0;
+
+  while (in < n) {
+    unsigned char token = src[in++];
+
+    int literalLength = token >> 4;
+    if (literalLength == 15 && !readLength(src, n, in, literalLength)) return -1;
+    if (literalLength > n - in || literalLength > capacity - out) return -1;
+    memcpy(dst + out, src + in, literalLength);
+    in += literalLength;
+    out += literalLength;
+
+    // the last sequence has no match
+    if (in == n) break;
+
+    if (in + 2 > n) return -1;
+    int offset = (unsigned char)src[in] | ((unsigned char)src[in + 1] << 8);
+    in += 2;
+    int matchLength = token & 15;
+    if (matchLength == 15 && !readLength(src, n, in, matchLength)) return -1;
+    matchLength += MIN_MATCH;
+    if (offset == 0 || offset > out || matchLength > capacity - out) return -1;
+
+    // the match may overlap the bytes it produces, so it is copied byte by byte
+    for (int i = 0; i < matchLength; i++, out++) dst[out] = dst[out - offset];
+  }
+  return out;
+}
@@ -0,0 +1,104 @@
+#ifndef EXTENTFILE_H
+#define EXTENTFILE_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * read/write a file in the unit of a page, like PageFile, but store the
+ * pages compressed. the pages are grouped in extents of EXTENT_PAGES
+ * consecutive pages, and every extent is compressed as one block with a
+ * fast LZ77 coder (in the manner of LZ4). the blocks are packed one after
+ * the other in the file, and the offset map (the file name + ".map")
+ * tells where the block of every extent starts.
+ * the extent being written is kept uncompressed in memory, and it is
+ * compressed and written when a page of another extent is written or when
+ * the file is closed. the extent last read is also kept uncompressed, so
+ * that reading its other pages takes no disk read.
+ */
+class ExtentFile {
+ public:
+
+  static const int EXTENT_PAGES = 8;  // # pages in an extent
+
+  ExtentFile();
+
+  /**
+   * open a file in read or write mode.
+   * when opened in 'w' mode, if the file does not exist, it is created.
+   * @param filename[IN] the name of the file to open
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename, char mode);
+
+  /**
+   * write the extent in memory and the offset map, and close the file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * read a page into memory buffer.
+   * @param pid[IN] the page to read
+   * @param buffer[OUT] pointer to memory buffer
+   * @return error code. 0 if no error
+   */
+  RC read(PageId pid, void* buffer) const;
+
+  /**
+   * write the memory buffer to the page.
+   * pid may be at most endPid(), and the file is expanded such that
+   * endPid() becomes (pid + 1) if pid is endPid().
+   * @param pid[IN] page to write to
+   * @param buffer[IN] the content to write
+   * @return error code. 0 if no error
+   */
+  RC write(PageId pid, const void* buffer);
+
+  /**
+   * @return the id of the last page in the file (+ 1)
+   */
+  PageId endPid() const { return epid; }
+
+  /**
+   * @param filename[IN] the name of a file
+   * @return the name of the offset map of the file
+   */
+  static std::string mapName(const std::string& filename) { return filename + ".map"; }
+
+ private:
+  // the block of an extent in the file. a block as long as the pages of
+  // its extent stores them uncompressed
+  struct Extent {
+    int offset;  // the offset of the first byte of the block
+    int length;  // # bytes of the block
+    int pages;   // # pages of the extent
+  };
+
+  int extentPages(int n) const;
+  RC loadExtent(int n, char* pages) const;
+  RC storeExtent(int n, const char* pages, int count);
+  RC readBytes(int offset, char* bytes, int length) const;
+  RC writeBytes(int offset, const char* bytes, int length);
+  RC readMap();
+  RC writeMap();
+
+  PageFile            pf;         // the PageFile of the blocks
+  std::string         name;       // the name of the offset map
+  std::vector<Extent> extents;    // the block of every extent written
+  int                 streamEnd;  // # bytes used by the blocks
+  PageId              epid;       // (last page id + 1) of the file
+  bool                mapDirty;   // true if the offset map is not written yet
+
+  char    current[EXTENT_PAGES * PageFile::PAGE_SIZE];  // the extent being written
+  int     currentExtent;  // the extent in current, -1 if none
+  bool    currentDirty;   // true if current is not written yet
+
+  mutable char cache[EXTENT_PAGES * PageFile::PAGE_SIZE];  // the extent last read
+  mutable int  cachedExtent;  // the extent in cache, -1 if none
+};
+
+#endif // EXTENTFILE_H
@@ -0,0 +1,445 @@
+#include <cstring>
+#include "HashIndex.h"
+
+using namespace std;
+
+#define NO_PAGE -1
+
+// Page 0: the header, followed by the PageIds of the directory pages
+struct HashHeader {
+  int    level;        // see BasicHashIndex::bucketOf()
+  int    next;         // the next bucket to split
+  int    bucketCount;
+  int    entryBytes;   // # bytes taken by all the entries
+  PageId freeList;     // the first free page, -1 if none
+  int    directoryCount;
+};
+
+// Header of a bucket page, followed by count entries. A free page has no
+// entry, and overflow is the next free page
+struct BucketHeader {
+  int    count;
+  PageId overflow;     // the next page of the bucket, -1 at the end
+};
+
+// # bytes for the entries of a bucket page
+static const int BUCKET_BYTES = PageFile::PAGE_SIZE - sizeof(BucketHeader);
+
+// # buckets listed by a directory page
+static const int DIRECTORY_ENTRIES = PageFile::PAGE_SIZE / sizeof(PageId);
+
+// the next bucket is split when the entries take more than this
+// fraction of the first pages of the buckets
+static const double SPLIT_LOAD = 0.75;
+
+// # directory pages listed by the header
+static const int MAX_DIRECTORY_PAGES = (PageFile::PAGE_SIZE - sizeof(HashHeader)) / sizeof(PageId);
+
+template<class K>
+BasicHashIndex<K>::BasicHashIndex()
+{
+  level = 0;
+  next = 0;
+  freeList = NO_PAGE;
+  entryBytes = 0;
+  headerDirty = false;
+  cursorPage.pid = NO_PAGE;
+}
+
+template<class K>
+RC BasicHashIndex<K>::open(const string& indexname, char mode)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  if ((rc = pf.open(indexname, mode)) < 0) return rc;
+  buckets.clear();
+  directory.clear();
+  cursorPage.pid = NO_PAGE;
+
+  if (pf.endPid() == 0) {
+    if (mode != 'w' && mode != 'W') {
+      pf.close();
+      return RC_INVALID_FILE_FORMAT;
+    }
+    // a new index has a single empty bucket
+    level = 0;
+    next = 0;
+    freeList = NO_PAGE;
+    entryBytes = 0;
+    memset(page, 0, PageFile::PAGE_SIZE);
+    if ((rc = pf.write(0, page)) < 0) return rc;
+    PageId pid;
+    if ((rc = allocatePage(pid)) < 0) return rc;
+    buckets.push_back(pid);
+    return writeDirectory(0);
+  }
+
+  HashHeader header;
+  if ((rc = pf.read(0, page)) < 0) return rc;
+  memcpy(&header, page, sizeof(header));
+  level = header.level;
+  next = header.next;
+  freeList = header.freeList;
+  entryBytes = header.entryBytes;
+  headerDirty = false;
+  directory.resize(header.directoryCount);
+  memcpy(&directory[0], page + sizeof(header), header.directoryCount * sizeof(PageId));
+  buckets.assign(header.bucketCount, NO_PAGE);
+  // a lookup reads the directory page of its bucket only. an insert may
+  // rewrite any directory page, so they are all read up front
+  if (mode == 'w' || mode == 'W') {
+    for (int d = 0; d < header.directoryCount; d++) {
+      if ((rc = readDirectory(d)) < 0) return rc;
+    }
+  }
+  return 0;
+}
+
+template<class K>
+RC BasicHashIndex<K>::close()
+{
+  // the header has the size of the entries inserted since the last split
+  if (headerDirty) writeHeader();
+  buckets.clear();
+  directory.clear();
+  cursorPage.pid = NO_PAGE;
+  return pf.close();
+}
+
+// The bucket of key: the last level bits of its hash, or the last
+// level + 1 bits for the buckets already split in this round
+template<class K>
+int BasicHashIndex<K>::bucketOf(const KeyType& key) const
+{
+  uint64_t hash = K::hash(key);
+  int bucket = (int)(hash & ((1ULL << level) - 1));
+  if (bucket < next) bucket = (int)(hash & ((2ULL << level) - 1));
+  return bucket;
+}
+
+template<class K>
+RC BasicHashIndex<K>::readDirectory(int d)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  if ((rc = pf.read(directory[d], page)) < 0) return rc;
+  int count = min(DIRECTORY_ENTRIES, (int)buckets.size() - d * DIRECTORY_ENTRIES);
+  memcpy(&buckets[d * DIRECTORY_ENTRIES], page, count * sizeof(PageId));
+  return 0;
+}
+
+// The first page of bucket, from its directory page if not read yet
+template<class K>
+RC BasicHashIndex<K>::firstPage(int bucket, PageId& pid)
+{
+  RC rc;
+  if (buckets[bucket] == NO_PAGE &&
+      (rc = readDirectory(bucket / DIRECTORY_ENTRIES)) < 0) return rc;
+  pid = buckets[bucket];
+  return 0;
+}
+
+template<class K>
+RC BasicHashIndex<K>::readPage(PageId pid, Page& page)
+{
+  RC           rc;
+  char         buffer[PageFile::PAGE_SIZE];
+  BucketHeader header;
+
+  if ((rc = pf.read(pid, buffer)) < 0) return rc;
+  memcpy(&header, buffer, sizeof(header));
+  page.pid = pid;
+  page.overflow = header.overflow;
+  page.keys.resize(header.count);
+  page.rids.resize(header.count);
+  int offset = sizeof(BucketHeader);
+  for (int i = 0; i < header.count; i++) {
+    offset += K::read(buffer + offset, page.keys[i]);
+    memcpy(&page.rids[i], buffer + offset, sizeof(RecordId));
+    offset += sizeof(RecordId);
+  }
+  page.used = offset - sizeof(BucketHeader);
+  return 0;
+}
+
+template<class K>
+RC BasicHashIndex<K>::writePage(const Page& page)
+{
+  char         buffer[PageFile::PAGE_SIZE];
+  BucketHeader header;
+
+  memset(buffer, 0, PageFile::PAGE_SIZE);
+  header.count = page.keys.size();
+  header.overflow = page.overflow;
+  memcpy(buffer, &header, sizeof(header));
+  int offset = sizeof(BucketHeader);
+  for (int i = 0; i < header.count; i++) {
+    K::write(buffer + offset, page.keys[i]);
+    offset += K::size(page.keys[i]);
+    memcpy(buffer + offset, &page.rids[i], sizeof(RecordId));
+    offset += sizeof(RecordId);
+  }
+  return pf.write(page.pid, buffer);
+}
+
+// Keep the page at pid decoded in cursorPage
+template<class K>
+RC BasicHashIndex<K>::loadPage(PageId pid)
+{
+  if (cursorPage.pid == pid) return 0;
+  RC rc = readPage(pid, cursorPage);
+  if (rc < 0) cursorPage.pid = NO_PAGE;
+  return rc;
+}
+
+// Take a free page, or an empty one at the end of the file. The header
+// is written by the caller
+template<class K>
+RC BasicHashIndex<K>::allocatePage(PageId& pid)
+{
+  RC   rc;
+  Page page;
+
+  if (freeList != NO_PAGE) {
+    pid = freeList;
+    if ((rc = readPage(pid, page)) < 0) return rc;
+    freeList = page.overflow;
+    return 0;
+  }
+  // the page is written right away, so that the next one goes after it
+  page.pid = pid = pf.endPid();
+  page.overflow = NO_PAGE;
+  return writePage(page);
+}
+
+template<class K>
+RC BasicHashIndex<K>::freePage(PageId pid)
+{
+  Page page;
+  page.pid = pid;
+  page.overflow = freeList;
+  freeList = pid;
+  return writePage(page);
+}
+
+template<class K>
+RC BasicHashIndex<K>::writeHeader()
+{
+  char       page[PageFile::PAGE_SIZE];
+  HashHeader header;
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  header.level = level;
+  header.next = next;
+  header.bucketCount = buckets.size();
+  header.entryBytes = entryBytes;
+  header.freeList = freeList;
+  header.directoryCount = directory.size();
+  headerDirty = false;
+  memcpy(page, &header, sizeof(header));
+  memcpy(page + sizeof(header), &directory[0], directory.size() * sizeof(PageId));
+  return pf.write(0, page);
+}
+
+// Write the directory page listing bucket, and the header
+template<class K>
+RC BasicHashIndex<K>::writeDirectory(int bucket)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  unsigned d = bucket / DIRECTORY_ENTRIES;
+  if (d == directory.size()) {
+    PageId pid;
+    if ((rc = allocatePage(pid)) < 0) return rc;
+    directory.push_back(pid);
+  }
+  memset(page, 0, PageFile::PAGE_SIZE);
+  int count = min(DIRECTORY_ENTRIES, (int)buckets.size() - (int)d * DIRECTORY_ENTRIES);
+  memcpy(page, &buckets[d * DIRECTORY_ENTRIES], count * sizeof(PageId));
+  if ((rc = pf.write(directory[d], page)) < 0) return rc;
+  return writeHeader();
+}
+
+template<class K>
+RC BasicHashIndex<K>::insert(const KeyType& key, const RecordId& rid)
+{
+  RC   rc;
+  Page page;
+  int  size = K::size(key) + sizeof(RecordId);
+
+  cursorPage.pid = NO_PAGE;
+  // the entry goes to the first page of the bucket. when it is full, a
+  // new page is put in front of it, so that an insert reads one page
+  // however long the chain of a frequent key gets
+  int    bucket = bucketOf(key);
+  PageId pid;
+  if ((rc = firstPage(bucket, pid)) < 0) return rc;
+  if ((rc = readPage(pid, page)) < 0) return rc;
+  if (page.used + size <= BUCKET_BYTES) {
+    page.keys.push_back(key);
+    page.rids.push_back(rid);
+    if ((rc = writePage(page)) < 0) return rc;
+  }
+  else {
+    Page added;
+    if ((rc = allocatePage(added.pid)) < 0) return rc;
+    added.overflow = pid;
+    added.keys.push_back(key);
+    added.rids.push_back(rid);
+    if ((rc = writePage(added)) < 0) return rc;
+    buckets[bucket] = added.pid;
+    if ((rc = writeDirectory(bucket)) < 0) return rc;
+  }
+
+  entryBytes += size;
+  headerDirty = true;
+  if (entryBytes > SPLIT_LOAD * buckets.size() * BUCKET_BYTES) return split();
+  return 0;
+}
+
+// Split bucket next in two: the entries whose hash has bit level set move
+// to a new bucket at the end of the directory
+template<class K>
+RC BasicHashIndex<K>::split()
+{
+  RC rc;
+  const int bucket = next;
+  const int created = next + (1 << level);
+
+  // with a full directory, the buckets only get overflow pages
+  if (created / DIRECTORY_ENTRIES >= MAX_DIRECTORY_PAGES) return 0;
+
+  vector<PageId>   pids;
+  vector<KeyType>  keys[2];
+  vector<RecordId> rids[2];
+  const uint64_t   mask = (2ULL << level) - 1;
+  for (PageId pid = buckets[bucket]; pid != NO_PAGE; ) {
+    Page page;
+    if ((rc = readPage(pid, page)) < 0) return rc;
+    pids.push_back(pid);
+    for (unsigned i = 0; i < page.keys.size(); i++) {
+      int half = ((K::hash(page.keys[i]) & mask) == (uint64_t)bucket) ? 0 : 1;
+      keys[half].push_back(page.keys[i]);
+      rids[half].push_back(page.rids[i]);
+    }
+    pid = page.overflow;
+  }
+
+  // the bucket keeps its pages, but the ones it no longer needs
+  if ((rc = writeEntries(pids, keys[0], rids[0])) < 0) return rc;
+  vector<PageId> createdPids;
+  if ((rc = writeEntries(createdPids, keys[1], rids[1])) < 0) return rc;
+  buckets.push_back(createdPids[0]);
+
+  if (++next == (1 << level)) {
+    level++;
+    next = 0;
+  }
+  return writeDirectory(created);
+}
+
+/*
+ * Write the entries to a chain of bucket pages.
+ * @param pids[IN/OUT] the pages of the chain. pages are added if the
+ *                     entries need more, and freed if they need fewer
+ * @param keys[IN] the keys of the entries
+ * @param rids[IN] the RecordIds of the entries
+ * @return error code. 0 if no error
+ */
+template<class K>
+RC BasicHashIndex<K>::writeEntries(vector<PageId>& pids, const vector<KeyType>& keys,
+                                   const vector<RecordId>& rids)
+{
+  RC       rc;
+  Page     page;
+  unsigned used = 0;  // the position of page in pids
+
+  if (pids.empty()) {
+    PageId pid;
+    if ((rc = allocatePage(pid)) < 0) return rc;
+    pids.push_back(pid);
+  }
+  page.pid = pids[0];
+  page.used = 0;
+  for (unsigned i = 0; i < keys.size(); i++) {
+    int size = K::size(keys[i]) + sizeof(RecordId);
+    if (page.used + size > BUCKET_BYTES) {
+      if (used + 1 == pids.size()) {
+        PageId pid;
+        if ((rc = allocatePage(pid)) < 0) return rc;
+        pids.push_back(pid);
+      }
+      page.overflow = pids[++used];
+      if ((rc = writePage(page)) < 0) return rc;
+      page.pid = pids[used];
+      page.used = 0;
+      page.keys.clear();
+      page.rids.clear();
+    }
+    page.keys.push_back(keys[i]);
+    page.rids.push_back(rids[i]);
+    page.used += size;
+  }
+  page.overflow = NO_PAGE;
+  if ((rc = writePage(page)) < 0) return rc;
+
+  for (unsigned i = used + 1; i < pids.size(); i++) {
+    if ((rc = freePage(pids[i])) < 0) return rc;
+  }
+  pids.resize(used + 1);
+  return 0;
+}
+
+// Move cursor to the first entry with key from the cursor on
+template<class K>
+RC BasicHashIndex<K>::seekKey(IndexCursor& cursor, const KeyType& key)
+{
+  while (cursor.pid != NO_PAGE) {
+    RC rc = loadPage(cursor.pid);
+    if (rc < 0) return rc;
+    for (; cursor.eid < (int)cursorPage.keys.size(); cursor.eid++) {
+      if (cursorPage.keys[cursor.eid] == key) return 0;
+    }
+    cursor.pid = cursorPage.overflow;
+    cursor.eid = 0;
+  }
+  return RC_NO_SUCH_RECORD;
+}
+
+template<class K>
+RC BasicHashIndex<K>::locate(const KeyType& searchKey, IndexCursor& cursor)
+{
+  RC rc = firstPage(bucketOf(searchKey), cursor.pid);
+  if (rc < 0) return rc;
+  cursor.eid = 0;
+  cursor.opid = NO_PAGE;
+  cursor.oeid = 0;
+  cursor.bid = NO_PAGE;
+  cursor.mid = 0;
+  return seekKey(cursor, searchKey);
+}
+
+template<class K>
+RC BasicHashIndex<K>::readForward(IndexCursor& cursor, KeyType& key, RecordId& rid)
+{
+  if (cursor.pid == NO_PAGE) return RC_END_OF_TREE;
+  RC rc = loadPage(cursor.pid);
+  if (rc < 0) return rc;
+  if (cursor.eid >= (int)cursorPage.keys.size()) return RC_INVALID_CURSOR;
+  key = cursorPage.keys[cursor.eid];
+  rid = cursorPage.rids[cursor.eid];
+
+  // past the last entry of the key, the cursor is at the end
+  cursor.eid++;
+  rc = seekKey(cursor, key);
+  return (rc == RC_NO_SUCH_RECORD) ? 0 : rc;
+}
+
+template class BasicHashIndex<IntKey>;
+template class BasicHashIndex<StringKey>;
+template class BasicHashIndex<Int64Key>;
+template class BasicHashIndex<DoubleKey>;
+template class BasicHashIndex<CompositeKey>;
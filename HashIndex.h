@@ -0,0 +1,118 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeKey.h"
+#include "BTreeIndex.h"
+
+/**
+ * A disk-resident hash index for tables that are only searched by key
+ * equality: a lookup reads the bucket page of the key (and its overflow
+ * pages, if any) instead of walking down a tree.
+ * The buckets grow by linear hashing: whenever the entries fill more than
+ * 3/4 of the bucket pages, the next bucket in turn is split in two, so the
+ * file grows one bucket at a time and overflow chains stay rare.
+ * Page 0 of the index file holds the header and the pages of the bucket
+ * directory, which map every bucket to its first page. A lookup reads the
+ * header, one directory page and the pages of one bucket. Bucket pages hold
+ * the entries as the key (see BTreeKey.h) followed by the RecordId.
+ * K is the key traits class (see BTreeKey.h).
+ */
+template<class K>
+class BasicHashIndex {
+ public:
+  typedef typename K::Type KeyType;
+
+  BasicHashIndex();
+
+  /**
+   * Open the index file in read or write mode.
+   * Under 'w' mode, the index file is created if it does not exist.
+   * @param indexname[IN] the name of the index file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& indexname, char mode);
+
+  /**
+   * Close the index file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * Insert (key, RecordId) pair to the index.
+   * @param key[IN] the key for the value inserted into the index
+   * @param rid[IN] the RecordId for the record being inserted into the index
+   * @return error code. 0 if no error
+   */
+  RC insert(const KeyType& key, const RecordId& rid);
+
+  /**
+   * Find the first entry with searchKey, and set cursor to it.
+   * Use readForward() to read the entries with searchKey one by one.
+   * @param searchKey[IN] the key to find
+   * @param cursor[OUT] the cursor pointing to the first entry with searchKey
+   * @return 0 if searchKey is found. RC_NO_SUCH_RECORD otherwise
+   */
+  RC locate(const KeyType& searchKey, IndexCursor& cursor);
+
+  /**
+   * Read the (key, rid) pair at the cursor, and move the cursor forward
+   * to the next entry with the same key.
+   * @param cursor[IN/OUT] the cursor set by locate()
+   * @param key[OUT] the key stored at the cursor
+   * @param rid[OUT] the RecordId stored at the cursor
+   * @return error code. RC_END_OF_TREE once every entry of the key is read
+   */
+  RC readForward(IndexCursor& cursor, KeyType& key, RecordId& rid);
+
+  /**
+   * @return # buckets of the index
+   */
+  int getBucketCount() const { return buckets.size(); }
+
+ private:
+  // the entries of a bucket page
+  struct Page {
+    PageId                pid;
+    PageId                overflow;  // the next page of the bucket
+    int                   used;      // # bytes taken by the entries
+    std::vector<KeyType>  keys;
+    std::vector<RecordId> rids;
+  };
+
+  int  bucketOf(const KeyType& key) const;
+  RC   readDirectory(int d);
+  RC   firstPage(int bucket, PageId& pid);
+  RC   readPage(PageId pid, Page& page);
+  RC   writePage(const Page& page);
+  RC   loadPage(PageId pid);
+  RC   allocatePage(PageId& pid);
+  RC   freePage(PageId pid);
+  RC   writeHeader();
+  RC   writeDirectory(int bucket);
+  RC   writeEntries(std::vector<PageId>& pids, const std::vector<KeyType>& keys,
+                    const std::vector<RecordId>& rids);
+  RC   split();
+  RC   seekKey(IndexCursor& cursor, const KeyType& key);
+
+  PageFile pf;          /// the PageFile of the index
+  int      level;       /// the buckets below next are addressed with
+  int      next;        /// level + 1 bits of the hash, the others with level
+  PageId   freeList;    /// the first page freed by a split, -1 if none
+  int      entryBytes;  /// # bytes taken by all the entries
+  bool     headerDirty; /// true if the header changed since it was written
+  std::vector<PageId> buckets;    /// the first page of every bucket, -1 if
+                                  /// its directory page is not read yet
+  std::vector<PageId> directory;  /// the pages of the bucket directory
+  Page     cursorPage;  /// the page last read by locate() and readForward()
+};
+
+typedef BasicHashIndex<IntKey> HashIndex;
+
+#endif // HASHINDEX_H
@@ -0,0 +1,170 @@
+#include <cstring>
+#include <algorithm>
+#include "LearnedModel.h"
+
+using namespace std;
+
+// the header fields stored at the beginning of page 0
+static const int HEADER_FIELDS = 3;
+
+LearnedModel::LearnedModel()
+{
+  endPid = 0;
+}
+
+void LearnedModel::build(const vector<int64_t>& firstKeys, const vector<PageId>& pids)
+{
+  this->firstKeys = firstKeys;
+  this->pids = pids;
+  segments.clear();
+
+  // Shrinking cone: a segment starts at a leaf and takes the following
+  // leaves as long as some slope predicts all of them within EPSILON.
+  // [lo, hi] is the range of such slopes
+  int n = firstKeys.size();
+  int start = 0;
+  while (start < n) {
+    double lo = 0, hi = 0;
+    bool   bounded = false;
+    int end = start + 1;
+    for (; end < n; end++) {
+      // leaves with the same first key are found from the first of them
+      if (firstKeys[end] == firstKeys[start]) continue;
+      double dx = (double)firstKeys[end] - (double)firstKeys[start];
+      double dy = end - start;
+      double l = (dy - EPSILON) / dx;
+      double h = (dy + EPSILON) / dx;
+      if (bounded && (l > hi || h < lo)) break;
+      lo = bounded ? max(lo, l) : l;
+      hi = bounded ? min(hi, h) : h;
+      bounded = true;
+    }
+    Segment segment;
+    segment.firstKey = firstKeys[start];
+    segment.slope = bounded ? (lo + hi) / 2 : 0;
+    segment.position = start;
+    segments.push_back(segment);
+    start = end;
+  }
+}
+
+int LearnedModel::predict(int64_t key) const
+{
+  // the segments are few; find the last one starting at or before key
+  int s = 0;
+  int count = segments.size();
+  while (count > 1) {
+    int half = count / 2;
+    s = (segments[s + half].firstKey <= key) ? s + half : s;
+    count -= half;
+  }
+  const Segment& segment = segments[s];
+  double position = segment.position + segment.slope * ((double)key - (double)segment.firstKey);
+  int n = firstKeys.size();
+  if (position < 0) return 0;
+  if (position > n - 1) return n - 1;
+  return (int)position;
+}
+
+int LearnedModel::findLeaf(int64_t key) const
+{
+  if (firstKeys.empty()) return -1;
+
+  // look for the first leaf whose first key is not smaller than key
+  // around the prediction
+  int n = firstKeys.size();
+  int position = predict(key);
+  int first = max(0, position - EPSILON);
+  int last = min(n - 1, position + EPSILON + 1);
+  int found = lower_bound(firstKeys.begin() + first, firstKeys.begin() + last + 1, key)
+              - firstKeys.begin();
+
+  // the answer may lie outside of the range searched
+  if (found == first && first > 0) return -1;
+  if (found == last + 1 && last < n - 1) return -1;
+
+  return max(found - 1, 0);
+}
+
+PageId LearnedModel::getLeaf(int position) const
+{
+  return (position < (int)pids.size()) ? pids[position] : -1;
+}
+
+RC LearnedModel::read(const PageFile& pf)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  header[HEADER_FIELDS];
+
+  if ((rc = pf.read(0, page)) < 0) return rc;
+  memcpy(header, page, sizeof(header));
+  if (header[0] < 0 || header[1] < 0 || (header[0] == 0) != (header[1] == 0)) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+  endPid = header[2];
+
+  segments.resize(header[0]);
+  firstKeys.resize(header[1]);
+  pids.resize(header[1]);
+
+  // the three arrays follow each other from page 1
+  if (firstKeys.empty()) return 0;
+  char* dst[3] = { (char*)&segments[0], (char*)&firstKeys[0], (char*)&pids[0] };
+  int   size[3] = { (int)(segments.size() * sizeof(Segment)),
+                    (int)(firstKeys.size() * sizeof(int64_t)),
+                    (int)(pids.size() * sizeof(PageId)) };
+  PageId pid = 1;
+  int    offset = PageFile::PAGE_SIZE;
+  for (int i = 0; i < 3; i++) {
+    for (int done = 0; done < size[i]; ) {
+      if (offset == PageFile::PAGE_SIZE) {
+        if ((rc = pf.read(pid++, page)) < 0) return rc;
+        offset = 0;
+      }
+      int n = min(size[i] - done, PageFile::PAGE_SIZE - offset);
+      memcpy(dst[i] + done, page + offset, n);
+      done += n;
+      offset += n;
+    }
+  }
+
+  return 0;
+}
+
+RC LearnedModel::write(PageFile& pf) const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  header[HEADER_FIELDS] = { (int)segments.size(), (int)firstKeys.size(), endPid };
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, header, sizeof(header));
+  if ((rc = pf.write(0, page)) < 0) return rc;
+  if (firstKeys.empty()) return 0;
+
+  const char* src[3] = { (const char*)&segments[0], (const char*)&firstKeys[0],
+                         (const char*)&pids[0] };
+  int size[3] = { (int)(segments.size() * sizeof(Segment)),
+                  (int)(firstKeys.size() * sizeof(int64_t)),
+                  (int)(pids.size() * sizeof(PageId)) };
+  PageId pid = 1;
+  int    offset = 0;
+  memset(page, 0, PageFile::PAGE_SIZE);
+  for (int i = 0; i < 3; i++) {
+    for (int done = 0; done < size[i]; ) {
+      int n = min(size[i] - done, PageFile::PAGE_SIZE - offset);
+      memcpy(page + offset, src[i] + done, n);
+      done += n;
+      offset += n;
+      if (offset == PageFile::PAGE_SIZE) {
+        if ((rc = pf.write(pid++, page)) < 0) return rc;
+        memset(page, 0, PageFile::PAGE_SIZE);
+        offset = 0;
+      }
+    }
+  }
+  if (offset > 0 && (rc = pf.write(pid, page)) < 0) return rc;
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+#ifndef LEARNEDMODEL_H
+#define LEARNEDMODEL_H
+
+#include <vector>
+#include <stdint.h>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * A learned index over the leaf level of a B+tree with integral keys.
+ * The model maps a key to the position of its leaf in the leaf chain with
+ * a piecewise linear function, built so that the position predicted for
+ * the first key of every leaf is off by at most EPSILON leaves
+ * (a PGM-index with a single level). A lookup checks the first keys of the
+ * few leaves around the prediction instead of walking the internal levels
+ * of the tree.
+ * The model is stored in its own PageFile: page 0 holds the header and
+ * the segments and leaves follow from page 1.
+ */
+class LearnedModel {
+ public:
+
+  // max distance between the predicted and the actual leaf position
+  static const int EPSILON = 2;
+
+  LearnedModel();
+
+  /**
+   * build the model over the leaves of a tree.
+   * @param firstKeys[IN] the first key of every leaf, in leaf chain order
+   * @param pids[IN] the PageId of every leaf, in leaf chain order
+   */
+  void build(const std::vector<int64_t>& firstKeys, const std::vector<PageId>& pids);
+
+  /**
+   * find the leaf where the search for key starts: the last leaf whose
+   * first key is smaller than key, or the first leaf.
+   * @param key[IN] the key to look up
+   * @return the position of the leaf in the leaf chain, or -1 if the leaf
+   *         is not within EPSILON leaves of the prediction
+   */
+  int findLeaf(int64_t key) const;
+
+  /**
+   * @param position[IN] a leaf position returned by findLeaf()
+   * @return the PageId of the leaf, or -1 past the last leaf
+   */
+  PageId getLeaf(int position) const;
+
+  /**
+   * @return the number of leaves the model was built over
+   */
+  int getLeafCount() const { return firstKeys.size(); }
+
+  /**
+   * the size of the index file when the model was saved. a model read
+   * back with an index file of another size is out of date.
+   */
+  PageId getEndPid() const { return endPid; }
+  void setEndPid(PageId pid) { endPid = pid; }
+
+  /**
+   * @return the number of linear segments of the model
+   */
+  int getSegmentCount() const { return segments.size(); }
+
+  /**
+   * read the model from the PageFile.
+   * @param pf[IN] PageFile to read from
+   * @return error code. 0 if no error
+   */
+  RC read(const PageFile& pf);
+
+  /**
+   * write the model to the PageFile.
+   * @param pf[IN] PageFile to write to
+   * @return error code. 0 if no error
+   */
+  RC write(PageFile& pf) const;
+
+ private:
+  // the leaf position of key is predicted as
+  // position + slope * (key - firstKey) for the last segment with
+  // firstKey <= key
+  struct Segment {
+    int64_t firstKey;
+    double  slope;
+    int     position;
+  };
+
+  int predict(int64_t key) const;
+
+  PageId endPid;
+  std::vector<Segment> segments;
+  std::vector<int64_t> firstKeys;  // the first key of every leaf
+  std::vector<PageId>  pids;       // the PageId of every leaf
+};
+
+#endif // LEARNEDMODEL_H
@@ -9,28 +9,111 @@
 
 #include "Bruinbase.h"
 #include "RecordFile.h"
+#include "TupleBatch.h"
 #include <cstring>
+#include <algorithm>
+#include <unistd.h>
 
 using std::string;
 
+//
+// the layout of a page
+//
+
+// the header at the beginning of every page
+struct PageHeader {
+  int            count;      // # records in the page
+  unsigned short dataStart;  // the offset of the first byte used by the records
+  unsigned short layout;     // ROW_LAYOUT or PAX_LAYOUT
+  unsigned int   format;     // PAGE_FORMAT
+};
+
+// the format of the slotted pages, in the header of every page. the pages
+// of fixed slots written by the earlier versions of Bruinbase have the
+// first bytes of the value of a record there instead
+static const unsigned int PAGE_FORMAT = 0xB7E5A001;
+
+// in a ROW_LAYOUT page, the slot directory follows the header. slot n
+// points to record n. a record is the key followed by the value, by an
+// OverflowValue when the slot has the OVERFLOW_BIT, or by the dictionary
+// code of the value when the slot has the CODE_BIT.
+// in a PAX_LAYOUT page, the keys of all the records follow the header,
+// then the slot directory. a slot points to the value of its record only
+struct Slot {
+  unsigned short offset;  // the offset of the record in the page
+  unsigned short length;  // the length of the value
+};
+
+// the value of a record stored in the overflow file
+struct OverflowValue {
+  int    length;  // the length of the value
+  PageId pid;     // the first page of the value. the value is stored
+                  // in consecutive pages
+};
+
+static const unsigned short OVERFLOW_BIT = 0x8000;
+static const unsigned short CODE_BIT     = 0x4000;
+// a slot with both bits is the tombstone of a removed record
+static const unsigned short REMOVED      = OVERFLOW_BIT | CODE_BIT;
+
+// a record of the file of changes: a record updated, removed or moved
+struct Change {
+  RecordId rid;
+  int      how;     // RECORD_UPDATED, RECORD_REMOVED or RECORD_MOVED
+  RecordId target;  // where a moved record is now
+};
+
+static const int RECORD_UPDATED = 1;
+static const int RECORD_REMOVED = 2;
+static const int RECORD_MOVED   = 3;  // only in the file, updated in memory
+
 //
 // helper functions for page manipultation
 //
 
+// get the layout of the page
+static int getLayout(const char* page);
+
 // compute the pointer to the n'th slot in a page
-static char* slotPtr(char* page, int n);
+static Slot* slotPtr(char* page, int n);
+
+// read the key of the n'th record in the page, and point data to the
+// bytes stored for its value. return the OVERFLOW_BIT if they are an
+// OverflowValue, the CODE_BIT if they are a dictionary code, REMOVED if
+// the record was removed, 0 otherwise
+static int recordAt(const char* page, int n, int& key, const char*& data, int& length);
+
+// # bytes a record takes in the page, slot included
+// @param length[IN] # bytes stored for the value
+static int recordSize(int length);
+
+// # bytes stored for the value of a record, from the length in its slot
+static int storedLength(unsigned short slotLength);
+
+// pack the records of the page again from the end of the page, leaving
+// out the removed records and the skip'th record, whose bytes are freed
+static void compactPage(char* page, int skip);
+
+// store the record of the n'th slot in the free space of the page. the
+// page must have room for it
+static void placeRecord(char* page, int n, int key, const char* data, int length,
+                        unsigned short flags);
 
-// read the record in the n'th slot in the page
-static void readSlot(const char* page, int n, int& key, std::string& value);
+// select the records of a PAX_LAYOUT page whose key is in [keyMin, keyMax]
+// and return # records selected
+static int selectKeys(const char* page, int keyMin, int keyMax, int* selected);
 
-// write the record to the n'th slot in the page
-static void writeSlot(char* page, int n, int key, const std::string& value);
+// write the record to the n'th slot in the page, and make it the last
+// record of the page. the page must have room for it. data is stored for
+// the value, and flags (OVERFLOW_BIT or CODE_BIT) tell what it is
+static void writeSlot(char* page, int n, int key, const char* data, int length,
+                      unsigned short flags);
 
 // get # records stored in the page
 static int getRecordCount(const char* page);
 
-// update # records stored in the page
-static void setRecordCount(char* page, int count);
+// get # bytes free in the page
+static int getFreeSpace(const char* page);
 
 
 //
@@ -107,10 +190,26 @@ RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  overflowOpen = false;
+  tailPid = -1;
+  tailDirty = false;
+  zonesValid = zonesDirty = false;
+  dictionaryOn = dictionaryDirty = false;
+  changeCount = 0;
+  compressed = false;
+  layout = ROW_LAYOUT;
 }
 
 RecordFile::RecordFile(const string& filename, char mode)
 {
+  overflowOpen = false;
+  tailPid = -1;
+  tailDirty = false;
+  zonesValid = zonesDirty = false;
+  dictionaryOn = dictionaryDirty = false;
+  changeCount = 0;
+  compressed = false;
+  layout = ROW_LAYOUT;
   open(filename, mode);
 }
 
@@ -121,13 +220,84 @@ RC RecordFile::open(const string& filename, char mode)
 
   // open the page file
   if ((rc = pf.open(filename, mode)) < 0) return rc;
+  name = filename;
+
+  // a compressed file has the offset map of its extents next to it
+  compressed = (::access(ExtentFile::mapName(filename).c_str(), F_OK) == 0);
+  if (compressed) {
+    pf.close();
+    if ((rc = extents.open(filename, mode)) < 0) {
+      compressed = false;
+      return rc;
+    }
+  }
+
+  // the overflow file is created by the first long value
+  overflowName = filename + ".ovf";
+  if (::access(overflowName.c_str(), F_OK) == 0) {
+    if ((rc = overflow.open(overflowName, mode)) < 0) {
+      close();
+      return rc;
+    }
+    overflowOpen = true;
+  }
+
+  // a table with a dictionary has it next to the file
+  dictionaryName = filename + ".dict";
+  dictionary.clear();
+  dictionaryOn = dictionaryDirty = false;
+  if (::access(dictionaryName.c_str(), F_OK) == 0) {
+    PageFile dpf;
+    if ((rc = dpf.open(dictionaryName, 'r')) == 0) {
+      rc = dictionary.read(dpf);
+      dpf.close();
+    }
+    if (rc < 0) {
+      close();
+      return rc;
+    }
+    dictionaryOn = true;
+  }
+
+  // so does a table with records updated or removed, with their list
+  changeName = filename + ".chg";
+  changes.clear();
+  forwards.clear();
+  homes.clear();
+  changed.clear();
+  changeCount = 0;
+  if (::access(changeName.c_str(), F_OK) == 0) {
+    PageFile cpf;
+    if ((rc = cpf.open(changeName, 'r')) == 0) {
+      rc = readChanges(cpf);
+      cpf.close();
+    }
+    if (rc < 0) {
+      close();
+      return rc;
+    }
+  }
+
+  // the zone map is kept up to date only in 'w' mode. it is read here if
+  // it covers every page of the file, and no longer kept otherwise
+  zoneName = filename + ".zone";
+  zones.clear();
+  zonesValid = (mode == 'w' || mode == 'W');
+  zonesDirty = false;
+  if (zonesValid && diskEndPid() > 0) {
+    PageFile zpf;
+    zonesValid = (zpf.open(zoneName, 'r') == 0 && zones.read(zpf) == 0 &&
+                  zones.getPageCount() == diskEndPid());
+    zpf.close();
+  }
   
   //
   // in the rest of this function, we set the end record id
   //
 
   // get the end pid of the file
-  erid.pid = pf.endPid();
+  erid.pid = diskEndPid();
+  layout = ROW_LAYOUT;
 
   // if the end pid is zero, the file is empty.
   // set the end record id to (0, 0).
@@ -139,30 +309,76 @@ RC RecordFile::open(const string& filename, char mode)
   // obtain # records in the last page to set sid of the end record id.
   // read the last page of the file and get # records in the page.
   // remeber that the id of the last page is endPid()-1 not endPid().
-  if ((rc = pf.read(--erid.pid, page)) < 0) {
+  if ((rc = readDisk(--erid.pid, page)) < 0) {
     // an error occurred during page read
     erid.pid = erid.sid = 0;
-    pf.close();
+    close();
     return rc;
   }
 
-  // get # records in the last page
-  erid.sid = getRecordCount(page);
-  if (erid.sid >= RECORDS_PER_PAGE) {
-    // the last page is full. advance the end record id to the next page.
-    erid.pid++;
-    erid.sid = 0;
+  // a file of another format is not read at all
+  PageHeader header;
+  memcpy(&header, page, sizeof(header));
+  if (header.format != PAGE_FORMAT) {
+    erid.pid = erid.sid = 0;
+    close();
+    return RC_INVALID_FILE_FORMAT;
   }
+
+  // get # records in the last page. append() moves on to the next page
+  // when the record does not fit in this one
+  erid.sid = getRecordCount(page);
+
+  // the new pages keep the layout of the last one
+  layout = getLayout(page);
   
   return 0;
 }
 
 RC RecordFile::close()
 {
+  // the last page and the zone map are written only now
+  RC rc = flushTail();
+  if (rc == 0 && zonesValid && zonesDirty) {
+    PageFile zpf;
+    if ((rc = zpf.open(zoneName, 'w')) == 0) {
+      rc = zones.write(zpf);
+      zpf.close();
+    }
+  }
+  if (rc == 0 && dictionaryOn && dictionaryDirty) {
+    PageFile dpf;
+    if ((rc = dpf.open(dictionaryName, 'w')) == 0) {
+      rc = dictionary.write(dpf);
+      dpf.close();
+    }
+  }
+  if (rc == 0 && !changed.empty()) {
+    PageFile cpf;
+    if ((rc = cpf.open(changeName, 'w')) == 0) {
+      rc = appendChanges(cpf);
+      cpf.close();
+    }
+  }
+  zonesValid = zonesDirty = false;
+  dictionaryOn = dictionaryDirty = false;
+  dictionary.clear();
+  changes.clear();
+  forwards.clear();
+  homes.clear();
+  changed.clear();
+  changeCount = 0;
+  tailPid = -1;
   erid.pid = 0;
   erid.sid = 0;
 
-  return pf.close();
+  if (overflowOpen) {
+    overflowOpen = false;
+    overflow.close();
+  }
+  RC closed = compressed ? extents.close() : pf.close();
+  compressed = false;
+  return (rc < 0) ? rc : closed;
 }
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
@@ -175,39 +391,85 @@ RC RecordFile::read(const RecordId& rid, int& key, string& value) const
   if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
   
-  // read the page containing the record
-  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
+  // read the page containing the record, where it was moved to if it was
+  RecordId at = locate(rid);
+  if ((rc = readPage(at.pid, page)) < 0) return rc;
 
   // read the record from the slot in the page
-  readSlot(page, rid.sid, key, value);
+  return readRecord(page, at.sid, key, value);
+}
+
+RC RecordFile::read(const std::vector<RecordId>& rids, std::vector<int>& keys,
+                    std::vector<std::string>& values) const
+{
+  RC     rc;
+  char   page[PageFile::PAGE_SIZE];
+  PageId pid = -1;  // the page currently in the buffer
+
+  keys.resize(rids.size());
+  values.resize(rids.size());
+
+  for (unsigned i = 0; i < rids.size(); i++) {
+    const RecordId& rid = rids[i];
+
+    // check whether the rid is in the valid range
+    if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
+    if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+    if (rid >= erid) return RC_INVALID_RID;
+
+    // read the page only when we move on to another page. a record
+    // moved to the end of the file takes a page read of its own
+    RecordId at = locate(rid);
+    if (at.pid != pid) {
+      if ((rc = readPage(at.pid, page)) < 0) return rc;
+      pid = at.pid;
+    }
+
+    if ((rc = readRecord(page, at.sid, keys[i], values[i])) < 0) return rc;
+  }
 
   return 0;
 }
 
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
+  RC             rc;
+  char           buffer[sizeof(OverflowValue)];
+  const char*    data;
+  int            length;
+  unsigned short flags;
 
-  // unless we are writing to the the first slot of an empty page,
-  // we have to read the page first
-  if (erid.sid > 0) {
-    if ((rc = pf.read(erid.pid, page)) < 0) return rc;
-  } else {
-    // if this is the first slot of an empty page
-    // we can simply initialize the page with zeros
-    memset(page, 0, PageFile::PAGE_SIZE);
+  // a record always fits in an empty page
+  if ((rc = encodeValue(value, PageFile::PAGE_SIZE, buffer, data, length, flags)) < 0) return rc;
+
+  // the records are added to the last page in memory. unless we are
+  // writing to the first slot of an empty page, the page is read once
+  if (erid.sid > 0 && tailPid != erid.pid) {
+    if ((rc = readDisk(erid.pid, tail)) < 0) return rc;
+    tailPid = erid.pid;
+  }
+  // if the record does not fit in the page, it goes to the next one
+  if (erid.sid > 0 && recordSize(length) > getFreeSpace(tail)) {
+    erid.pid++;
+    erid.sid = 0;
+  }
+  if (erid.sid == 0) {
+    // the full page is written, and the next one starts empty
+    if ((rc = flushTail()) < 0) return rc;
+    memset(tail, 0, PageFile::PAGE_SIZE);
+    PageHeader header = { 0, PageFile::PAGE_SIZE, (unsigned short)layout, PAGE_FORMAT };
+    memcpy(tail, &header, sizeof(header));
+    tailPid = erid.pid;
   }
     
   // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
-
-  // the first four bytes in the page stores # records in the page.
-  // update this number.
-  setRecordCount(page, erid.sid + 1);
+  writeSlot(tail, erid.sid, key, data, length, flags);
+  if (zonesValid) {
+    zones.add(erid.pid, key, value.data(), value.size());
+    zonesDirty = true;
+  }
 
-  // write the page to the disk
-  if ((rc = pf.write(erid.pid, page)) < 0) return rc;
+  tailDirty = true;
     
   // we need to output the rid of the record slot
   rid = erid;
@@ -218,11 +480,436 @@ RC RecordFile::append(int key, const std::string& value, RecordId& rid)
   return 0;
 }
 
+RC RecordFile::appendBatch(const int* keys, const std::string* values, int n, RecordId* rids)
+{
+  RC rc;
+
+  // the records fill the last page in memory, so every page is written
+  // once, when the next page is started or when the file is closed
+  for (int i = 0; i < n; i++) {
+    if ((rc = append(keys[i], values[i], rids[i])) < 0) return rc;
+  }
+  return 0;
+}
+
+RC RecordFile::update(const RecordId& rid, const std::string& value)
+{
+  RC             rc;
+  char           page[PageFile::PAGE_SIZE];
+  char           buffer[sizeof(OverflowValue)];
+  const char*    data;
+  int            length;
+  unsigned short flags;
+  int            key;
+
+  RecordId at = locate(rid);
+  if ((rc = readSlot(at, page, key)) < 0) return rc;
+
+  // the old value is dropped, and the new one takes the room left in the
+  // page. a record in a row page needs room for its key too
+  compactPage(page, at.sid);
+  int room = getFreeSpace(page) - ((getLayout(page) == ROW_LAYOUT) ? sizeof(int) : 0);
+  rc = encodeValue(value, room, buffer, data, length, flags);
+  if (rc == RC_NODE_FULL) {
+    // the page has no room even for the location of the value in the
+    // overflow file. the record is moved to the end of the file, and its
+    // slot becomes a tombstone. the record keeps its id, which forwards
+    // to where the record is now
+    Slot slot = { 0, REMOVED };
+    memcpy(slotPtr(page, at.sid), &slot, sizeof(slot));
+    if ((rc = writePage(at.pid, page)) < 0) return rc;
+
+    RecordId target;
+    if ((rc = append(key, value, target)) < 0) return rc;
+    if (at != rid) homes.erase(at);
+    forwards[rid] = target;
+    homes[target] = rid;
+    changes[rid] = RECORD_UPDATED;
+    changed.insert(rid);
+    return 0;
+  }
+  if (rc < 0) return rc;
+  placeRecord(page, at.sid, key, data, length, flags);
+  if ((rc = writePage(at.pid, page)) < 0) return rc;
+
+  // the zone map is written again only if the zone of the page grows
+  if (zonesValid && zones.add(at.pid, key, value.data(), value.size())) {
+    zonesDirty = true;
+  }
+  changes[rid] = RECORD_UPDATED;
+  changed.insert(rid);
+  return 0;
+}
+
+RC RecordFile::remove(const RecordId& rid)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  key;
+
+  RecordId at = locate(rid);
+  if ((rc = readSlot(at, page, key)) < 0) return rc;
+
+  // the bytes of the record are freed, and its slot becomes a tombstone
+  compactPage(page, at.sid);
+  Slot slot = { 0, REMOVED };
+  memcpy(slotPtr(page, at.sid), &slot, sizeof(slot));
+  if ((rc = writePage(at.pid, page)) < 0) return rc;
+
+  if (at != rid) {
+    forwards.erase(rid);
+    homes.erase(at);
+  }
+  changes[rid] = RECORD_REMOVED;
+  changed.insert(rid);
+  return 0;
+}
+
+bool RecordFile::isRemoved(const RecordId& rid) const
+{
+  std::map<RecordId, int>::const_iterator it = changes.find(rid);
+  return it != changes.end() && it->second == RECORD_REMOVED;
+}
+
+bool RecordFile::isUpdated(const RecordId& rid) const
+{
+  std::map<RecordId, int>::const_iterator it = changes.find(rid);
+  return it != changes.end() && it->second == RECORD_UPDATED;
+}
+
+RecordId RecordFile::locate(const RecordId& rid) const
+{
+  std::map<RecordId, RecordId>::const_iterator it = forwards.find(rid);
+  return (it == forwards.end()) ? rid : it->second;
+}
+
+RC RecordFile::readSlot(const RecordId& rid, char* page, int& key) const
+{
+  RC          rc;
+  const char* data;
+  int         length;
+
+  // check whether the rid is in the valid range
+  if (rid.pid < 0 || rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+  if (rid >= erid) return RC_INVALID_RID;
+
+  if ((rc = readPage(rid.pid, page)) < 0) return rc;
+  if (rid.sid >= getRecordCount(page)) return RC_NO_SUCH_RECORD;
+  if (recordAt(page, rid.sid, key, data, length) == REMOVED) return RC_NO_SUCH_RECORD;
+  return 0;
+}
+
+RC RecordFile::encodeValue(const std::string& value, int room, char* buffer,
+                           const char*& data, int& length, unsigned short& flags)
+{
+  RC rc;
+
+  // with a dictionary, the code of the value is stored instead
+  if (dictionaryOn) {
+    if (room < (int)sizeof(int)) return RC_NODE_FULL;
+    int code = dictionary.encode(value);
+    dictionaryDirty = true;
+    memcpy(buffer, &code, sizeof(int));
+    data = buffer;
+    length = sizeof(int);
+    flags = CODE_BIT;
+    return 0;
+  }
+
+  // without, a value longer than MAX_INLINE_LENGTH or than the room in
+  // the page goes to the overflow file first
+  if ((int)value.size() <= MAX_INLINE_LENGTH && (int)value.size() <= room) {
+    data = value.data();
+    length = value.size();
+    flags = 0;
+    return 0;
+  }
+  if (room < (int)sizeof(OverflowValue)) return RC_NODE_FULL;
+
+  OverflowValue location;
+  location.length = value.size();
+  if ((rc = writeOverflow(value, location.pid)) < 0) return rc;
+  memcpy(buffer, &location, sizeof(location));
+  data = buffer;
+  length = sizeof(location);
+  flags = OVERFLOW_BIT;
+  return 0;
+}
+
+RC RecordFile::enableDictionary()
+{
+  // the records already in the file keep their values
+  if (dictionaryOn) return 0;
+  if (erid.pid > 0 || erid.sid > 0) return RC_INVALID_ATTRIBUTE;
+  dictionaryOn = dictionaryDirty = true;
+  return 0;
+}
+
+RC RecordFile::enableCompression()
+{
+  RC rc;
+
+  // the empty PageFile is replaced by an ExtentFile of the same name
+  if (compressed) return 0;
+  if (erid.pid > 0 || erid.sid > 0) return RC_INVALID_ATTRIBUTE;
+  if ((rc = pf.close()) < 0) return rc;
+  if ((rc = extents.open(name, 'w')) < 0) return rc;
+  compressed = true;
+  return 0;
+}
+
+int RecordFile::findCode(const std::string& value) const
+{
+  return dictionaryOn ? dictionary.find(value) : -1;
+}
+
+void RecordFile::setLayout(int layout)
+{
+  this->layout = layout;
+}
+
+RC RecordFile::flushTail()
+{
+  if (!tailDirty) return 0;
+  tailDirty = false;
+  return writeDisk(tailPid, tail);
+}
+
+RC RecordFile::readPage(PageId pid, char* page) const
+{
+  // the last page may not be written yet
+  if (pid == tailPid) {
+    memcpy(page, tail, PageFile::PAGE_SIZE);
+    return 0;
+  }
+  return readDisk(pid, page);
+}
+
+RC RecordFile::writePage(PageId pid, const char* page)
+{
+  // the last page may be kept in memory
+  if (pid == tailPid) {
+    memcpy(tail, page, PageFile::PAGE_SIZE);
+    tailDirty = true;
+    return 0;
+  }
+  return writeDisk(pid, page);
+}
+
+RC RecordFile::readDisk(PageId pid, char* page) const
+{
+  return compressed ? extents.read(pid, page) : pf.read(pid, page);
+}
+
+RC RecordFile::writeDisk(PageId pid, const char* page)
+{
+  return compressed ? extents.write(pid, page) : pf.write(pid, page);
+}
+
+PageId RecordFile::diskEndPid() const
+{
+  return compressed ? extents.endPid() : pf.endPid();
+}
+
+RecordFile::Scanner::Scanner(const RecordFile& rf, Filter filter, void* arg)
+  : rf(rf), filter(filter), arg(arg)
+{
+  cursor.pid = cursor.sid = 0;
+  pid = -1;
+  count = 0;
+  bounded = false;
+  zonesRead = false;
+  selecting = false;
+  code = -1;
+  keysOnly = false;
+}
+
+void RecordFile::Scanner::setBounds(const ZoneMap::Bounds& bounds)
+{
+  this->bounds = bounds;
+  bounded = true;
+
+  // a file open for writing has its zone map in memory
+  if (rf.zonesValid) {
+    zones = rf.zones;
+    zonesRead = true;
+    return;
+  }
+  PageFile zpf;
+  zonesRead = (zpf.open(rf.zoneName, 'r') == 0 && zones.read(zpf) == 0);
+  zpf.close();
+}
+
+RC RecordFile::Scanner::next(RecordId& rid, int& key, const char*& value, int& length)
+{
+  RC rc;
+
+  while (cursor < rf.erid) {
+    // every page is read once, and its records are used in place
+    if (cursor.pid != pid) {
+      if (zonesRead && !zones.mayContain(cursor.pid, bounds)) {
+        cursor.pid++;
+        cursor.sid = 0;
+        continue;
+      }
+      if ((rc = rf.readPage(cursor.pid, page)) < 0) return rc;
+      pid = cursor.pid;
+      count = getRecordCount(page);
+
+      // the keys of a PAX page are checked against the bounds all at once,
+      // and only the records selected are looked at
+      selecting = bounded && getLayout(page) == PAX_LAYOUT;
+      if (selecting) {
+        selectedCount = selectKeys(page, bounds.keyMin, bounds.keyMax, selected);
+        position = 0;
+      }
+    }
+
+    // the next record of the page, if any
+    int sid = -1;
+    if (selecting) {
+      if (position < selectedCount) sid = selected[position++];
+    }
+    else if (cursor.sid < count) {
+      sid = cursor.sid++;
+    }
+    if (sid < 0) {
+      cursor.pid++;
+      cursor.sid = 0;
+      continue;
+    }
+
+    rid.pid = cursor.pid;
+    rid.sid = sid;
+    if (!rf.homes.empty()) {
+      // a record moved here keeps the id of the slot it was appended to
+      std::map<RecordId, RecordId>::const_iterator home = rf.homes.find(rid);
+      if (home != rf.homes.end()) rid = home->second;
+    }
+    code = -1;
+    int flags = recordAt(page, sid, key, value, length);
+    if (flags == REMOVED) continue;
+    if (flags == CODE_BIT) memcpy(&code, value, sizeof(int));
+    if (keysOnly) {
+      // the value is not looked at, and an overflow value is not read
+      value = "";
+      length = 0;
+    }
+    else if (flags == OVERFLOW_BIT) {
+      if ((rc = rf.readOverflow(value, overflowValue)) < 0) return rc;
+      value = overflowValue.data();
+      length = overflowValue.size();
+    }
+    else if (flags == CODE_BIT) {
+      // the value is used in place in the dictionary
+      value = rf.dictionary.decode(code).data();
+      length = rf.dictionary.decode(code).size();
+    }
+    if (filter == NULL || filter(key, value, length, arg)) return 0;
+  }
+  return RC_END_OF_FILE;
+}
+
+RC RecordFile::Scanner::nextBatch(TupleBatch& batch)
+{
+  RC          rc;
+  RecordId    rid;
+  int         key;
+  const char* value;
+  int         length;
+
+  batch.clear();
+  while (!batch.isFull() && (rc = next(rid, key, value, length)) == 0) {
+    batch.add(rid, key, value, length, code);
+  }
+  if (batch.isFull()) return 0;
+  if (rc == RC_END_OF_FILE && batch.getSize() > 0) return 0;
+  return rc;
+}
+
 const RecordId& RecordFile::endRid() const
 {
   return erid;
 }
 
+RC RecordFile::readRecord(const char* page, int n, int& key, std::string& value) const
+{
+  const char* data;
+  int         length;
+
+  // the slot may be past the last record of the page
+  if (n >= getRecordCount(page)) return RC_NO_SUCH_RECORD;
+
+  // read the value, from the page, the overflow file or the dictionary
+  switch (recordAt(page, n, key, data, length)) {
+  case OVERFLOW_BIT:
+    return readOverflow(data, value);
+  case CODE_BIT:
+    int code;
+    memcpy(&code, data, sizeof(int));
+    value = dictionary.decode(code);
+    return 0;
+  case REMOVED:
+    return RC_NO_SUCH_RECORD;
+  }
+  value.assign(data, length);
+  return 0;
+}
+
+RC RecordFile::readOverflow(const char* location, std::string& value) const
+{
+  RC            rc;
+  OverflowValue ovf;
+  char          buffer[PageFile::PAGE_SIZE];
+
+  if (!overflowOpen) return RC_INVALID_FILE_FORMAT;
+  memcpy(&ovf, location, sizeof(ovf));
+  value.resize(ovf.length);
+  for (int offset = 0; offset < ovf.length; offset += PageFile::PAGE_SIZE) {
+    if ((rc = overflow.read(ovf.pid++, buffer)) < 0) return rc;
+    int n = (ovf.length - offset < PageFile::PAGE_SIZE) ? ovf.length - offset : PageFile::PAGE_SIZE;
+    value.replace(offset, PageFile::PAGE_SIZE, buffer, n);
+  }
+  return 0;
+}
+
+RC RecordFile::writeOverflow(const std::string& value, PageId& pid)
+{
+  RC   rc;
+  char buffer[PageFile::PAGE_SIZE];
+
+  if (!overflowOpen) {
+    if ((rc = overflow.open(overflowName, 'w')) < 0) return rc;
+    overflowOpen = true;
+  }
+
+  // the value is written to consecutive pages at the end of the file
+  pid = overflow.endPid();
+  for (unsigned offset = 0; offset < value.size(); offset += PageFile::PAGE_SIZE) {
+    memset(buffer, 0, PageFile::PAGE_SIZE);
+    value.copy(buffer, PageFile::PAGE_SIZE, offset);
+    if ((rc = overflow.write(pid + offset / PageFile::PAGE_SIZE, buffer)) < 0) return rc;
+  }
+  return 0;
+}
+
+static int recordAt(const char* page, int n, int& key, const char*& data, int& length)
+{
+  // compute the location of the record
+  const Slot* slot = slotPtr(const_cast<char*>(page), n);
+  const char* ptr = page + slot->offset;
+
+  if (getLayout(page) == RecordFile::PAX_LAYOUT) {
+    memcpy(&key, page + sizeof(PageHeader) + n * sizeof(int), sizeof(int));
+    data = ptr;
+  } else {
+    memcpy(&key, ptr, sizeof(int));
+    data = ptr + sizeof(int);
+  }
+  length = slot->length & ~REMOVED;
+  return slot->length & REMOVED;
+}
+
 static int getRecordCount(const char* page)
 {
   int count;
@@ -232,47 +919,218 @@ static int getRecordCount(const char* page)
   return count;
 }
 
-static void setRecordCount(char* page, int count)
+static int getLayout(const char* page)
 {
-  // the first four bytes of a page contains # records in the page
-  memcpy(page, &count, sizeof(int));
+  PageHeader header;
+  memcpy(&header, page, sizeof(header));
+  return header.layout;
 }
 
-static char* slotPtr(char* page, int n) 
+static int getFreeSpace(const char* page)
+{
+  // the free space lies between the slot directory and the records.
+  // a PAX page has the keys before the slot directory
+  PageHeader header;
+  memcpy(&header, page, sizeof(header));
+  int perRecord = sizeof(Slot) + ((header.layout == RecordFile::PAX_LAYOUT) ? sizeof(int) : 0);
+  return header.dataStart - (int)sizeof(PageHeader) - header.count * perRecord;
+}
+
+static Slot* slotPtr(char* page, int n) 
 {
   // compute the location of the n'th slot in a page.
-  // remember that the first four bytes in a page is used to store
-  // # records in the page and each slot consists of an integer and
-  // a string of length MAX_VALUE_LENGTH
-  return (page+sizeof(int)) + (sizeof(int)+RecordFile::MAX_VALUE_LENGTH)*n;
+  // remember that the page header comes first, followed by the slots,
+  // or by the keys and then the slots in a PAX page
+  PageHeader header;
+  memcpy(&header, page, sizeof(header));
+  char* slots = page + sizeof(PageHeader);
+  if (header.layout == RecordFile::PAX_LAYOUT) slots += header.count * sizeof(int);
+  return (Slot*)slots + n;
 }
 
-static void readSlot(const char* page, int n, int& key, std::string& value)
+static int selectKeys(const char* page, int keyMin, int keyMax, int* selected)
 {
-  // compute the location of the record
-  char *ptr = slotPtr(const_cast<char*>(page), n);
+  int  count = getRecordCount(page);
+  int  keys[RecordFile::RECORDS_PER_PAGE];
+  char match[RecordFile::RECORDS_PER_PAGE];
 
-  // read the key 
-  memcpy(&key, ptr, sizeof(int));
+  // the comparisons have no branch, so the compiler turns this loop into
+  // vector compares over the key array
+  memcpy(keys, page + sizeof(PageHeader), count * sizeof(int));
+  for (int i = 0; i < count; i++) {
+    match[i] = (keys[i] >= keyMin) & (keys[i] <= keyMax);
+  }
 
-  // read the value
-  value.assign(ptr + sizeof(int));
+  int n = 0;
+  for (int i = 0; i < count; i++) {
+    selected[n] = i;
+    n += match[i];
+  }
+  return n;
 }
 
-static void writeSlot(char* page, int n, int key, const std::string& value)
+static int recordSize(int length)
 {
-  // compute the location of the record
-  char *ptr = slotPtr(page, n);
+  // the slot, the key and the bytes stored for the value
+  return sizeof(Slot) + sizeof(int) + length;
+}
+
+static int storedLength(unsigned short slotLength)
+{
+  // the length of an OverflowValue or a code is known from the flag
+  switch (slotLength & REMOVED) {
+  case OVERFLOW_BIT:
+    return sizeof(OverflowValue);
+  case CODE_BIT:
+    return sizeof(int);
+  case REMOVED:
+    return 0;
+  }
+  return slotLength;
+}
+
+static void compactPage(char* page, int skip)
+{
+  PageHeader header;
+  char       copy[PageFile::PAGE_SIZE];
 
-  // store the key
-  memcpy(ptr, &key, sizeof(int));
+  memcpy(&header, page, sizeof(header));
+  memcpy(copy, page, PageFile::PAGE_SIZE);
+  int keyLength = (header.layout == RecordFile::PAX_LAYOUT) ? 0 : sizeof(int);
 
-  // store the value. 
-  if ((int)value.size() >= RecordFile::MAX_VALUE_LENGTH) {
-    // when the string is longer than MAX_VALUE_LENGTH, truncate it.
-    memcpy(ptr + sizeof(int), value.c_str(), RecordFile::MAX_VALUE_LENGTH -1);
-    *(ptr + sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1) = 0;
-  } else {
-    strcpy(ptr + sizeof(int), value.c_str());
+  // the records only move towards the end of the page, so the slots are
+  // updated in place. the bytes freed are cleared
+  char* end = (char*)slotPtr(page, header.count);
+  header.dataStart = PageFile::PAGE_SIZE;
+  for (int n = 0; n < header.count; n++) {
+    Slot* slot = slotPtr(page, n);
+    if (n == skip || (slot->length & REMOVED) == REMOVED) continue;
+    int size = keyLength + storedLength(slot->length);
+    header.dataStart -= size;
+    memcpy(page + header.dataStart, copy + slot->offset, size);
+    slot->offset = header.dataStart;
   }
+  memset(end, 0, page + header.dataStart - end);
+  memcpy(page, &header, sizeof(header));
+}
+
+static void placeRecord(char* page, int n, int key, const char* data, int length,
+                        unsigned short flags)
+{
+  PageHeader header;
+  Slot       slot;
+
+  // the record is stored right before the records already in the page,
+  // with its key unless the page keeps the keys together
+  memcpy(&header, page, sizeof(header));
+  bool withKey = (header.layout != RecordFile::PAX_LAYOUT);
+  header.dataStart -= length + (withKey ? sizeof(int) : 0);
+  char* ptr = page + header.dataStart;
+  if (withKey) {
+    memcpy(ptr, &key, sizeof(int));
+    ptr += sizeof(int);
+  }
+  memcpy(ptr, data, length);
+  memcpy(page, &header, sizeof(header));
+
+  // the slot has the length of the value, or the flag of what is stored
+  slot.offset = header.dataStart;
+  slot.length = flags ? flags : length;
+  memcpy(slotPtr(page, n), &slot, sizeof(slot));
+}
+
+static void writeSlot(char* page, int n, int key, const char* data, int length,
+                      unsigned short flags)
+{
+  PageHeader header;
+
+  // in a PAX page the key goes to the end of the keys, and the slots move
+  // over to make room for it
+  memcpy(&header, page, sizeof(header));
+  if (header.layout == RecordFile::PAX_LAYOUT) {
+    char* keys = page + sizeof(PageHeader);
+    memmove(keys + (n + 1) * sizeof(int), keys + n * sizeof(int), n * sizeof(Slot));
+    memcpy(keys + n * sizeof(int), &key, sizeof(int));
+  }
+  header.count = n + 1;
+  memcpy(page, &header, sizeof(header));
+
+  placeRecord(page, n, key, data, length, flags);
+}
+
+RC RecordFile::readChanges(const PageFile& pf)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  count;
+  const int CHANGES_PER_PAGE = PageFile::PAGE_SIZE / sizeof(Change);
+
+  // page 0 holds # changes, and the changes start from page 1
+  if ((rc = pf.read(0, page)) < 0) return rc;
+  memcpy(&count, page, sizeof(int));
+  if (count < 0 || (count + CHANGES_PER_PAGE - 1) / CHANGES_PER_PAGE + 1 > pf.endPid()) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  changes.clear();
+  forwards.clear();
+  homes.clear();
+  changeCount = count;
+  for (int i = 0; i < count; i++) {
+    if (i % CHANGES_PER_PAGE == 0 && (rc = pf.read(1 + i / CHANGES_PER_PAGE, page)) < 0) return rc;
+    Change change;
+    memcpy(&change, page + (i % CHANGES_PER_PAGE) * sizeof(Change), sizeof(change));
+
+    // a record that was moved before forwards to where it is now
+    std::map<RecordId, RecordId>::iterator it = forwards.find(change.rid);
+    if (it != forwards.end()) {
+      homes.erase(it->second);
+      forwards.erase(it);
+    }
+    if (change.how == RECORD_MOVED) {
+      forwards[change.rid] = change.target;
+      homes[change.target] = change.rid;
+      changes[change.rid] = RECORD_UPDATED;
+    }
+    else {
+      changes[change.rid] = change.how;
+    }
+  }
+  return 0;
+}
+
+RC RecordFile::appendChanges(PageFile& pf)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  i = changeCount;
+  const int CHANGES_PER_PAGE = PageFile::PAGE_SIZE / sizeof(Change);
+
+  // the records changed since the file was opened are listed after the
+  // changes already in the file, and override them when the file is
+  // read. the last page is read first if it is partly filled
+  memset(page, 0, PageFile::PAGE_SIZE);
+  if (i % CHANGES_PER_PAGE != 0 && (rc = pf.read(1 + i / CHANGES_PER_PAGE, page)) < 0) return rc;
+
+  int count = changeCount + changed.size();
+  for (std::set<RecordId>::const_iterator it = changed.begin(); it != changed.end(); ++it, ++i) {
+    Change change = { *it, changes.find(*it)->second, *it };
+    std::map<RecordId, RecordId>::const_iterator forward = forwards.find(*it);
+    if (forward != forwards.end()) {
+      change.how = RECORD_MOVED;
+      change.target = forward->second;
+    }
+    memcpy(page + (i % CHANGES_PER_PAGE) * sizeof(Change), &change, sizeof(change));
+    if (i % CHANGES_PER_PAGE == CHANGES_PER_PAGE - 1 || i == count - 1) {
+      if ((rc = pf.write(1 + i / CHANGES_PER_PAGE, page)) < 0) return rc;
+      memset(page, 0, PageFile::PAGE_SIZE);
+    }
+  }
+
+  // page 0 holds # changes, and is written last
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, &count, sizeof(int));
+  if ((rc = pf.write(0, page)) < 0) return rc;
+  changeCount = count;
+  return 0;
 }
@@ -10,8 +10,15 @@
 #ifndef RECORDFILE_H
 #define RECORDFILE_H
 
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
+#include <cstddef>
 #include "PageFile.h"
+#include "ExtentFile.h"
+#include "ZoneMap.h"
+#include "Dictionary.h"
 
 /**
  * The data structure for pointing to a particular record in a RecordFile.
@@ -38,19 +45,50 @@ bool operator<= (const RecordId& r1, const RecordId& r2);
 bool operator== (const RecordId& r1, const RecordId& r2);
 bool operator!= (const RecordId& r1, const RecordId& r2);
 
+class TupleBatch;
+
 /**
- * read/write a record to a file
+ * read/write a record to a file.
+ * every page is a slotted page: a header with # records in the page, a
+ * directory of slots pointing to the records, and the records themselves,
+ * packed from the end of the page. a record takes only the bytes of its
+ * key and value. values longer than MAX_INLINE_LENGTH are stored in the
+ * overflow file (the file name + ".ovf"), and the record points to them.
+ * append() also keeps the zone map of the file (see ZoneMap.h), stored
+ * in the file name + ".zone" when the file is closed.
+ * a file may store the values by their code in a dictionary (see
+ * Dictionary.h), stored in the file name + ".dict".
+ * a file may also store its pages compressed, in an ExtentFile (see
+ * ExtentFile.h), instead of a PageFile. such a file has the offset map
+ * of its extents next to it.
+ * a record may be updated or removed in place, and keeps its record id.
+ * a removed record leaves a tombstone in its slot, and the bytes of the
+ * records no longer used are reclaimed when their page is written again.
+ * a record whose new value does not fit in its page is moved to the end
+ * of the file, and its record id forwards to where it is now.
+ * the records updated, removed or moved are listed in the file name +
+ * ".chg", so that the indexes of the file, whose entries still point to
+ * them, can tell them apart without reading the page. the list is read
+ * when the file is opened, and the records changed since are appended
+ * to it when the file is closed.
  */
 class RecordFile {
  public:
 
-  // maximum length of the value field
-  static const int MAX_VALUE_LENGTH = 100;  
+  // maximum length of a value stored in the page of its record
+  static const int MAX_INLINE_LENGTH = 200;
+
+  // the layouts of a page. a ROW_LAYOUT page stores every key next to its
+  // value. a PAX_LAYOUT page stores the keys together in one array and the
+  // values after them, so the keys of a page are scanned without the values
+  static const int ROW_LAYOUT = 0;
+  static const int PAX_LAYOUT = 1;
 
-  // number of record slots per page
-  static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int))/ (sizeof(int) + MAX_VALUE_LENGTH);  
-    // Note that we subtract sizeof(int) from PAGE_SIZE because the first
-    // four bytes in the page is used to store # records in the page.
+  // maximum number of records per page, all with an empty value
+  static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - 3 * sizeof(int)) / (2 * sizeof(int));
+    // Note that we subtract 3 * sizeof(int) from PAGE_SIZE because the
+    // first twelve bytes in the page are the page header, and that every
+    // record takes at least a slot (sizeof(int)) and its key (sizeof(int)).
 
   RecordFile();
   RecordFile(const std::string& filename, char mode);
@@ -60,7 +98,8 @@ class RecordFile {
    * when opened in 'w' mode, if the file does not exist, it is created.
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
-   * @return error code. 0 if no error
+   * @return error code. 0 if no error. RC_INVALID_FILE_FORMAT if the
+   *         pages of the file are not slotted pages of this format
    */
   RC open(const std::string& filename, char mode);
 
@@ -75,14 +114,31 @@ class RecordFile {
    * @param rid[IN] the id of the record to read
    * @param key[OUT] the record key
    * @param value[OUT] the record valu
-   * @return error code. 0 if no error
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the page of rid
+   *         holds fewer records than rid.sid + 1, so that a scan can move
+   *         on to the next page, or if the record was removed
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read a set of records from the file. a page is read again only when
+   * the page id changes from one record to the next, so the rids should be
+   * sorted to read every page once.
+   * @param rids[IN] the ids of the records to read
+   * @param keys[OUT] the record keys, in the order of rids
+   * @param values[OUT] the record values, in the order of rids
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if one of the
+   *         records was removed
+   */
+  RC read(const std::vector<RecordId>& rids, std::vector<int>& keys,
+          std::vector<std::string>& values) const;
+
   /**
    * append a new record at the end of the file.
-   * note that RecordFile does not have write() function.
-   * append is the only way to write a record to a RecordFile.
+   * a record is written to the file by append() only, and is changed
+   * later by update() and remove().
+   * the record is added to the last page in memory, which is written to
+   * the disk when the next page is started or when the file is closed.
    * @param key[IN] the record key
    * @param value[IN] the record value
    * @param rid[OUT] the location of the stored record
@@ -90,6 +146,195 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * append n records at the end of the file.
+   * the records are added to the last page in memory, and a page is
+   * written to the disk once, when it is full or when the file is closed.
+   * @param keys[IN] the record keys
+   * @param values[IN] the record values
+   * @param n[IN] # records to append
+   * @param rids[OUT] the locations of the stored records
+   * @return error code. 0 if no error
+   */
+  RC appendBatch(const int* keys, const std::string* values, int n, RecordId* rids);
+
+  /**
+   * replace the value of a record. the record keeps its id and its key,
+   * and its page is written once. the page is compacted first if the new
+   * value does not fit in its free space, and a value that still does not
+   * fit is stored in the overflow file. if the page has no room even for
+   * the location of the value in the overflow file, the record is moved
+   * to the end of the file.
+   * @param rid[IN] the id of the record to update
+   * @param value[IN] the new value
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         was removed
+   */
+  RC update(const RecordId& rid, const std::string& value);
+
+  /**
+   * remove a record. its slot is kept as a tombstone, so that the other
+   * records of the page keep their id, and its page is written once.
+   * @param rid[IN] the id of the record to remove
+   * @return error code. 0 if no error. RC_NO_SUCH_RECORD if the record
+   *         was removed already
+   */
+  RC remove(const RecordId& rid);
+
+  /**
+   * @param rid[IN] a record id
+   * @return true if the record was removed
+   */
+  bool isRemoved(const RecordId& rid) const;
+
+  /**
+   * @param rid[IN] a record id
+   * @return true if the value of the record was updated since it was appended
+   */
+  bool isUpdated(const RecordId& rid) const;
+
+  /**
+   * @return # entries in the file of changes, including those appended
+   *         to it when the file is closed
+   */
+  int getChangeCount() const { return changeCount + changed.size(); }
+
+  /**
+   * store the values of the records appended from now on by their code
+   * in the dictionary of the file. the file keeps its dictionary when it
+   * is opened again.
+   * @return error code. RC_INVALID_ATTRIBUTE if the file has records
+   *         stored without a dictionary
+   */
+  RC enableDictionary();
+
+  /**
+   * @param value[IN] the value to look for
+   * @return the dictionary code of the value. -1 if the file has no
+   *         dictionary or if no record has the value
+   */
+  int findCode(const std::string& value) const;
+
+  /**
+   * @return true if the values are stored by their dictionary code
+   */
+  bool hasDictionary() const { return dictionaryOn; }
+
+  /**
+   * store the pages of the file compressed. the file is compressed from
+   * its first page, so it must be empty and open for writing. the file
+   * stays compressed when it is opened again.
+   * @return error code. RC_INVALID_ATTRIBUTE if the file has records
+   */
+  RC enableCompression();
+
+  /**
+   * @return true if the pages are stored compressed
+   */
+  bool isCompressed() const { return compressed; }
+
+  /**
+   * set the layout of the pages appended from now on.
+   * when a file is opened, the layout is that of its last page.
+   * read() and Scanner read the pages of both layouts.
+   * @param layout[IN] ROW_LAYOUT or PAX_LAYOUT
+   */
+  void setLayout(int layout);
+
+  /**
+   * @return the layout of the pages appended from now on
+   */
+  int getPageLayout() const { return layout; }
+
+  /**
+   * reads the records of a RecordFile in order, one page at a time.
+   * the records are not copied: the value returned by next() points to
+   * the page in the scanner, so it is valid until the next call only.
+   */
+  class Scanner {
+   public:
+    /**
+     * a filter on the records. a record is returned by next() only if
+     * the filter returns true for it.
+     * @param key[IN] the record key
+     * @param value[IN] the record value. it is not null-terminated
+     * @param length[IN] the length of the value
+     * @param arg[IN] the argument given to the scanner
+     */
+    typedef bool (*Filter)(int key, const char* value, int length, void* arg);
+
+    /**
+     * @param rf[IN] the open RecordFile to scan
+     * @param filter[IN] the filter on the records, NULL for none
+     * @param arg[IN] the argument passed to the filter
+     */
+    Scanner(const RecordFile& rf, Filter filter = NULL, void* arg = NULL);
+
+    /**
+     * move to the next record that passes the filter.
+     * @param rid[OUT] the id of the record
+     * @param key[OUT] the record key
+     * @param value[OUT] the record value, valid until the next call
+     * @param length[OUT] the length of the value
+     * @return error code. RC_END_OF_FILE after the last record
+     */
+    RC next(RecordId& rid, int& key, const char*& value, int& length);
+
+    /**
+     * read the next records that pass the filter into the batch (see
+     * TupleBatch.h), until the batch is full or the file ends. the batch
+     * is cleared first, and all the records read are selected.
+     * @param batch[OUT] the records read, with the codes of their values
+     * @return error code. RC_END_OF_FILE if no record is left
+     */
+    RC nextBatch(TupleBatch& batch);
+
+    /**
+     * skip the pages whose zone shows that none of their records is
+     * within the bounds, and the records of a PAX_LAYOUT page whose key
+     * is not within them. the zone map is read from the disk by this call,
+     * unless the file is open for writing, and the scan reads every page
+     * if the file has none.
+     * @param bounds[IN] the bounds of the records looked for
+     */
+    void setBounds(const ZoneMap::Bounds& bounds);
+
+    /**
+     * scan the keys only. the values are then neither read from the
+     * overflow file nor decoded from the dictionary, and every record is
+     * returned, and given to the filter, with an empty value. the codes of
+     * the values are still available.
+     * @param keysOnly[IN] true to scan the keys only
+     */
+    void setKeysOnly(bool keysOnly) { this->keysOnly = keysOnly; }
+
+    /**
+     * @return the dictionary code of the value of the record last looked
+     *         at, by next() or by the filter. -1 if the value has no code
+     */
+    int valueCode() const { return code; }
+
+   private:
+    const RecordFile& rf;
+    Filter      filter;
+    void*       arg;
+    RecordId    cursor;         // the next record to look at
+    PageId      pid;            // the page in the buffer, -1 if none
+    int         count;          // # records in the page
+    char        page[PageFile::PAGE_SIZE];
+    std::string overflowValue;  // the last value read from the overflow file
+    ZoneMap     zones;          // the zone map of the file
+    ZoneMap::Bounds bounds;     // the bounds set by setBounds()
+    bool        bounded;        // true if setBounds() was called
+    bool        zonesRead;      // true if the zone map was read
+    bool        selecting;      // true if the page has its records selected
+    int         selected[RECORDS_PER_PAGE];  // the records selected in the page
+    int         selectedCount;  // # records selected
+    int         position;       // the next record to return in selected
+    int         code;           // the code of the value of the record
+    bool        keysOnly;       // true if the values are not read
+  };
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
    * @return (last record id + 1) of the RecordFile
@@ -97,8 +342,53 @@ class RecordFile {
   const RecordId& endRid() const;
 
  private:
+  RC readPage(PageId pid, char* page) const;
+  RC writePage(PageId pid, const char* page);
+  RecordId locate(const RecordId& rid) const;
+  RC readSlot(const RecordId& rid, char* page, int& key) const;
+  RC encodeValue(const std::string& value, int room, char* buffer,
+                 const char*& data, int& length, unsigned short& flags);
+  RC readDisk(PageId pid, char* page) const;
+  RC writeDisk(PageId pid, const char* page);
+  PageId diskEndPid() const;
+  RC flushTail();
+  RC readRecord(const char* page, int n, int& key, std::string& value) const;
+  RC readOverflow(const char* location, std::string& value) const;
+  RC writeOverflow(const std::string& value, PageId& pid);
+  RC readChanges(const PageFile& pf);
+  RC appendChanges(PageFile& pf);
+
   PageFile pf;     // the PageFile used to store the records
+  ExtentFile extents;   // the ExtentFile used instead if compressed
+  bool     compressed;  // true if the pages are stored in extents
+  std::string name;     // the name of the file
   RecordId erid;   // the last record id of the file + 1
+  int      layout; // the layout of the new pages
+
+  char     tail[PageFile::PAGE_SIZE];  // the last page, filled by append()
+  PageId   tailPid;     // the id of the page in tail, -1 if none
+  bool     tailDirty;   // true if tail is not written to the disk yet
+
+  PageFile    overflow;      // the PageFile of the values too long for a page
+  bool        overflowOpen;  // true if the overflow file is open
+  std::string overflowName;  // the name of the overflow file
+
+  ZoneMap     zones;       // the zone map, kept up to date by append()
+  bool        zonesValid;  // false if the file has pages without a zone
+  bool        zonesDirty;  // true if the zone map changed since it was read
+  std::string zoneName;    // the name of the zone map file
+
+  Dictionary  dictionary;       // the codes of the values
+  bool        dictionaryOn;     // true if the values are stored by their code
+  bool        dictionaryDirty;  // true if the dictionary changed since it was read
+  std::string dictionaryName;   // the name of the dictionary file
+
+  std::map<RecordId, int> changes;  // the records updated or removed, and how
+  std::map<RecordId, RecordId> forwards;  // where the moved records are now
+  std::map<RecordId, RecordId> homes;     // the ids of the moved records, by where they are
+  std::set<RecordId> changed;  // the records changed since the file was opened
+  int         changeCount;   // # changes in the file of changes
+  std::string changeName;    // the name of the file of changes
 };
 
 #endif // RECORDFILE_H
@@ -13,9 +13,14 @@
 #include <iostream>
 #include <fstream>
 #include <climits>
+#include <algorithm>
+#include <set>
+#include <unistd.h>
 #include "Bruinbase.h"
 #include "SqlEngine.h"
 #include "BTreeIndex.h"
+#include "HashIndex.h"
+#include "TupleBatch.h"
 
 using namespace std;
 
@@ -23,6 +28,489 @@ using namespace std;
 extern FILE* sqlin;
 int sqlparse(void);
 
+// # tuples collected by an index range scan before their values are
+// read from the table in RecordId order
+static const unsigned FETCH_BATCH_SIZE = 4096;
+
+// a tuple located through an index which may still have to be read
+// from the table
+struct IndexedTuple {
+  int      key;
+  RecordId rid;
+  string   value;
+  bool     complete;  // true if key and value are those of the tuple
+};
+
+// the comparators of the conditions. every condition is compiled into the
+// instances of its comparator, so a running query never looks at
+// SelCond::Comparator again
+struct Equal        { bool operator()(int a, int b) const { return a == b; } };
+struct NotEqual     { bool operator()(int a, int b) const { return a != b; } };
+struct Less         { bool operator()(int a, int b) const { return a < b; } };
+struct Greater      { bool operator()(int a, int b) const { return a > b; } };
+struct LessEqual    { bool operator()(int a, int b) const { return a <= b; } };
+struct GreaterEqual { bool operator()(int a, int b) const { return a >= b; } };
+
+// compare a value that is not null-terminated with a condition value of
+// n bytes, the way strcmp() does
+static int compareValue(const char* value, int length, const char* s, int n)
+{
+  int diff = memcmp(value, s, min(length, n));
+  return (diff != 0) ? diff : length - n;
+}
+
+// check the comparator on a and b
+template<class Compare>
+static bool holds(int a, int b)
+{
+  return Compare()(a, b);
+}
+
+// keep the tuples of the selection vector whose entry in the column
+// compares with the constant as Compare says, and return how many are
+// kept. the loop has no branch, so that it runs as a tight loop
+template<class Compare>
+static int selectColumn(const int* column, int constant, int* selected, int n)
+{
+  Compare compare;
+  int     m = 0;
+  for (int i = 0; i < n; i++) {
+    selected[m] = selected[i];
+    m += compare(column[selected[i]], constant);
+  }
+  return m;
+}
+
+// the same for the values of the batch, compared with a condition value
+// of length bytes
+template<class Compare>
+static int selectValues(const TupleBatch& batch, const char* value, int length,
+                        int* selected, int n)
+{
+  Compare compare;
+  int     m = 0;
+  for (int i = 0; i < n; i++) {
+    int t = selected[i];
+    selected[m] = t;
+    m += compare(compareValue(batch.getValue(t), batch.getLength(t), value, length), 0);
+  }
+  return m;
+}
+
+// a condition of the WHERE clause, compiled by prepareConditions()
+struct Condition {
+  int         attr;      // 1 - key column, 2 - value column
+  SelCond::Comparator comp;
+  int         constant;  // the key compared with, or the dictionary code of
+                         // the value compared with if coded
+  const char* value;     // the value compared with
+  int         length;    // the length of value
+  bool        coded;     // true if the codes of the values are compared
+  bool (*holds)(int a, int b);
+  int  (*selectColumn)(const int* column, int constant, int* selected, int n);
+  int  (*selectValues)(const TupleBatch& batch, const char* value, int length,
+                       int* selected, int n);
+};
+
+// the WHERE clause of a query, compiled once before the query runs. the
+// conditions on key and on value are also summed up in the ranges used
+// by the indexes and the zone map. the bounds of the ranges are inclusive
+struct Predicate {
+  vector<Condition> cond;
+  bool   never;          // true if no tuple can meet the conditions
+  bool   keyEquality;    // true if there is an equality on key
+  int    keyMatch;
+  bool   keyRange;       // true if there is a range on key
+  int    keyMin;
+  int    keyMax;
+  bool   valueEquality;  // true if there is an equality on value
+  string valueMatch;
+  bool   valueRange;     // true if there is a range on value
+  string valueMin;       // "" is the smallest value
+  string valueMax;
+  bool   valueMaxSet;
+};
+
+// set the comparator of a condition
+template<class Compare>
+static void setComparator(Condition& c)
+{
+  c.holds = holds<Compare>;
+  c.selectColumn = selectColumn<Compare>;
+  c.selectValues = selectValues<Compare>;
+}
+
+// compile the conditions of a query. the constants on key are parsed once
+// here, and the conditions that contradict each other, like key > 10 AND
+// key < 5, make the predicate never true, so that the query reads nothing
+static void prepareConditions(const vector<SelCond>& cond, Predicate& p)
+{
+  p.cond.resize(cond.size());
+  p.never = false;
+  p.keyEquality = p.keyRange = false;
+  p.keyMatch = 0;
+  p.keyMin = INT_MIN;
+  p.keyMax = INT_MAX;
+  p.valueEquality = p.valueRange = p.valueMaxSet = false;
+  p.valueMatch = p.valueMin = p.valueMax = "";
+
+  for (unsigned i = 0; i < cond.size(); i++) {
+    Condition& c = p.cond[i];
+    c.attr = cond[i].attr;
+    c.comp = cond[i].comp;
+    c.value = cond[i].value;
+    c.length = strlen(cond[i].value);
+    c.coded = false;
+    switch (c.comp) {
+    case SelCond::EQ: setComparator<Equal>(c); break;
+    case SelCond::NE: setComparator<NotEqual>(c); break;
+    case SelCond::LT: setComparator<Less>(c); break;
+    case SelCond::GT: setComparator<Greater>(c); break;
+    case SelCond::LE: setComparator<LessEqual>(c); break;
+    case SelCond::GE: setComparator<GreaterEqual>(c); break;
+    }
+
+    if (c.attr == 1) {
+      int val = c.constant = atoi(c.value);
+      switch (c.comp) {
+      case SelCond::EQ:
+        if (p.keyEquality && p.keyMatch != val) p.never = true;
+        p.keyEquality = true;
+        p.keyMatch = val;
+        break;
+      case SelCond::GT:
+        p.keyRange = true;
+        if (val == INT_MAX) p.never = true;
+        else if (val+1 > p.keyMin) p.keyMin = val+1;
+        break;
+      case SelCond::LT:
+        p.keyRange = true;
+        if (val == INT_MIN) p.never = true;
+        else if (val-1 < p.keyMax) p.keyMax = val-1;
+        break;
+      case SelCond::GE:
+        p.keyRange = true;
+        if (val > p.keyMin) p.keyMin = val;
+        break;
+      case SelCond::LE:
+        p.keyRange = true;
+        if (val < p.keyMax) p.keyMax = val;
+        break;
+      default:
+        break;
+      }
+    }
+    else {
+      c.constant = -1;
+      switch (c.comp) {
+      case SelCond::EQ:
+        if (p.valueEquality && p.valueMatch != c.value) p.never = true;
+        p.valueEquality = true;
+        p.valueMatch = c.value;
+        break;
+      case SelCond::GT:
+      case SelCond::GE:
+        p.valueRange = true;
+        if (p.valueMin < c.value) p.valueMin = c.value;
+        break;
+      case SelCond::LT:
+      case SelCond::LE:
+        p.valueRange = true;
+        if (!p.valueMaxSet || c.value < p.valueMax) p.valueMax = c.value;
+        p.valueMaxSet = true;
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  // an equality out of the range, or one with an inequality on the same
+  // constant, is never true either
+  if (p.keyMin > p.keyMax) p.never = true;
+  if (p.keyEquality && (p.keyMatch < p.keyMin || p.keyMatch > p.keyMax)) p.never = true;
+  if (p.valueMaxSet && p.valueMax < p.valueMin) p.never = true;
+  if (p.valueEquality &&
+      (p.valueMatch < p.valueMin || (p.valueMaxSet && p.valueMax < p.valueMatch))) {
+    p.never = true;
+  }
+  for (unsigned i = 0; i < p.cond.size(); i++) {
+    const Condition& c = p.cond[i];
+    if (c.comp != SelCond::NE) continue;
+    if (c.attr == 1 && p.keyEquality && c.constant == p.keyMatch) p.never = true;
+    if (c.attr == 2 && p.valueEquality && p.valueMatch == c.value) p.never = true;
+  }
+}
+
+// check the conditions on a tuple of a sequential scan, in its page.
+// arg is the vector of the compiled conditions
+static bool conditionsHold(int key, const char* value, int length, void* arg)
+{
+  const vector<Condition>& cond = *(const vector<Condition>*)arg;
+  for (unsigned i = 0; i < cond.size(); i++) {
+    const Condition& c = cond[i];
+    bool match = (c.attr == 1) ? c.holds(key, c.constant)
+                               : c.holds(compareValue(value, length, c.value, c.length), 0);
+    if (!match) return false;
+  }
+  return true;
+}
+
+// narrow the selection of the batch down to the tuples that meet the
+// conditions, one condition at a time over a whole column. the coded
+// conditions compare the codes of the batch
+static void filterBatch(TupleBatch& batch, const vector<Condition>& cond)
+{
+  int* selected = batch.getSelected();
+  int  n = batch.getSelectedCount();
+  for (unsigned i = 0; i < cond.size() && n > 0; i++) {
+    const Condition& c = cond[i];
+    if (c.attr == 1) {
+      n = c.selectColumn(batch.getKeys(), c.constant, selected, n);
+    }
+    else if (c.coded) {
+      n = c.selectColumn(batch.getCodes(), c.constant, selected, n);
+    }
+    else {
+      n = c.selectValues(batch, c.value, c.length, selected, n);
+    }
+  }
+  batch.setSelectedCount(n);
+}
+
+// print the selected tuples of the batch in their order, and count them.
+// the lines of the whole batch are put together and written at once
+static void printBatch(const TupleBatch& batch, int attr, int& count)
+{
+  const int* selected = batch.getSelected();
+  int        n = batch.getSelectedCount();
+  char       number[16];
+  string     lines;
+
+  count += n;
+  if (attr == 4) return;
+  for (int i = 0; i < n; i++) {
+    int t = selected[i];
+    switch (attr) {
+    case 1:  // SELECT key
+      lines.append(number, sprintf(number, "%d\n", batch.getKey(t)));
+      break;
+    case 2:  // SELECT value
+      lines.append(batch.getValue(t), batch.getLength(t));
+      lines += '\n';
+      break;
+    case 3:  // SELECT *
+      lines.append(number, sprintf(number, "%d '", batch.getKey(t)));
+      lines.append(batch.getValue(t), batch.getLength(t));
+      lines.append("'\n");
+      break;
+    }
+  }
+  fwrite(lines.data(), 1, lines.size(), stdout);
+}
+
+// read the incomplete tuples of the batch from the table, sorted by
+// RecordId so that every page is read once. then check the conditions
+// and print the matching tuples in the original index order, through
+// filterBatch() and printBatch().
+// the tuples removed since they were indexed are dropped first, and those
+// updated since are read again. the batch is cleared afterwards.
+static RC emitBatch(const RecordFile& rf, vector<IndexedTuple>& batch,
+                    int attr, const vector<Condition>& cond, int& count)
+{
+  RC rc;
+  unsigned live = 0;
+  for (unsigned i = 0; i < batch.size(); i++) {
+    if (rf.isRemoved(batch[i].rid)) continue;
+    if (rf.isUpdated(batch[i].rid)) batch[i].complete = false;
+    if (live != i) {
+      batch[live].key = batch[i].key;
+      batch[live].rid = batch[i].rid;
+      batch[live].value.swap(batch[i].value);
+      batch[live].complete = batch[i].complete;
+    }
+    live++;
+  }
+  batch.resize(live);
+
+  vector<pair<RecordId, unsigned> > order;
+  for (unsigned i = 0; i < batch.size(); i++) {
+    if (!batch[i].complete) order.push_back(make_pair(batch[i].rid, i));
+  }
+  sort(order.begin(), order.end());
+
+  vector<RecordId> rids(order.size());
+  vector<int>      keys;
+  vector<string>   values;
+  for (unsigned i = 0; i < order.size(); i++) {
+    rids[i] = order[i].first;
+  }
+  if ((rc = rf.read(rids, keys, values)) < 0) return rc;
+  for (unsigned i = 0; i < order.size(); i++) {
+    batch[order[i].second].key = keys[i];
+    batch[order[i].second].value.swap(values[i]);
+  }
+
+  // the tuples go through the conditions and the output a TupleBatch at a time
+  TupleBatch tuples;
+  for (unsigned i = 0; i < batch.size(); i++) {
+    const IndexedTuple& t = batch[i];
+    tuples.add(t.rid, t.key, t.value.data(), t.value.size());
+    if (tuples.isFull() || i + 1 == batch.size()) {
+      filterBatch(tuples, cond);
+      printBatch(tuples, attr, count);
+      tuples.clear();
+    }
+  }
+
+  batch.clear();
+  return 0;
+}
+
+// check the conditions on key, keyCond, on the entries of an index range
+// scan. the matching tuples are printed right away when their value is
+// not needed. otherwise they are added to batch, and emitBatch() reads
+// their values once it holds FETCH_BATCH_SIZE tuples. entries is cleared
+// afterwards
+static RC emitEntries(const RecordFile& rf, const BTreeIndex& tree, TupleBatch& entries,
+                      vector<IndexedTuple>& batch, bool needValue, int attr,
+                      const vector<Condition>& keyCond, const vector<Condition>& cond,
+                      int& count)
+{
+  RC rc;
+
+  filterBatch(entries, keyCond);
+  if (!needValue) {
+    printBatch(entries, attr, count);
+  }
+  else {
+    const int* selected = entries.getSelected();
+    for (int i = 0; i < entries.getSelectedCount(); i++) {
+      IndexedTuple tuple;
+      tuple.key = entries.getKey(selected[i]);
+      tuple.rid = entries.getRid(selected[i]);
+      tuple.value.assign(entries.getValue(selected[i]), entries.getLength(selected[i]));
+      tuple.complete = tree.coversValue(tuple.value);
+      batch.push_back(tuple);
+    }
+    if (batch.size() >= FETCH_BATCH_SIZE &&
+        (rc = emitBatch(rf, batch, attr, cond, count)) < 0) {
+      return rc;
+    }
+  }
+  entries.clear();
+  return 0;
+}
+
+// tell why an index of a table could not be read
+static void printIndexError(const string& name, RC rc)
+{
+  if (rc == RC_INVALID_FILE_FORMAT) {
+    fprintf(stderr, "Error: index %s is stored in an older format, load the table again\n", name.c_str());
+  }
+  else {
+    fprintf(stderr, "Error: while reading the index %s\n", name.c_str());
+  }
+}
+
+// find the tuples of the table that meet the conditions, for UPDATE and
+// DELETE. the tuples with an equality on key are looked up in the index
+// of the table if it has one, and the table is scanned otherwise
+static RC findTuples(const RecordFile& rf, const string& table,
+                     const vector<SelCond>& cond, vector<RecordId>& rids)
+{
+  RC        rc;
+  RecordId  rid;
+  int       key;
+  Predicate pred;
+
+  prepareConditions(cond, pred);
+  if (pred.never) return 0;
+
+  // the candidates of the index are checked against all the conditions
+  if (pred.keyEquality) {
+    vector<RecordId> candidates;
+    IndexCursor cursor;
+    HashIndex hindex;
+    BTreeIndex tree;
+    bool indexed = true;
+    if (hindex.open(table + ".hidx", 'r') == 0) {
+      if (hindex.locate(pred.keyMatch, cursor) == 0) {
+        while (hindex.readForward(cursor, key, rid) == 0) candidates.push_back(rid);
+      }
+      hindex.close();
+    }
+    else if (tree.open(table + ".idx", 'r') == 0) {
+      if ((rc = tree.readRoot()) < 0) {
+        printIndexError(table + ".idx", rc);
+        tree.close();
+        return rc;
+      }
+      rc = tree.locate(pred.keyMatch, cursor);
+      while ((rc == 0 || rc == RC_NO_SUCH_RECORD) &&
+             (rc = tree.readForward(cursor, key, rid)) == 0 && key == pred.keyMatch) {
+        candidates.push_back(rid);
+      }
+      tree.close();
+    }
+    else {
+      indexed = false;
+    }
+
+    if (indexed) {
+      string value;
+      for (unsigned j = 0; j < candidates.size(); j++) {
+        if (rf.isRemoved(candidates[j])) continue;
+        if ((rc = rf.read(candidates[j], key, value)) < 0) return rc;
+        if (conditionsHold(key, value.data(), value.size(), &pred.cond)) {
+          rids.push_back(candidates[j]);
+        }
+      }
+      return 0;
+    }
+  }
+
+  // the values are read only for the conditions on value
+  RecordFile::Scanner scanner(rf, cond.empty() ? NULL : conditionsHold, (void*)&pred.cond);
+  bool needValue = false;
+  for (unsigned i = 0; i < pred.cond.size(); i++) {
+    if (pred.cond[i].attr == 2) needValue = true;
+  }
+  scanner.setKeysOnly(!needValue);
+  const char* data;
+  int         length;
+  while ((rc = scanner.next(rid, key, data, length)) == 0) {
+    rids.push_back(rid);
+  }
+  return (rc == RC_END_OF_FILE) ? 0 : rc;
+}
+
+// # lines parsed by LOAD before they are appended to the table together
+static const int LOAD_BATCH_SIZE = 1024;
+
+// # bytes of the value stored with every entry of a covering index.
+// long enough for most titles, while a leaf still holds about 21 entries
+// of distinct keys: every one takes the key, its varint-coded posting
+// list of one RecordId (about 4 bytes) and the value.
+static const int COVERING_VALUE_WIDTH = 40;
+
+// a table is compacted by UPDATE and DELETE once its list of changes has
+// more entries than this per page of the table. the list is read every
+// time the table is opened, and the indexes keep the entries of the
+// tuples removed and of the values replaced until the table is compacted
+static const int COMPACT_CHANGES_PER_PAGE = 8;
+
+
+// tell why a table could not be opened
+static void printOpenError(const string& table, RC rc)
+{
+  if (rc == RC_INVALID_FILE_FORMAT) {
+    fprintf(stderr, "Error: table %s is stored in an older format, load it again\n", table.c_str());
+  }
+  else {
+    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+  }
+}
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -45,223 +533,227 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
   int    key;     
   string value;
   int    count;
-  int    diff;
 
   // open the table file
   if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
-    fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
+    printOpenError(table, rc);
     return rc;
   }
 
-  bool condOnKeyEquality = false;
-  int keyMatch;
-  bool condOnKeyRange = false;
-  int keyMin = INT_MIN;
-  int keyMax = INT_MAX;
-  for (unsigned i = 0; i < cond.size(); i++) {
-    if (cond[i].attr == 1) {
-      int val;
-      switch (cond[i].comp) {
-      case SelCond::EQ:
-        condOnKeyEquality = true;
-        keyMatch = atoi(cond[i].value);
-        break;
-      case SelCond::GT:
-        condOnKeyRange = true;
-        val = atoi(cond[i].value);
-        if (val+1 > keyMin) keyMin = val+1;
-        break;
-      case SelCond::LT: 
-        condOnKeyRange = true;
-        val = atoi(cond[i].value);
-        if (val-1 < keyMax) keyMax = val-1;
-        break;
-      case SelCond::GE:
-        condOnKeyRange = true;
-        val = atoi(cond[i].value);
-        if (val > keyMin) keyMin = val;
-        break;
-      case SelCond::LE:
-        condOnKeyRange = true;
-        val = atoi(cond[i].value);
-        if (val < keyMax) keyMax = val;
-        break;
-      default:
-        break;
+  // the conditions are compiled once. when they contradict each other,
+  // no tuple can match and nothing is read
+  Predicate pred;
+  prepareConditions(cond, pred);
+  if (pred.never) {
+    if (attr == 4) {
+      fprintf(stdout, "0\n");
+    }
+    rf.close();
+    return 0;
+  }
+
+  // a hash index answers an equality on key by reading the bucket of the
+  // key only. it is built instead of the B+tree, so it is tried first
+  if (pred.keyEquality) {
+    HashIndex hindex;
+    if (hindex.open(table + ".hidx", 'r') == 0) {
+      bool needValue = (attr == 2 || attr == 3);
+      for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr == 2) needValue = true;
+      }
+      IndexCursor entry;
+      vector<IndexedTuple> batch;
+      count = 0;
+      rc = hindex.locate(pred.keyMatch, entry);
+      if (rc == 0) {
+        IndexedTuple tuple;
+        while ((rc = hindex.readForward(entry, tuple.key, tuple.rid)) == 0) {
+          tuple.complete = !needValue;
+          batch.push_back(tuple);
+        }
+      }
+      if (rc < 0 && rc != RC_NO_SUCH_RECORD && rc != RC_END_OF_TREE) {
+        fprintf(stderr, "Error reading the hash index of table %s\n", table.c_str());
+      }
+      else if ((rc = emitBatch(rf, batch, attr, pred.cond, count)) < 0) {
+        fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+      }
+      else {
+        if (attr == 4) {
+          fprintf(stdout, "%d\n", count);
+        }
+        rc = 0;
       }
+      rf.close();
+      hindex.close();
+      return rc;
     }
   }
 
+  // the value index is used when there is no equality on key, and for a
+  // range on value only when there is no range on key
+  BTreeStringIndex vtree;
+  bool useValueTree = false;
+  if (!pred.keyEquality && (pred.valueEquality || (pred.valueRange && !pred.keyRange))) {
+    useValueTree = (vtree.open(table + ".vidx", 'r') == 0);
+  }
+
   BTreeIndex tree;
   bool tryTree = false;
-  if (condOnKeyEquality || condOnKeyRange || (cond.size() == 0 && (attr == 1 || attr ==4))) {
+  if (!useValueTree &&
+      (pred.keyEquality || pred.keyRange || (cond.size() == 0 && (attr == 1 || attr ==4)))) {
     rc = tree.open(table + ".idx", 'r');
     tryTree = true;
   }
-  // B+ tree opened successfully, use this index for searching
-  if (tryTree && rc == 0) {
-    tree.readRoot();
+  // value index opened successfully, scan it for the matching values
+  if (useValueTree) {
     IndexCursor entry;
+    string vkey;
+    vector<IndexedTuple> batch;
     count = 0;
-    if (condOnKeyEquality) {
-      rc = tree.locate(keyMatch, entry);
-      if (rc < 0 && rc != RC_NO_SUCH_RECORD) {
-        fprintf(stderr, "Error locating searchKey in B+ tree\n");
-        goto exit_index_select;
-      }
-      else if ((rc = tree.readForward(entry, key, rid)) < 0) {
-        fprintf(stderr, "Error reading forward long B+ tree leaf\n");
-        goto exit_index_select;
-      }
-      else {
-        bool ridRead = false;
-        for (unsigned i = 0; i < cond.size(); i++) {
-          switch(cond[i].attr) {
-          case 1:
-            diff = key - atoi(cond[i].value);
-            break;
-          case 2:
-            if (ridRead == false) {
-              if ((rc = rf.read(rid, key, value)) < 0) {
-                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-                goto exit_index_select;
-              }
-              ridRead = true;
-            }
-            diff = strcmp(value.c_str(), cond[i].value);
-            break;
-          }
+    if (pred.valueEquality) {
+      if (!vtree.mayContain(StringKey::truncate(pred.valueMatch)))
+        goto value_select_done;
+      pred.valueMin = pred.valueMax = pred.valueMatch;
+      pred.valueMaxSet = true;
+    }
+    // values longer than StringKey::MAX_LENGTH are stored by their prefix,
+    // so the bounds are cut the same way
+    pred.valueMin = StringKey::truncate(pred.valueMin);
+    pred.valueMax = StringKey::truncate(pred.valueMax);
 
-          switch (cond[i].comp) {
-          case SelCond::EQ:
-            if (diff != 0) goto section_end;
-            break;
-          case SelCond::NE:
-            if (diff == 0) goto section_end;
-            break;
-          case SelCond::GT:
-            if (diff <= 0) goto section_end;
-            break;
-          case SelCond::LT:
-            if (diff >= 0) goto section_end;
-            break;
-          case SelCond::GE:
-            if (diff < 0) goto section_end;
-            break;
-          case SelCond::LE:
-            if (diff > 0) goto section_end;
-            break;
+    if ((rc = vtree.readRoot()) < 0) {
+      printIndexError(table + ".vidx", rc);
+      goto exit_value_select;
+    }
+    rc = vtree.locate(pred.valueMin, entry);
+    if (rc < 0 && rc != RC_NO_SUCH_RECORD) {
+      fprintf(stderr, "Error locating searchKey in B+ tree\n");
+      goto exit_value_select;
+    }
+    {
+      // the tuple has to be read from the table when its key is needed or
+      // when the index holds only a prefix of its value
+      bool needKey = (attr == 1 || attr == 3);
+      for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr == 1) needKey = true;
+      }
+      set<RecordId> updatedFound;
+      while ((rc = vtree.readForward(entry, vkey, rid)) == 0) {
+        if (pred.valueMaxSet && pred.valueMax < vkey) break;
+        IndexedTuple tuple;
+        tuple.key = 0;
+        tuple.rid = rid;
+        tuple.value = vkey;
+        tuple.complete = !needKey && (int)vkey.size() < StringKey::MAX_LENGTH;
+        // a tuple updated since it was indexed has an entry for every
+        // value it had, and only the first entry of its value is used
+        if (rf.isUpdated(rid)) {
+          if ((rc = rf.read(rid, key, value)) < 0) {
+            fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+            goto exit_value_select;
           }
+          if (StringKey::truncate(value) != vkey || !updatedFound.insert(rid).second) continue;
         }
-        count++;
-        switch (attr) {
-        case 1:
-          fprintf(stdout, "%d\n", key);
-          break;
-        case 2:
-          if (ridRead == false) {
-            if ((rc = rf.read(rid, key, value)) < 0) {
-              fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-              goto exit_index_select;
-            }
-            ridRead = true;
-          }
-          fprintf(stdout, "%s\n", value.c_str());
-          break;
-        case 3:
-          if (ridRead == false) {
-            if ((rc = rf.read(rid, key, value)) < 0) {
-              fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-              goto exit_index_select;
-            }
-            ridRead = true;
-          }
-          fprintf(stdout, "%d '%s'\n", key, value.c_str());
-          break;
+        batch.push_back(tuple);
+        if (batch.size() >= FETCH_BATCH_SIZE &&
+            (rc = emitBatch(rf, batch, attr, pred.cond, count)) < 0) {
+          fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+          goto exit_value_select;
         }
+      }
+    }
+    if (rc < 0 && rc != RC_END_OF_TREE) {
+      fprintf(stderr, "Error reading forward along B+ tree leaf\n");
+      goto exit_value_select;
+    }
+    if ((rc = emitBatch(rf, batch, attr, pred.cond, count)) < 0) {
+      fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+      goto exit_value_select;
+    }
+
+    value_select_done:
+    if (attr == 4) {
+      fprintf(stdout, "%d\n", count);
+    }
+    rc = 0;
 
-        section_end: ;
+    exit_value_select:
+    rf.close();
+    vtree.close();
+    return rc;
+  }
+  // B+ tree opened successfully, use this index for searching
+  else if (tryTree && rc == 0) {
+    IndexCursor entry;
+    count = 0;
+    // The membership filter answers most misses on key equality
+    // without reading a single page of the tree
+    if (pred.keyEquality && !tree.mayContain(pred.keyMatch))
+      goto index_select_done;
+    // A hot key with a single entry is found in the front cache of the
+    // index, again without reading any page of the tree
+    if (pred.keyEquality && tree.lookupCached(pred.keyMatch, rid) == 0) {
+      vector<IndexedTuple> batch(1);
+      batch[0].key = pred.keyMatch;
+      batch[0].rid = rid;
+      batch[0].complete = (attr == 1 || attr == 4);
+      for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr == 2) batch[0].complete = false;
+      }
+      if ((rc = emitBatch(rf, batch, attr, pred.cond, count)) < 0) {
+        fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+        goto exit_index_select;
       }
+      goto index_select_done;
     }
-    else {
-      rc = tree.locate(keyMin, entry);
+    if ((rc = tree.readRoot()) < 0) {
+      printIndexError(table + ".idx", rc);
+      goto exit_index_select;
+    }
+    // A key may occur more than once, so an equality is scanned as the
+    // range [pred.keyMatch, pred.keyMatch]
+    if (pred.keyEquality) {
+      pred.keyMin = pred.keyMax = pred.keyMatch;
+    }
+    {
+      rc = tree.locate(pred.keyMin, entry);
       if (rc < 0 && rc != RC_NO_SUCH_RECORD) {
         fprintf(stderr, "Error locating searchKey in B+ tree\n");
         goto exit_index_select;
       }
-      if ((rc = tree.readForward(entry, key, rid)) < 0) {
+      if ((rc = tree.readForward(entry, key, rid, value)) == RC_END_OF_TREE) {
+        goto index_select_done;
+      }
+      else if (rc < 0) {
         fprintf(stderr, "Error reading forward along B+ tree leaf\n");
         goto exit_index_select;
       }
-      while (key <= keyMax) {
-        bool ridRead = false;
-        for (unsigned i = 0; i < cond.size(); i++) {
-          switch(cond[i].attr) {
-          case 1:
-            diff = key - atoi(cond[i].value);
-            break;
-          case 2:
-            if (ridRead == false) {
-              if ((rc = rf.read(rid, key, value)) < 0) {
-                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-                goto exit_index_select;
-              }
-              ridRead = true;
-            }
-            diff = strcmp(value.c_str(), cond[i].value);
-            break;
-          }
-
-         switch (cond[i].comp) {
-          case SelCond::EQ:
-            if (diff != 0) goto index_next_tuple;
-            break;
-          case SelCond::NE:
-            if (diff == 0) goto index_next_tuple;
-            break;
-          case SelCond::GT:
-            if (diff <= 0) goto index_next_tuple;
-            break;
-          case SelCond::LT:
-            if (diff >= 0) goto index_next_tuple;
-            break;
-          case SelCond::GE:
-            if (diff < 0) goto index_next_tuple;
-            break;
-          case SelCond::LE:
-            if (diff > 0) goto index_next_tuple;
-            break;
-          }
-        }
-        count++;
-        switch (attr) {
-        case 1:
-          fprintf(stdout, "%d\n", key);
-          break;
-        case 2:
-          if (ridRead == false) {
-            if ((rc = rf.read(rid, key, value)) < 0) {
-              fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-              goto exit_index_select;
-            }
-            ridRead = true;
-          }
-          fprintf(stdout, "%s\n", value.c_str());
-          break;
-        case 3:
-          if (ridRead == false) {
-            if ((rc = rf.read(rid, key, value)) < 0) {
-              fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-              goto exit_index_select;
-            }
-            ridRead = true;
+      // The entries are collected in a TupleBatch, and the conditions on
+      // key are checked on the whole batch. Tuples whose value is needed
+      // are then collected in a batch of their own, and their values are
+      // read from the table in RecordId order. This way every table page
+      // is read once per batch instead of once per tuple.
+      bool needValue = (attr == 2 || attr == 3);
+      vector<Condition> keyCond;
+      for (unsigned i = 0; i < pred.cond.size(); i++) {
+        if (pred.cond[i].attr == 2) needValue = true;
+        if (pred.cond[i].attr == 1) keyCond.push_back(pred.cond[i]);
+      }
+      TupleBatch entries;
+      vector<IndexedTuple> batch;
+      while (key <= pred.keyMax) {
+        // the entries of the tuples removed since they were indexed are skipped
+        if (!rf.isRemoved(rid)) {
+          entries.add(rid, key, value.data(), value.size());
+          if (entries.isFull() &&
+              (rc = emitEntries(rf, tree, entries, batch, needValue, attr, keyCond, pred.cond, count)) < 0) {
+            fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+            goto exit_index_select;
           }
-          fprintf(stdout, "%d '%s'\n", key, value.c_str());
-          break;
         }
 
-        index_next_tuple:
-        rc = tree.readForward(entry, key, rid);
+        rc = tree.readForward(entry, key, rid, value);
         if (rc == RC_END_OF_TREE) {
           break;
         }
@@ -270,7 +762,13 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
           goto exit_index_select;
         }
       }
+      if ((rc = emitEntries(rf, tree, entries, batch, needValue, attr, keyCond, pred.cond, count)) < 0 ||
+          (rc = emitBatch(rf, batch, attr, pred.cond, count)) < 0) {
+        fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+        goto exit_index_select;
+      }
     }
+    index_select_done:
     if (attr == 4) {
       fprintf(stdout, "%d\n", count);
     }
@@ -283,71 +781,57 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
   }
   // Otherwise, use default sequential scan
   else {
-    // scan the table file from the beginning
-    rid.pid = rid.sid = 0;
-    count = 0;
-    while (rid < rf.endRid()) {
-      // read the tuple
-      if ((rc = rf.read(rid, key, value)) < 0) {
-        fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-        goto exit_select;
-      }
-
-      // check the conditions on the tuple
-      for (unsigned i = 0; i < cond.size(); i++) {
-        // compute the difference between the tuple value and the condition value
-        switch (cond[i].attr) {
-        case 1:
-          diff = key - atoi(cond[i].value);
-          break;
-        case 2:
-          diff = strcmp(value.c_str(), cond[i].value);
-          break;
-        }
-
-        // skip the tuple if any condition is not met
-        switch (cond[i].comp) {
-        case SelCond::EQ:
-          if (diff != 0) goto next_tuple;
-          break;
-        case SelCond::NE:
-          if (diff == 0) goto next_tuple;
-          break;
-        case SelCond::GT:
-          if (diff <= 0) goto next_tuple;
-          break;
-        case SelCond::LT:
-          if (diff >= 0) goto next_tuple;
-          break;
-        case SelCond::GE:
-          if (diff < 0) goto next_tuple;
-          break;
-        case SelCond::LE:
-          if (diff > 0) goto next_tuple;
-          break;
+    // scan the table file from the beginning, a TupleBatch at a time.
+    // the conditions are checked on the columns of the batch, and the
+    // matching tuples of the batch are printed together. the values are
+    // not read at all when neither the output nor a condition needs them
+    RecordFile::Scanner scanner(rf);
+    TupleBatch batch;
+    bool needValue = (attr == 2 || attr == 3);
+    for (unsigned i = 0; i < pred.cond.size(); i++) {
+      if (pred.cond[i].attr == 2) needValue = true;
+    }
+    scanner.setKeysOnly(!needValue);
+    // on a table with a dictionary, the equalities on value compare the
+    // code of the value with that of the condition value, which is -1
+    // when no tuple has it
+    if (rf.hasDictionary()) {
+      for (unsigned i = 0; i < pred.cond.size(); i++) {
+        Condition& c = pred.cond[i];
+        if (c.attr == 2 && (c.comp == SelCond::EQ || c.comp == SelCond::NE)) {
+          c.coded = true;
+          c.constant = rf.findCode(c.value);
         }
       }
-
-      // the condition is met for the tuple. 
-      // increase matching tuple counter
-      count++;
-
-      // print the tuple 
-      switch (attr) {
-      case 1:  // SELECT key
-        fprintf(stdout, "%d\n", key);
-        break;
-      case 2:  // SELECT value
-        fprintf(stdout, "%s\n", value.c_str());
-        break;
-      case 3:  // SELECT *
-        fprintf(stdout, "%d '%s'\n", key, value.c_str());
-        break;
+    }
+    // the pages whose zone is out of the ranges of key and value are
+    // not read at all
+    if (pred.keyEquality || pred.keyRange || pred.valueEquality || pred.valueRange) {
+      ZoneMap::Bounds bounds;
+      bounds.keyMin = pred.keyMin;
+      bounds.keyMax = pred.keyMax;
+      if (pred.keyEquality) {
+        bounds.keyMin = max(pred.keyMin, pred.keyMatch);
+        bounds.keyMax = min(pred.keyMax, pred.keyMatch);
       }
-
-      // move to the next tuple
-      next_tuple:
-      ++rid;
+      bounds.valueMin = pred.valueMin;
+      bounds.valueMax = pred.valueMax;
+      bounds.valueMaxSet = pred.valueMaxSet;
+      if (pred.valueEquality) {
+        bounds.valueMin = max(pred.valueMin, pred.valueMatch);
+        bounds.valueMax = pred.valueMaxSet ? min(pred.valueMax, pred.valueMatch) : pred.valueMatch;
+        bounds.valueMaxSet = true;
+      }
+      scanner.setBounds(bounds);
+    }
+    count = 0;
+    while ((rc = scanner.nextBatch(batch)) == 0) {
+      filterBatch(batch, pred.cond);
+      printBatch(batch, attr, count);
+    }
+    if (rc != RC_END_OF_FILE) {
+      fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+      goto exit_select;
     }
 
     // print matching tuple count if "select count(*)"
@@ -363,84 +847,394 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
   }
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+RC SqlEngine::update(const string& table, const string& value, const vector<SelCond>& cond)
+{
+  RecordFile       rf;
+  BTreeStringIndex vtree;
+  vector<RecordId> rids;
+  RC               rc;
+
+  // the table is opened for writing only if it exists
+  rc = (access((table + ".tbl").c_str(), F_OK) == 0) ? rf.open(table + ".tbl", 'w') : RC_FILE_OPEN_FAILED;
+  if (rc < 0) {
+    printOpenError(table, rc);
+    return RC_FILE_OPEN_FAILED;
+  }
+  if ((rc = findTuples(rf, table, cond, rids)) < 0) {
+    fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+    rf.close();
+    return rc;
+  }
+
+  // the tuples keep their RecordId, even those moved to the end of the
+  // table, so the indexes on key stay as they are. the value index gets
+  // an entry for the new value, and the select skips the entry of the
+  // old one
+  bool valueIndexed = (access((table + ".vidx").c_str(), F_OK) == 0 &&
+                       vtree.open(table + ".vidx", 'w') == 0);
+  if (valueIndexed && (rc = vtree.readRoot()) < 0) {
+    printIndexError(table + ".vidx", rc);
+    vtree.close();
+    rf.close();
+    return rc;
+  }
+
+  unsigned count = 0;
+  for (unsigned i = 0; i < rids.size(); i++) {
+    if ((rc = rf.update(rids[i], value)) < 0 ||
+        (valueIndexed && (rc = vtree.insert(StringKey::truncate(value), rids[i])) < 0)) {
+      fprintf(stderr, "Error: while updating a tuple of table %s\n", table.c_str());
+      break;
+    }
+    count++;
+  }
+  bool compacting = rf.getChangeCount() > COMPACT_CHANGES_PER_PAGE * (rf.endRid().pid + 1);
+  if (valueIndexed && vtree.close() < 0 && rc == 0) rc = RC_FILE_WRITE_FAILED;
+  if (rf.close() < 0 && rc == 0) rc = RC_FILE_WRITE_FAILED;
+
+  fprintf(stderr, "  -- %u tuples updated\n", count);
+  if (rc == 0 && compacting && (rc = compact(table)) < 0) {
+    fprintf(stderr, "Error: while compacting table %s\n", table.c_str());
+  }
+  return (rc < 0) ? rc : 0;
+}
+
+RC SqlEngine::remove(const string& table, const vector<SelCond>& cond)
+{
+  RecordFile       rf;
+  vector<RecordId> rids;
+  RC               rc;
+
+  // the table is opened for writing only if it exists
+  rc = (access((table + ".tbl").c_str(), F_OK) == 0) ? rf.open(table + ".tbl", 'w') : RC_FILE_OPEN_FAILED;
+  if (rc < 0) {
+    printOpenError(table, rc);
+    return RC_FILE_OPEN_FAILED;
+  }
+  if ((rc = findTuples(rf, table, cond, rids)) < 0) {
+    fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+    rf.close();
+    return rc;
+  }
+
+  // the entries of the removed tuples are left in the indexes until the
+  // table is compacted, and the select skips them
+  unsigned count;
+  for (count = 0; count < rids.size(); count++) {
+    if ((rc = rf.remove(rids[count])) < 0) {
+      fprintf(stderr, "Error: while removing a tuple of table %s\n", table.c_str());
+      break;
+    }
+  }
+  bool compacting = rf.getChangeCount() > COMPACT_CHANGES_PER_PAGE * (rf.endRid().pid + 1);
+  if (rf.close() < 0 && rc == 0) rc = RC_FILE_WRITE_FAILED;
+
+  fprintf(stderr, "  -- %u tuples removed\n", count);
+  if (rc == 0 && compacting && (rc = compact(table)) < 0) {
+    fprintf(stderr, "Error: while compacting table %s\n", table.c_str());
+  }
+  return (rc < 0) ? rc : 0;
+}
+
+// the tuple source of load(): the lines of the load file
+static RC readLoadLine(int& key, string& value, void* arg)
+{
+    ifstream& file = *(ifstream*)arg;
+    string line;
+    if (!getline(file, line))
+        return RC_END_OF_FILE;
+    //If parseLoadLine returns error
+    if (SqlEngine::parseLoadLine(line, key, value) < 0)
+        return RC_FILE_SEEK_FAILED;
+    return 0;
+}
+
+// the tuple source of compact(): the live tuples of the table
+static RC readLiveTuple(int& key, string& value, void* arg)
+{
+    RecordFile::Scanner& scanner = *(RecordFile::Scanner*)arg;
+    RecordId    rid;
+    const char* data;
+    int         length;
+    RC          rc;
+    if ((rc = scanner.next(rid, key, data, length)) < 0)
+        return rc;
+    value.assign(data, length);
+    return 0;
+}
+
+RC SqlEngine::load(const string& table, const string& loadfile, int options)
 {
     ifstream file;
     file.open(loadfile.c_str());
     if (!file.is_open())
         exit(RC_FILE_OPEN_FAILED);
-    string line;
 
+    RC rc = loadTuples(table, readLoadLine, &file, options);
+    if (rc < 0)
+        exit(rc);
+    file.close();
+    return 0;
+}
+
+RC SqlEngine::loadTuples(const string& table, TupleSource next, void* arg, int options)
+{
     //Open target RecordFile
     RecordFile rf;
     const string recordName = table + ".tbl";
-    rf.open(recordName, 'w');
+    RC rc = rf.open(recordName, 'w');
+    if (rc < 0)
+        return rc;
+    if (options & LOAD_PAX)
+        rf.setLayout(RecordFile::PAX_LAYOUT);
+    if ((options & LOAD_DICTIONARY) && rf.enableDictionary() < 0) {
+        rf.close();
+        return RC_FILE_WRITE_FAILED;
+    }
+    if ((options & LOAD_COMPRESSED) && rf.enableCompression() < 0) {
+        rf.close();
+        return RC_FILE_WRITE_FAILED;
+    }
+
+    int key;
+    string value;
+    if (options & LOAD_HASH) {
+        // The hash index replaces the B+tree, the other index options
+        // do not apply to it
+        HashIndex hindex;
+        if (hindex.open(table + ".hidx", 'w') < 0) {
+            rf.close();
+            return RC_FILE_OPEN_FAILED;
+        }
+
+        //For each tuple of the source, insert into table
+        while ((rc = next(key, value, arg)) == 0)
+        {
+            //Insert each value and key into the RecordFile table and the index
+            RecordId rid;
+            if (rf.append(key, value, rid) < 0 || hindex.insert(key, rid) < 0) {
+                rf.close();
+                hindex.close();
+                return RC_FILE_WRITE_FAILED;
+            }
+        }
+        //If the source returns error
+        if (rc != RC_END_OF_FILE) {
+            rf.close();
+            hindex.close();
+            return rc;
+        }
 
-    if (index) {
+        hindex.close();
+    }
+    else if (options & LOAD_INDEX) {
         // Open target index file
         BTreeIndex tree;
         const string treeName = table + ".idx";
         tree.open(treeName, 'w');
-        tree.initializeTree();
+        const int leafFormat = (options & LOAD_PACKED) ? BTLeafNode::PACKED : BTLeafNode::POSTING_LISTS;
+        const bool buffered = (options & LOAD_EPSILON) != 0;
+        tree.initializeTree((options & LOAD_COVERING) ? COVERING_VALUE_WIDTH : 0, leafFormat, buffered);
         tree.readRoot();
-        int inserted = 0;
-
-        //For each file line extract value and key, insert into table
-        while (getline(file, line))
-        {
-            int key;
-            string value;
-            //If parseLoadLine returns error
-            if (parseLoadLine(line, key, value) < 0 ) {
+        if ((options & LOAD_FILTER) && tree.enableFilter() < 0) {
+            rf.close();
+            tree.close();
+            return RC_FILE_WRITE_FAILED;
+        }
+        // The model is built over the leaves when the index is closed
+        if (options & LOAD_LEARNED)
+            tree.enableModel();
+        // Both indexes are filled in key order from their write buffers
+        if ((options & LOAD_BUFFERED) && tree.enableWriteBuffer() < 0) {
+            rf.close();
+            tree.close();
+            return RC_FILE_WRITE_FAILED;
+        }
+        // Open the secondary index on value
+        BTreeStringIndex vtree;
+        if (options & LOAD_VALUE_INDEX) {
+            const string vtreeName = table + ".vidx";
+            vtree.open(vtreeName, 'w');
+            vtree.initializeTree(0, leafFormat, buffered);
+            vtree.readRoot();
+            if (((options & LOAD_FILTER) && vtree.enableFilter() < 0) ||
+                ((options & LOAD_BUFFERED) && vtree.enableWriteBuffer() < 0)) {
                 rf.close();
                 tree.close();
-                exit(RC_FILE_SEEK_FAILED);
+                vtree.close();
+                return RC_FILE_WRITE_FAILED;
             }
-            
+        }
+        int inserted = 0;
+        // Keys and values inserted out of order leave the leaves of their
+        // index scattered over its file, which is then rewritten in order
+        bool keysSorted = true;
+        bool valuesSorted = true;
+        int lastKey = 0;
+        string lastValue;
+
+        //For each tuple of the source, insert into table
+        while ((rc = next(key, value, arg)) == 0)
+        {
             //Insert each value and key into the RecordFile table
             RecordId rid;
             if (rf.append(key, value, rid) < 0) {
                 rf.close();
                 tree.close();
-                exit(RC_FILE_WRITE_FAILED);
+                vtree.close();
+                return RC_FILE_WRITE_FAILED;
             }
 
-            RC errorCode = tree.insert(key, rid);
+            RC errorCode = tree.insert(key, rid, value);
+            if (errorCode == 0 && (options & LOAD_VALUE_INDEX)) {
+                errorCode = vtree.insert(StringKey::truncate(value), rid);
+            }
             if (errorCode < 0) {
                 rf.close();
                 tree.close();
-                exit(RC_FILE_WRITE_FAILED);
+                vtree.close();
+                return RC_FILE_WRITE_FAILED;
             }
+            if (inserted > 0 && key < lastKey)
+                keysSorted = false;
+            if (inserted > 0 && (options & LOAD_VALUE_INDEX) && value < lastValue)
+                valuesSorted = false;
+            lastKey = key;
+            if (options & LOAD_VALUE_INDEX)
+                lastValue.swap(value);
             inserted++;
         }
+        //If the source returns error
+        if (rc != RC_END_OF_FILE) {
+            rf.close();
+            tree.close();
+            vtree.close();
+            return rc;
+        }
+        if ((!keysSorted && tree.reorganize() < 0) ||
+            (!valuesSorted && vtree.reorganize() < 0)) {
+            rf.close();
+            tree.close();
+            vtree.close();
+            return RC_FILE_WRITE_FAILED;
+        }
 
         tree.close();
+        if (options & LOAD_VALUE_INDEX) vtree.close();
     }
     else {
-        //For each file line extract value and key, insert into table
-        while (getline(file, line))
+        //Without an index the tuples are appended in batches
+        vector<int> keys(LOAD_BATCH_SIZE);
+        vector<string> values(LOAD_BATCH_SIZE);
+        vector<RecordId> rids(LOAD_BATCH_SIZE);
+        int n = 0;
+
+        //For each tuple of the source, insert into table
+        while (true)
         {
-            int key;
-            string value;
-            //If parseLoadLine returns error
-            if (parseLoadLine(line, key, value) < 0 ) {
+            rc = next(keys[n], values[n], arg);
+            bool more = (rc == 0);
+            //If the source returns error
+            if (!more && rc != RC_END_OF_FILE) {
                 rf.close();
-                exit(RC_FILE_SEEK_FAILED);
+                return rc;
             }
-            
-            //Insert each value and key into the RecordFile table
-            RecordId rid;
-            if (rf.append(key, value, rid) < 0) {
+            if (more && ++n < LOAD_BATCH_SIZE) continue;
+
+            //Insert each value and key of the batch into the RecordFile table
+            if (rf.appendBatch(&keys[0], &values[0], n, &rids[0]) < 0) {
                 rf.close();
-                exit(RC_FILE_WRITE_FAILED);
+                return RC_FILE_WRITE_FAILED;
             }
+            n = 0;
+            if (!more) break;
         }
     }
-    rf.close();
-	file.close();
+    //The last page of the table is written on close
+    if (rf.close() < 0) {
+        return RC_FILE_WRITE_FAILED;
+    }
     return 0;
 }
 
+// the files of a table, after the table name
+static const char* const TABLE_FILES[] = {
+  ".tbl", ".tbl.ovf", ".tbl.zone", ".tbl.dict", ".tbl.map", ".tbl.chg",
+  ".idx", ".idx.bf", ".idx.lm", ".idx.wal",
+  ".vidx", ".vidx.bf", ".vidx.lm", ".vidx.wal", ".hidx"
+};
+static const int TABLE_FILE_COUNT = sizeof(TABLE_FILES) / sizeof(TABLE_FILES[0]);
+
+static bool exists(const string& filename)
+{
+  return access(filename.c_str(), F_OK) == 0;
+}
+
+RC SqlEngine::compact(const string& table)
+{
+  RecordFile rf;
+  RC         rc;
+
+  if ((rc = rf.open(table + ".tbl", 'r')) < 0) return rc;
+
+  // the table is loaded again with the options it was loaded with, as
+  // far as its files tell them
+  int options = 0;
+  if (rf.getPageLayout() == RecordFile::PAX_LAYOUT) options |= LOAD_PAX;
+  if (rf.hasDictionary()) options |= LOAD_DICTIONARY;
+  if (rf.isCompressed()) options |= LOAD_COMPRESSED;
+  if (exists(table + ".hidx")) options |= LOAD_HASH;
+  if (exists(table + ".idx")) {
+    BTreeIndex tree;
+    if ((rc = tree.open(table + ".idx", 'r')) < 0 || (rc = tree.readRoot()) < 0) {
+      printIndexError(table + ".idx", rc);
+      tree.close();
+      rf.close();
+      return rc;
+    }
+    options |= LOAD_INDEX;
+    if (tree.getValueWidth() > 0) options |= LOAD_COVERING;
+    if (tree.getLeafFormat() == BTLeafNode::PACKED) options |= LOAD_PACKED;
+    if (tree.isBuffered()) options |= LOAD_EPSILON;
+    tree.close();
+    if (exists(table + ".idx.bf")) options |= LOAD_FILTER;
+    if (exists(table + ".idx.lm")) options |= LOAD_LEARNED;
+    if (exists(table + ".idx.wal")) options |= LOAD_BUFFERED;
+    if (exists(table + ".vidx")) options |= LOAD_VALUE_INDEX;
+  }
+
+  // the live tuples go to a new table next to the old one. the files
+  // left there by a compaction that did not finish are dropped first,
+  // since the files are opened for appending
+  const string compacted = table + ".compact";
+  for (int i = 0; i < TABLE_FILE_COUNT; i++) unlink((compacted + TABLE_FILES[i]).c_str());
+  BTreeIndex::forget(compacted + ".idx");
+  BTreeStringIndex::forget(compacted + ".vidx");
+
+  RecordFile::Scanner scanner(rf);
+  rc = loadTuples(compacted, readLiveTuple, &scanner, options);
+  rf.close();
+  if (rc < 0) {
+    for (int i = 0; i < TABLE_FILE_COUNT; i++) unlink((compacted + TABLE_FILES[i]).c_str());
+    return rc;
+  }
+
+  // the files of the new table replace those of the old one, and the
+  // files it does not have, such as the list of changes, are removed
+  for (int i = 0; i < TABLE_FILE_COUNT; i++) {
+    const string name = table + TABLE_FILES[i];
+    if (exists(compacted + TABLE_FILES[i])) {
+      if (rename((compacted + TABLE_FILES[i]).c_str(), name.c_str()) < 0) return RC_FILE_WRITE_FAILED;
+    }
+    else {
+      unlink(name.c_str());
+    }
+  }
+  BTreeIndex::forget(table + ".idx");
+  BTreeStringIndex::forget(table + ".vidx");
+  return 0;
+}
+
 RC SqlEngine::parseLoadLine(const string& line, int& key, string& value)
 {
     const char *s;
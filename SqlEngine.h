@@ -28,6 +28,31 @@ struct SelCond {
  */
 class SqlEngine {
  public:
+
+  // options of the LOAD command. the options in the WITH clause are ORed.
+  static const int LOAD_INDEX    = 0x1;  // WITH INDEX: build a B+tree on key
+  static const int LOAD_FILTER   = 0x2;  // WITH FILTERED INDEX: add a membership
+                                         // filter sidecar to the index
+  static const int LOAD_COVERING = 0x4;  // WITH COVERING INDEX: store values
+                                         // in the index leaves
+  static const int LOAD_VALUE_INDEX = 0x8;  // WITH VALUE INDEX: also build a
+                                            // B+tree on value
+  static const int LOAD_PACKED   = 0x10; // WITH PACKED INDEX: store the index
+                                         // leaves in the bit-packed format
+  static const int LOAD_LEARNED  = 0x20; // WITH LEARNED INDEX: attach a learned
+                                         // model over the leaves of the index
+  static const int LOAD_BUFFERED = 0x40; // WITH BUFFERED INDEX: insert through
+                                         // a logged write buffer
+  static const int LOAD_EPSILON  = 0x80; // WITH EPSILON INDEX: keep message
+                                         // buffers in the internal nodes
+  static const int LOAD_HASH     = 0x100; // WITH HASH INDEX: build a hash index
+                                          // on key instead of the B+tree
+  static const int LOAD_PAX      = 0x200; // WITH PAX: store the table in pages
+                                          // of the PAX layout (see RecordFile.h)
+  static const int LOAD_DICTIONARY = 0x400; // WITH DICTIONARY: store the values
+                                            // of the table by dictionary code
+  static const int LOAD_COMPRESSED = 0x800; // WITH COMPRESSED: store the pages
+                                            // of the table compressed
     
   /**
    * takes the user commands from commandline and executes them.
@@ -50,14 +75,48 @@ class SqlEngine {
    */
   static RC select(int attr, const std::string& table, const std::vector<SelCond>& conds);
 
+  /**
+   * executes an UPDATE statement: set the value of the tuples that meet
+   * the conditions. the tuples keep their key and, until the table is
+   * compacted (see compact()), their RecordId.
+   * all conditions in conds must be ANDed together.
+   * @param table[IN] the table name in the UPDATE clause
+   * @param value[IN] the new value in the SET clause
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @return error code. 0 if no error
+   */
+  static RC update(const std::string& table, const std::string& value,
+                   const std::vector<SelCond>& conds);
+
+  /**
+   * executes a DELETE statement: remove the tuples that meet the conditions.
+   * all conditions in conds must be ANDed together.
+   * @param table[IN] the table name in the DELETE clause
+   * @param conds[IN] list of conditions in the WHERE clause
+   * @return error code. 0 if no error
+   */
+  static RC remove(const std::string& table, const std::vector<SelCond>& conds);
+
   /**
    * load a table from a load file.
    * @param table[IN] the table name in the LOAD command
    * @param loadfile[IN] the file name of the load file
-   * @param index[IN] true if "WITH INDEX" option was specified
+   * @param options[IN] the LOAD_* options specified in the WITH clause
+   * @return error code. 0 if no error
+   */
+  static RC load(const std::string& table, const std::string& loadfile, int options);
+
+  /**
+   * compact a table: load it again from its live tuples, with the options
+   * it was loaded with. the slots of the tuples removed or moved to the
+   * end of the table are freed, the indexes lose the entries of those
+   * tuples and of the values replaced, and the list of changes of the
+   * table is emptied. update() and remove() compact the table once its
+   * list of changes grows long.
+   * @param table[IN] the table name
    * @return error code. 0 if no error
    */
-  static RC load(const std::string& table, const std::string& loadfile, bool index);
+  static RC compact(const std::string& table);
 
   /**
    * parse a line from the load file into the (key, value) pair.
@@ -67,6 +126,27 @@ class SqlEngine {
    * @return error code. 0 if no error
    */
   static RC parseLoadLine(const std::string& line, int& key, std::string& value);
+
+ private:
+  /**
+   * a source of the tuples of loadTuples().
+   * @param key[OUT] the key of the next tuple
+   * @param value[OUT] the value of the next tuple
+   * @param arg[IN] the argument given to loadTuples()
+   * @return error code. RC_END_OF_FILE after the last tuple
+   */
+  typedef RC (*TupleSource)(int& key, std::string& value, void* arg);
+
+  /**
+   * create a table from the tuples of a source, the way load() does from
+   * the lines of a load file.
+   * @param table[IN] the table name
+   * @param next[IN] the source of the tuples
+   * @param arg[IN] the argument passed to next
+   * @param options[IN] the LOAD_* options
+   * @return error code. 0 if no error
+   */
+  static RC loadTuples(const std::string& table, TupleSource next, void* arg, int options);
 };
 
 #endif /* SQLENGINE_H */
@@ -38,11 +38,12 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
 }
 
 %token SELECT FROM WHERE LOAD WITH INDEX QUIT COUNT AND OR 
+%token UPDATE SET DELETE
 %token COMMA STAR LF
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
+%type <integer> attributes attribute comparator index_options load_options load_option
 %type <string> table value
 %type <cond> condition
 %type <conds> conditions
@@ -56,6 +57,8 @@ commands:
 command:
         load_command { fprintf(stdout, "Bruinbase> "); }
 	| select_command { fprintf(stdout, "Bruinbase> "); }
+	| update_command { fprintf(stdout, "Bruinbase> "); }
+	| delete_command { fprintf(stdout, "Bruinbase> "); }
 	| quit_command
 	| error LF { fprintf(stdout, "Bruinbase> "); }
 	| LF { fprintf(stdout, "Bruinbase> "); }
@@ -67,15 +70,53 @@ quit_command:
 
 load_command:
 	LOAD table FROM STRING LF { 
-	  SqlEngine::load(std::string($2), std::string($4), false); 
+	  SqlEngine::load(std::string($2), std::string($4), 0); 
 	  free($2);
 	  free($4);
 	}
-	| LOAD table FROM STRING WITH INDEX LF { 
-	  SqlEngine::load(std::string($2), std::string($4), true); 
+	| LOAD table FROM STRING WITH index_options INDEX LF { 
+	  SqlEngine::load(std::string($2), std::string($4), $6 | SqlEngine::LOAD_INDEX); 
 	  free($2);
 	  free($4);
 	}
+	| LOAD table FROM STRING WITH load_options LF { 
+	  SqlEngine::load(std::string($2), std::string($4), $6); 
+	  free($2);
+	  free($4);
+	}
+	;
+
+index_options:
+	/* empty */ { $$ = 0; }
+	| load_options { $$ = $1; }
+	;
+
+load_options:
+	load_option { $$ = $1; }
+	| load_options load_option { $$ = $1 | $2; }
+	;
+
+load_option:
+	ID {
+		int option = 0;
+		if (strcasecmp($1, "filtered") == 0) option = SqlEngine::LOAD_FILTER;
+		else if (strcasecmp($1, "covering") == 0) option = SqlEngine::LOAD_COVERING;
+		else if (strcasecmp($1, "value") == 0) option = SqlEngine::LOAD_VALUE_INDEX;
+		else if (strcasecmp($1, "packed") == 0) option = SqlEngine::LOAD_PACKED;
+		else if (strcasecmp($1, "learned") == 0) option = SqlEngine::LOAD_LEARNED;
+		else if (strcasecmp($1, "buffered") == 0) option = SqlEngine::LOAD_BUFFERED;
+		else if (strcasecmp($1, "epsilon") == 0) option = SqlEngine::LOAD_EPSILON;
+		else if (strcasecmp($1, "hash") == 0) option = SqlEngine::LOAD_HASH;
+		else if (strcasecmp($1, "pax") == 0) option = SqlEngine::LOAD_PAX;
+		else if (strcasecmp($1, "dictionary") == 0) option = SqlEngine::LOAD_DICTIONARY;
+		else if (strcasecmp($1, "compressed") == 0) option = SqlEngine::LOAD_COMPRESSED;
+		free($1);
+		if (option == 0) {
+			sqlerror("unknown index option");
+			YYERROR;
+		}
+		$$ = option;
+	}
 	;
 
 select_command:
@@ -94,6 +135,42 @@ select_command:
 	}
 	;
 
+update_command:
+	UPDATE table SET attribute EQUAL value LF {
+	        std::vector<SelCond> conds;
+		if ($4 == 2) SqlEngine::update($2, $6, conds);
+		else sqlerror("only the value of a tuple can be updated");
+		free($2);
+		free($6);
+	}
+	| UPDATE table SET attribute EQUAL value WHERE conditions LF {
+		if ($4 == 2) SqlEngine::update($2, $6, *$8);
+		else sqlerror("only the value of a tuple can be updated");
+		free($2);
+		free($6);
+	  	for (unsigned i = 0; i < $8->size(); i++) {
+		    free((*$8)[i].value);
+		}
+	  	delete $8;
+	}
+	;
+
+delete_command:
+	DELETE FROM table LF {
+	        std::vector<SelCond> conds;
+		SqlEngine::remove($3, conds);
+		free($3);
+	}
+	| DELETE FROM table WHERE conditions LF {
+		SqlEngine::remove($3, *$5);
+		free($3);
+	  	for (unsigned i = 0; i < $5->size(); i++) {
+		    free((*$5)[i].value);
+		}
+	  	delete $5;
+	}
+	;
+
 conditions:
 	condition {
 	  std::vector<SelCond>* v = new std::vector<SelCond>;
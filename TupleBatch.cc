@@ -0,0 +1,29 @@
+#include "TupleBatch.h"
+
+using namespace std;
+
+TupleBatch::TupleBatch()
+{
+  size = 0;
+  selectedCount = 0;
+}
+
+void TupleBatch::clear()
+{
+  // the memory of the values is kept for the next tuples
+  size = 0;
+  selectedCount = 0;
+  values.clear();
+}
+
+void TupleBatch::add(const RecordId& rid, int key, const char* value, int length, int code)
+{
+  rids[size] = rid;
+  keys[size] = key;
+  codes[size] = code;
+  offsets[size] = values.size();
+  lengths[size] = length;
+  values.append(value, length);
+  selected[selectedCount++] = size;
+  size++;
+}
@@ -0,0 +1,94 @@
+#ifndef TUPLEBATCH_H
+#define TUPLEBATCH_H
+
+#include <string>
+#include "Bruinbase.h"
+#include "RecordFile.h"
+
+/**
+ * A batch of up to CAPACITY tuples stored column by column: the record
+ * ids, the keys, the dictionary codes and the values each have an array,
+ * so that a condition is checked on a whole column in one tight loop.
+ * The tuples still wanted are listed, in order, in the selection vector.
+ * The conditions narrow the selection down, and the output reads it.
+ */
+class TupleBatch {
+ public:
+
+  static const int CAPACITY = 1024;  // # tuples in a full batch
+
+  TupleBatch();
+
+  /**
+   * remove all the tuples.
+   */
+  void clear();
+
+  /**
+   * add a tuple at the end of the batch, and select it.
+   * the value is copied. the batch must not be full.
+   * @param rid[IN] the id of the tuple
+   * @param key[IN] the key of the tuple
+   * @param value[IN] the value of the tuple. it is not null-terminated
+   * @param length[IN] the length of the value
+   * @param code[IN] the dictionary code of the value, -1 if it has none
+   */
+  void add(const RecordId& rid, int key, const char* value, int length, int code = -1);
+
+  /**
+   * @return # tuples in the batch
+   */
+  int getSize() const { return size; }
+
+  /**
+   * @return true if no tuple can be added
+   */
+  bool isFull() const { return size == CAPACITY; }
+
+  const RecordId& getRid(int i) const { return rids[i]; }
+  int getKey(int i) const { return keys[i]; }
+  int getCode(int i) const { return codes[i]; }
+  const char* getValue(int i) const { return values.data() + offsets[i]; }
+  int getLength(int i) const { return lengths[i]; }
+
+  /**
+   * @return the column of the keys, indexed by the tuple
+   */
+  const int* getKeys() const { return keys; }
+
+  /**
+   * @return the column of the dictionary codes, indexed by the tuple
+   */
+  const int* getCodes() const { return codes; }
+
+  /**
+   * @return the selection vector: the tuples selected, in order.
+   *         getSelectedCount() of its entries are valid
+   */
+  int* getSelected() { return selected; }
+  const int* getSelected() const { return selected; }
+
+  /**
+   * @return # tuples selected
+   */
+  int getSelectedCount() const { return selectedCount; }
+
+  /**
+   * keep only the first n entries of the selection vector.
+   * @param n[IN] # tuples still selected
+   */
+  void setSelectedCount(int n) { selectedCount = n; }
+
+ private:
+  int         size;              // # tuples in the batch
+  RecordId    rids[CAPACITY];
+  int         keys[CAPACITY];
+  int         codes[CAPACITY];
+  int         offsets[CAPACITY]; // where every value starts in values
+  int         lengths[CAPACITY];
+  std::string values;            // the values, one after the other
+  int         selected[CAPACITY];
+  int         selectedCount;
+};
+
+#endif // TUPLEBATCH_H
@@ -0,0 +1,213 @@
+#include <cstring>
+#include <algorithm>
+#include "WriteBuffer.h"
+
+using namespace std;
+
+// Header of a log page, followed by count entries. An entry is stored as
+// the key (see BTreeKey.h), the RecordId, a one-byte length and the value
+struct LogHeader {
+  int epoch;  // the pages of earlier buffers have smaller epochs
+  int count;  // # entries in this page
+};
+
+template<class K>
+BasicWriteBuffer<K>::BasicWriteBuffer()
+{
+  for (int i = 0; i < MAX_HEIGHT; i++) head[i] = END;
+  height = 1;
+  seed = 0x9e3779b97f4a7c15ULL;
+  epoch = 0;
+  logPid = 0;
+  logOffset = sizeof(LogHeader);
+  memset(logPage, 0, PageFile::PAGE_SIZE);
+}
+
+template<class K>
+RC BasicWriteBuffer<K>::open(const string& logname, char mode, bool create)
+{
+  RC   rc;
+  bool writing = (mode == 'w' || mode == 'W');
+  // unless it is created, the log must exist already
+  if (!create || !writing) {
+    if ((rc = log.open(logname, 'r')) < 0) return rc;
+    if (writing) log.close();
+  }
+  if (writing && (rc = log.open(logname, 'w')) < 0) return rc;
+  return replay();
+}
+
+template<class K>
+RC BasicWriteBuffer<K>::close()
+{
+  entries.clear();
+  for (int i = 0; i < MAX_HEIGHT; i++) head[i] = END;
+  height = 1;
+  return log.close();
+}
+
+// Read the entries of the current epoch back from the log
+template<class K>
+RC BasicWriteBuffer<K>::replay()
+{
+  RC        rc;
+  LogHeader header;
+
+  entries.clear();
+  for (int i = 0; i < MAX_HEIGHT; i++) head[i] = END;
+  height = 1;
+  logPid = 0;
+  logOffset = sizeof(LogHeader);
+  memset(logPage, 0, PageFile::PAGE_SIZE);
+  if (log.endPid() == 0) {
+    epoch = 0;
+    return 0;
+  }
+
+  for (PageId pid = 0; pid < log.endPid(); pid++) {
+    char page[PageFile::PAGE_SIZE];
+    if ((rc = log.read(pid, page)) < 0) return rc;
+    memcpy(&header, page, sizeof(header));
+    if (pid == 0) {
+      epoch = header.epoch;
+    } else if (header.epoch != epoch) {
+      break;
+    }
+    int offset = sizeof(LogHeader);
+    for (int i = 0; i < header.count; i++) {
+      KeyType       key;
+      RecordId      rid;
+      unsigned char length;
+      offset += K::read(page + offset, key);
+      memcpy(&rid, page + offset, sizeof(RecordId));
+      offset += sizeof(RecordId);
+      length = page[offset++];
+      add(key, rid, string(page + offset, length));
+      offset += length;
+    }
+    logPid = pid;
+    logOffset = offset;
+    memcpy(logPage, page, PageFile::PAGE_SIZE);
+  }
+  return 0;
+}
+
+template<class K>
+RC BasicWriteBuffer<K>::insert(const KeyType& key, const RecordId& rid, const string& value)
+{
+  RC  rc;
+  int length = min((int)value.size(), 255);
+  int size = K::size(key) + sizeof(RecordId) + 1 + length;
+
+  // the entry goes to a new page if the last one is full
+  LogHeader header;
+  memcpy(&header, logPage, sizeof(header));
+  if (logOffset + size > PageFile::PAGE_SIZE) {
+    logPid++;
+    logOffset = sizeof(LogHeader);
+    memset(logPage, 0, PageFile::PAGE_SIZE);
+    header.count = 0;
+  }
+  header.epoch = epoch;
+  header.count++;
+
+  char* p = logPage + logOffset;
+  K::write(p, key);
+  p += K::size(key);
+  memcpy(p, &rid, sizeof(RecordId));
+  p += sizeof(RecordId);
+  *p++ = (unsigned char)length;
+  memcpy(p, value.data(), length);
+  memcpy(logPage, &header, sizeof(header));
+
+  // the entry is buffered only once it is in the log
+  if ((rc = log.write(logPid, logPage)) < 0) return rc;
+  logOffset += size;
+  add(key, rid, value.substr(0, length));
+  return 0;
+}
+
+template<class K>
+RC BasicWriteBuffer<K>::clear()
+{
+  entries.clear();
+  for (int i = 0; i < MAX_HEIGHT; i++) head[i] = END;
+  height = 1;
+
+  // the pages of the old epoch left in the log are ignored from now on
+  LogHeader header;
+  header.epoch = ++epoch;
+  header.count = 0;
+  logPid = 0;
+  logOffset = sizeof(LogHeader);
+  memset(logPage, 0, PageFile::PAGE_SIZE);
+  memcpy(logPage, &header, sizeof(header));
+  return log.write(logPid, logPage);
+}
+
+template<class K>
+int BasicWriteBuffer<K>::randomHeight()
+{
+  // xorshift64
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  int h = 1;
+  for (uint64_t bits = seed; h < MAX_HEIGHT && bits % BRANCHING == 0; bits /= BRANCHING) h++;
+  return h;
+}
+
+// Link a new entry after the entries with keys not greater than key
+template<class K>
+void BasicWriteBuffer<K>::add(const KeyType& key, const RecordId& rid, const string& value)
+{
+  int position = entries.size();
+  int h = randomHeight();
+  entries.push_back(Entry());
+  Entry& entry = entries.back();
+  entry.key = key;
+  entry.rid = rid;
+  entry.value = value;
+  entry.next.resize(h);
+
+  if (h > height) height = h;
+  int prev = END;
+  for (int level = height - 1; level >= 0; level--) {
+    int* link = (prev == END) ? &head[level] : &entries[prev].next[level];
+    while (*link != END && !(key < entries[*link].key)) {
+      prev = *link;
+      link = &entries[prev].next[level];
+    }
+    if (level < h) {
+      entry.next[level] = *link;
+      *link = position;
+    }
+  }
+}
+
+template<class K>
+int BasicWriteBuffer<K>::lowerBound(const KeyType& key) const
+{
+  int prev = END;
+  for (int level = height - 1; level >= 0; level--) {
+    int next = (prev == END) ? head[level] : entries[prev].next[level];
+    while (next != END && entries[next].key < key) {
+      prev = next;
+      next = entries[prev].next[level];
+    }
+  }
+  return (prev == END) ? head[0] : entries[prev].next[0];
+}
+
+template<class K>
+bool BasicWriteBuffer<K>::contains(const KeyType& key) const
+{
+  int position = lowerBound(key);
+  return position != END && entries[position].key == key;
+}
+
+template class BasicWriteBuffer<IntKey>;
+template class BasicWriteBuffer<StringKey>;
+template class BasicWriteBuffer<Int64Key>;
+template class BasicWriteBuffer<DoubleKey>;
+template class BasicWriteBuffer<CompositeKey>;
@@ -0,0 +1,126 @@
+#ifndef WRITEBUFFER_H
+#define WRITEBUFFER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeKey.h"
+
+/**
+ * An in-memory write buffer in front of a B+tree index, for fast ingest.
+ * Inserted (key, RecordId, value) entries are kept sorted by key in a skip
+ * list, and are merged into the tree in key order once the buffer is full,
+ * so that the tree is updated one leaf after another instead of at random.
+ * Every entry is also appended to a write-ahead log (a PageFile) before it
+ * is buffered, so that the buffered entries survive a crash: they are read
+ * back when the buffer is opened again.
+ * Entries with the same key are kept in the order they were inserted.
+ * K is the key traits class (see BTreeKey.h).
+ */
+template<class K>
+class BasicWriteBuffer {
+ public:
+  typedef typename K::Type KeyType;
+
+  // the position past the last entry
+  static const int END = -1;
+
+  BasicWriteBuffer();
+
+  /**
+   * open the log and read back the entries in it.
+   * @param logname[IN] the name of the log file
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @param create[IN] whether to create the log if it does not exist
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& logname, char mode, bool create);
+
+  /**
+   * close the log. the buffered entries stay in the log.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * log the entry and add it to the buffer.
+   * @param key[IN] the key of the entry
+   * @param rid[IN] the RecordId of the entry
+   * @param value[IN] the value stored with the entry (may be empty)
+   * @return error code. 0 if no error
+   */
+  RC insert(const KeyType& key, const RecordId& rid, const std::string& value);
+
+  /**
+   * drop every entry, once they are all merged into the tree. the log is
+   * emptied as well.
+   * @return error code. 0 if no error
+   */
+  RC clear();
+
+  /**
+   * @return the position of the first entry, END if the buffer is empty
+   */
+  int first() const { return head[0]; }
+
+  /**
+   * @return the position of the entry after the one at position
+   */
+  int next(int position) const { return entries[position].next[0]; }
+
+  /**
+   * @return the position of the first entry whose key is not smaller than
+   *         key, or END
+   */
+  int lowerBound(const KeyType& key) const;
+
+  /**
+   * @return whether some entry has key
+   */
+  bool contains(const KeyType& key) const;
+
+  const KeyType&     getKey(int position) const { return entries[position].key; }
+  const RecordId&    getRid(int position) const { return entries[position].rid; }
+  const std::string& getValue(int position) const { return entries[position].value; }
+
+  /**
+   * @return # entries in the buffer
+   */
+  int size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+
+ private:
+  // the skip list: 1 in BRANCHING entries of a level is also on the next
+  static const int MAX_HEIGHT = 12;
+  static const int BRANCHING = 4;
+
+  struct Entry {
+    KeyType          key;
+    RecordId         rid;
+    std::string      value;
+    std::vector<int> next;  // the next entry on every level of the entry
+  };
+
+  void add(const KeyType& key, const RecordId& rid, const std::string& value);
+  int  randomHeight();
+  RC   replay();
+
+  std::vector<Entry> entries;
+  int      head[MAX_HEIGHT];  // the first entry on every level
+  int      height;            // # levels in use
+  uint64_t seed;              // the state of the height generator
+
+  PageFile log;               // the write-ahead log
+  int      epoch;             // the log pages of the current buffer carry
+                              // the epoch of page 0
+  PageId   logPid;            // the last page of the log
+  int      logOffset;         // the end of the entries in that page
+  char     logPage[PageFile::PAGE_SIZE];
+};
+
+typedef BasicWriteBuffer<IntKey>    WriteBuffer;
+
+#endif // WRITEBUFFER_H
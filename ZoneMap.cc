@@ -0,0 +1,120 @@
+#include <cstring>
+#include "ZoneMap.h"
+
+// the header fields stored at the beginning of page 0
+static const int HEADER_FIELDS = 1;
+
+// copy the first PREFIX_LENGTH bytes of a value, padded with zeros
+static void prefixOf(const char* value, int length, char* prefix)
+{
+  memset(prefix, 0, ZoneMap::PREFIX_LENGTH);
+  memcpy(prefix, value, (length < ZoneMap::PREFIX_LENGTH) ? length : ZoneMap::PREFIX_LENGTH);
+}
+
+ZoneMap::ZoneMap()
+{
+}
+
+void ZoneMap::clear()
+{
+  zones.clear();
+}
+
+bool ZoneMap::add(PageId pid, int key, const char* value, int length)
+{
+  char prefix[PREFIX_LENGTH];
+  prefixOf(value, length, prefix);
+
+  // the first record of a page sets its zone
+  if (pid == (PageId)zones.size()) {
+    Zone zone;
+    zone.minKey = zone.maxKey = key;
+    memcpy(zone.minValue, prefix, PREFIX_LENGTH);
+    memcpy(zone.maxValue, prefix, PREFIX_LENGTH);
+    zones.push_back(zone);
+    return true;
+  }
+
+  Zone& zone = zones[pid];
+  bool  changed = false;
+  if (key < zone.minKey) {
+    zone.minKey = key;
+    changed = true;
+  }
+  if (key > zone.maxKey) {
+    zone.maxKey = key;
+    changed = true;
+  }
+  if (memcmp(prefix, zone.minValue, PREFIX_LENGTH) < 0) {
+    memcpy(zone.minValue, prefix, PREFIX_LENGTH);
+    changed = true;
+  }
+  if (memcmp(prefix, zone.maxValue, PREFIX_LENGTH) > 0) {
+    memcpy(zone.maxValue, prefix, PREFIX_LENGTH);
+    changed = true;
+  }
+  return changed;
+}
+
+bool ZoneMap::mayContain(PageId pid, const Bounds& bounds) const
+{
+  if (pid < 0 || pid >= (PageId)zones.size()) return true;
+  const Zone& zone = zones[pid];
+
+  if (zone.maxKey < bounds.keyMin || zone.minKey > bounds.keyMax) return false;
+
+  // a value below valueMin has a prefix at most that of valueMin, and a
+  // value above valueMax a prefix at least that of valueMax. so the bounds
+  // are compared by their prefix too
+  char prefix[PREFIX_LENGTH];
+  prefixOf(bounds.valueMin.data(), bounds.valueMin.size(), prefix);
+  if (memcmp(zone.maxValue, prefix, PREFIX_LENGTH) < 0) return false;
+  if (bounds.valueMaxSet) {
+    prefixOf(bounds.valueMax.data(), bounds.valueMax.size(), prefix);
+    if (memcmp(zone.minValue, prefix, PREFIX_LENGTH) > 0) return false;
+  }
+  return true;
+}
+
+RC ZoneMap::read(const PageFile& pf)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  header[HEADER_FIELDS];
+
+  if ((rc = pf.read(0, page)) < 0) return rc;
+  memcpy(header, page, sizeof(header));
+  if (header[0] < 0 || (header[0] + ZONES_PER_PAGE - 1) / ZONES_PER_PAGE + 1 > pf.endPid()) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  // copy the zones page by page
+  zones.resize(header[0]);
+  for (int i = 0; i < header[0]; i += ZONES_PER_PAGE) {
+    if ((rc = pf.read(1 + i / ZONES_PER_PAGE, page)) < 0) return rc;
+    int n = (header[0] - i < ZONES_PER_PAGE) ? header[0] - i : ZONES_PER_PAGE;
+    memcpy(&zones[i], page, n * sizeof(Zone));
+  }
+
+  return 0;
+}
+
+RC ZoneMap::write(PageFile& pf) const
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  header[HEADER_FIELDS] = { (int)zones.size() };
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, header, sizeof(header));
+  if ((rc = pf.write(0, page)) < 0) return rc;
+
+  for (int i = 0; i < header[0]; i += ZONES_PER_PAGE) {
+    int n = (header[0] - i < ZONES_PER_PAGE) ? header[0] - i : ZONES_PER_PAGE;
+    memset(page, 0, PageFile::PAGE_SIZE);
+    memcpy(page, &zones[i], n * sizeof(Zone));
+    if ((rc = pf.write(1 + i / ZONES_PER_PAGE, page)) < 0) return rc;
+  }
+
+  return 0;
+}
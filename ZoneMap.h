@@ -0,0 +1,95 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <string>
+#include <vector>
+#include "Bruinbase.h"
+#include "PageFile.h"
+
+/**
+ * The zone map of a RecordFile: the smallest and the largest key and
+ * value prefix of the records in every page. A scan with conditions on
+ * key or value skips the pages whose zone shows that none of their
+ * records can match, without reading them.
+ * The zone map is stored in its own PageFile: page 0 holds the header
+ * and the zones start from page 1.
+ */
+class ZoneMap {
+ public:
+
+  // # bytes of the values kept in a zone
+  static const int PREFIX_LENGTH = 8;
+
+  // the records of a page. a value is compared by its first PREFIX_LENGTH
+  // bytes, padded with zeros
+  struct Zone {
+    int  minKey;
+    int  maxKey;
+    char minValue[PREFIX_LENGTH];
+    char maxValue[PREFIX_LENGTH];
+  };
+
+  static const int ZONES_PER_PAGE = PageFile::PAGE_SIZE / sizeof(Zone);
+
+  // the records looked for by a scan: every key is in [keyMin, keyMax],
+  // every value is at least valueMin and, if valueMaxSet, at most valueMax
+  struct Bounds {
+    int         keyMin;
+    int         keyMax;
+    std::string valueMin;
+    std::string valueMax;
+    bool        valueMaxSet;
+  };
+
+  ZoneMap();
+
+  /**
+   * remove all the zones.
+   */
+  void clear();
+
+  /**
+   * add a record to the zone of its page.
+   * the pages must be filled in order: pid is the last page with a zone,
+   * or the page after it.
+   * @param pid[IN] the page of the record
+   * @param key[IN] the record key
+   * @param value[IN] the record value
+   * @param length[IN] the length of the value
+   * @return true if the zone of the page changed
+   */
+  bool add(PageId pid, int key, const char* value, int length);
+
+  /**
+   * test whether the page may hold a record within the bounds.
+   * a false answer is always correct. a page without a zone may hold any record.
+   * @param pid[IN] the page to test
+   * @param bounds[IN] the bounds of the records looked for
+   * @return false if no record of the page is within the bounds
+   */
+  bool mayContain(PageId pid, const Bounds& bounds) const;
+
+  /**
+   * @return # pages with a zone
+   */
+  int getPageCount() const { return zones.size(); }
+
+  /**
+   * read the zone map from the PageFile.
+   * @param pf[IN] PageFile to read from
+   * @return error code. 0 if no error
+   */
+  RC read(const PageFile& pf);
+
+  /**
+   * write the zone map to the PageFile.
+   * @param pf[IN] PageFile to write to
+   * @return error code. 0 if no error
+   */
+  RC write(PageFile& pf) const;
+
+ private:
+  std::vector<Zone> zones;  // the zone of every page, by PageId
+};
+
+#endif // ZONEMAP_H
@@ -0,0 +1,88 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "BTreeIndex.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+
+// Compares the insert and query throughput of the classic B+tree with the
+// buffered (B-epsilon) tree over the same random keys.
+// Usage: epsilonBench [# keys] [# queries]
+
+static double now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void report(const char* phase, int count, double seconds, int reads, int writes)
+{
+    printf("  %-8s %9.0f ops/s  %8.1f reads/op  %8.3f writes/op\n",
+           phase, count / seconds, (double)reads / count, (double)writes / count);
+}
+
+static void run(bool buffered, int keys, int queries)
+{
+    const char* name = "epsilonBench.idx";
+    unlink(name);
+    BTreeIndex tree;
+    tree.open(name, 'w');
+    tree.initializeTree(0, BTLeafNode::POSTING_LISTS, buffered);
+    tree.readRoot();
+    printf("%s tree\n", buffered ? "buffered" : "classic");
+
+    srand(1);
+    int reads = PageFile::getPageReadCount();
+    int writes = PageFile::getPageWriteCount();
+    double start = now();
+    for (int i = 0; i < keys; i++) {
+        RecordId rid;
+        rid.pid = i;
+        rid.sid = 0;
+        tree.insert(rand() % (4 * keys), rid);
+    }
+    report("insert", keys, now() - start, PageFile::getPageReadCount() - reads,
+           PageFile::getPageWriteCount() - writes);
+
+    // Point queries: locate a random key and read its first entry
+    int found = 0;
+    reads = PageFile::getPageReadCount();
+    start = now();
+    for (int i = 0; i < queries; i++) {
+        IndexCursor cursor;
+        int key;
+        RecordId rid;
+        if (tree.locate(rand() % (4 * keys), cursor) == 0 && tree.readForward(cursor, key, rid) == 0)
+            found++;
+    }
+    report("lookup", queries, now() - start, PageFile::getPageReadCount() - reads, 0);
+
+    // Range queries: read the 100 entries following a random key
+    reads = PageFile::getPageReadCount();
+    start = now();
+    for (int i = 0; i < queries / 10; i++) {
+        IndexCursor cursor;
+        int key;
+        RecordId rid;
+        tree.locate(rand() % (4 * keys), cursor);
+        for (int j = 0; j < 100 && tree.readForward(cursor, key, rid) == 0; j++)
+            ;
+    }
+    report("scan100", queries / 10, now() - start, PageFile::getPageReadCount() - reads, 0);
+    printf("  %d of %d lookups found\n", found, queries);
+
+    tree.close();
+    unlink(name);
+}
+
+int main(int argc, char** argv)
+{
+    int keys = (argc > 1) ? atoi(argv[1]) : 100000;
+    int queries = (argc > 2) ? atoi(argv[2]) : 20000;
+    run(false, keys, queries);
+    run(true, keys, queries);
+    return 0;
+}
@@ -1,5 +1,8 @@
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <iostream>
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include "BTreeNode.h"
@@ -7,9 +10,58 @@
 #include "PageFile.h"
 #include "RecordFile.h"
 
+// Read every entry of the tree as a (key, pid of the RecordId) pair, and
+// check that the keys come in order
+static bool scanTree(BTreeIndex& tree, std::vector<std::pair<int, int> >& entries) {
+    IndexCursor cursor;
+    int key;
+    RecordId rid;
+    entries.clear();
+    tree.locate(-1, cursor);
+    while (tree.readForward(cursor, key, rid) == 0) {
+        if (!entries.empty() && key < entries.back().first)
+            return false;
+        entries.push_back(std::make_pair(key, rid.pid));
+    }
+    std::sort(entries.begin(), entries.end());
+    return true;
+}
+
 int main() {
     srand(time(NULL));
 
+    // Test for reorganizing: a full scan gives the same entries before
+    // and after the tree is rewritten, and so do the inserts after it
+    BTreeIndex rtree;
+    remove("reorgtest.idx");
+    rtree.open("reorgtest.idx", 'w');
+    rtree.initializeTree();
+    rtree.readRoot();
+    std::vector<std::pair<int, int> > expected, entries;
+    RecordId rec;
+    bool ok = true;
+    for (int i = 0; i < 20000; i++) {
+        rec.pid = i;
+        rec.sid = 0;
+        int key = rand() % 5000;
+        rtree.insert(key, rec);
+        expected.push_back(std::make_pair(key, rec.pid));
+    }
+    std::sort(expected.begin(), expected.end());
+    ok = ok && scanTree(rtree, entries) && entries == expected;
+    ok = ok && rtree.reorganize() == 0 && scanTree(rtree, entries) && entries == expected;
+    for (int i = 20000; i < 25000; i++) {
+        rec.pid = i;
+        int key = rand() % 5000;
+        rtree.insert(key, rec);
+        expected.push_back(std::make_pair(key, rec.pid));
+    }
+    std::sort(expected.begin(), expected.end());
+    ok = ok && scanTree(rtree, entries) && entries == expected;
+    ok = ok && rtree.reorganize() == 0 && scanTree(rtree, entries) && entries == expected;
+    rtree.close();
+    std::cout << "reorganize: " << (ok ? "ok" : "FAILED") << std::endl;
+
     // Test for creating
     /*BTreeIndex tree;
     tree.open("indextest.txt", 'w');